@@ -6,9 +6,27 @@
  */
 
 #include "CppSQLite3.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fmt/core.h>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 
@@ -54,6 +72,250 @@ std::string_view levelToString(CppSQLite3LogLevel::Level level)
     std::terminate();
 }
 
+bool containsNoCase(std::string_view text, std::string_view pattern)
+{
+    auto it = std::search(text.begin(), text.end(), pattern.begin(), pattern.end(),
+                          [](char lhs, char rhs) { return std::toupper(lhs) == std::toupper(rhs); });
+    return it != text.end();
+}
+
+enum class Affinity
+{
+    integer,
+    text,
+    blob,
+    real,
+    numeric
+};
+
+/**
+ * @brief affinityOf applies sqlite's column affinity rules (https://sqlite.org/datatype3.html#affname)
+ */
+Affinity affinityOf(std::string_view declType)
+{
+    if (containsNoCase(declType, "INT"))
+    {
+        return Affinity::integer;
+    }
+    if (containsNoCase(declType, "CHAR") || containsNoCase(declType, "CLOB") || containsNoCase(declType, "TEXT"))
+    {
+        return Affinity::text;
+    }
+    if (declType.empty() || containsNoCase(declType, "BLOB"))
+    {
+        return Affinity::blob;
+    }
+    if (containsNoCase(declType, "REAL") || containsNoCase(declType, "FLOA") || containsNoCase(declType, "DOUB"))
+    {
+        return Affinity::real;
+    }
+    return Affinity::numeric;
+}
+
+bool hasTextAffinity(std::string_view declType)
+{
+    return affinityOf(declType) == Affinity::text;
+}
+
+/**
+ * @brief storageTypeOf picks the SQLITE_* type a column is decoded as in a CppSQLite3ColumnBatch
+ *
+ * Declared INTEGER, REAL, TEXT and BLOB columns map directly. Expressions and NUMERIC columns (which often hold
+ * dates as text) use the type of the value in the current row, NULL falls back to text.
+ */
+int storageTypeOf(sqlite3_stmt* pVM, int nCol)
+{
+    const char* szDeclType = sqlite3_column_decltype(pVM, nCol);
+    if (szDeclType != nullptr && *szDeclType != '\0')
+    {
+        switch (affinityOf(szDeclType))
+        {
+        case Affinity::integer:
+            return SQLITE_INTEGER;
+        case Affinity::real:
+            return SQLITE_FLOAT;
+        case Affinity::text:
+            return SQLITE_TEXT;
+        case Affinity::blob:
+            return SQLITE_BLOB;
+        case Affinity::numeric:
+            break;
+        }
+    }
+    int nType = sqlite3_column_type(pVM, nCol);
+    return nType == SQLITE_NULL ? SQLITE_TEXT : nType;
+}
+
+// numbers the query executions, statements and their addresses are reused
+std::atomic<std::uint64_t> gnLastQueryExecution{0};
+
+/**
+ * @brief logExpandedSQL logs the SQL of pVM with its parameters, which are only expanded with verbose logging on
+ */
+void logExpandedSQL(CppSQLite3Config& config, sqlite3_stmt* pVM)
+{
+    if (config.enableVerboseLogging)
+    {
+        char* szSQL = sqlite3_expanded_sql(pVM);
+        config.log(CppSQLite3LogLevel::verbose, szSQL);
+        sqlite3_free(szSQL);
+    }
+}
+
+/**
+ * @brief statementStatus reads the sqlite3_stmt_status counters of pVM
+ */
+CppSQLite3StatementStatus statementStatus(sqlite3_stmt* pVM, bool bReset)
+{
+    auto counter = [pVM, bReset](int nCounter)
+    { return static_cast<std::uint64_t>(sqlite3_stmt_status(pVM, nCounter, bReset ? 1 : 0)); };
+
+    CppSQLite3StatementStatus status;
+    status.fullscanSteps = counter(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+    status.sorts = counter(SQLITE_STMTSTATUS_SORT);
+    status.autoindexRows = counter(SQLITE_STMTSTATUS_AUTOINDEX);
+    status.vmSteps = counter(SQLITE_STMTSTATUS_VM_STEP);
+    status.reprepares = counter(SQLITE_STMTSTATUS_REPREPARE);
+    status.runs = counter(SQLITE_STMTSTATUS_RUN);
+    status.memoryUsed = counter(SQLITE_STMTSTATUS_MEMUSED);
+    return status;
+}
+
+/**
+ * @brief runCounters reads only the counters of pVM that the tracer sums up per run, the others stay zero
+ */
+CppSQLite3StatementStatus runCounters(sqlite3_stmt* pVM)
+{
+    auto counter = [pVM](int nCounter) { return static_cast<std::uint64_t>(sqlite3_stmt_status(pVM, nCounter, 0)); };
+
+    CppSQLite3StatementStatus status;
+    status.fullscanSteps = counter(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+    status.sorts = counter(SQLITE_STMTSTATUS_SORT);
+    status.autoindexRows = counter(SQLITE_STMTSTATUS_AUTOINDEX);
+    status.vmSteps = counter(SQLITE_STMTSTATUS_VM_STEP);
+    status.reprepares = counter(SQLITE_STMTSTATUS_REPREPARE);
+    return status;
+}
+
+bool isIdentifierChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || (c & 0x80) != 0;
+}
+
+/**
+ * @brief endOfQuoted returns the position after the quoted string starting at nStart, doubled quotes are escapes
+ */
+std::size_t endOfQuoted(std::string_view sql, std::size_t nStart, char quote)
+{
+    std::size_t nPos = nStart + 1;
+    while ((nPos = sql.find(quote, nPos)) != std::string_view::npos)
+    {
+        if (nPos + 1 < sql.size() && sql[nPos + 1] == quote)
+        {
+            nPos += 2;
+            continue;
+        }
+        return nPos + 1;
+    }
+    return sql.size();
+}
+
+/**
+ * @brief normalizeSQL copies sql to normalized with literals replaced by ? and whitespace and comments collapsed
+ *
+ * Statements only differing in their values get the same text, which groups them e.g. in profiles.
+ */
+void normalizeSQL(std::string_view sql, std::string& normalized)
+{
+    normalized.clear();
+    bool bSpace = false;
+    auto append = [&](std::string_view token)
+    {
+        if (bSpace && !normalized.empty())
+        {
+            normalized += ' ';
+        }
+        bSpace = false;
+        normalized += token;
+    };
+
+    std::size_t nPos = 0;
+    const std::size_t nSize = sql.size();
+    while (nPos < nSize)
+    {
+        const char c = sql[nPos];
+        const char next = nPos + 1 < nSize ? sql[nPos + 1] : '\0';
+        const bool bTokenStart = nPos == 0 || !isIdentifierChar(sql[nPos - 1]);
+        std::size_t nEnd = nPos + 1;
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            bSpace = true;
+        }
+        else if (c == '-' && next == '-')
+        {
+            nEnd = std::min(sql.find('\n', nPos), nSize);
+            bSpace = true;
+        }
+        else if (c == '/' && next == '*')
+        {
+            auto nClose = sql.find("*/", nPos + 2);
+            nEnd = nClose == std::string_view::npos ? nSize : nClose + 2;
+            bSpace = true;
+        }
+        else if (c == '\'')
+        {
+            nEnd = endOfQuoted(sql, nPos, c);
+            append("?");
+        }
+        else if ((c == 'x' || c == 'X') && next == '\'' && bTokenStart)
+        {
+            // blob literal
+            nEnd = endOfQuoted(sql, nPos + 1, next);
+            append("?");
+        }
+        else if (c == '"' || c == '`' || c == '[')
+        {
+            // quoted identifier
+            nEnd = c == '[' ? std::min(sql.find(']', nPos), nSize - 1) + 1 : endOfQuoted(sql, nPos, c);
+            append(sql.substr(nPos, nEnd - nPos));
+        }
+        else if (c == '?')
+        {
+            // numbered parameter, its number is not a literal
+            while (nEnd < nSize && std::isdigit(static_cast<unsigned char>(sql[nEnd])))
+            {
+                ++nEnd;
+            }
+            append(sql.substr(nPos, nEnd - nPos));
+        }
+        else if (bTokenStart && (std::isdigit(static_cast<unsigned char>(c)) ||
+                                 (c == '.' && std::isdigit(static_cast<unsigned char>(next)))))
+        {
+            // numeric literal, including fractions, exponents and hex
+            while (nEnd < nSize && (isIdentifierChar(sql[nEnd]) || sql[nEnd] == '.' ||
+                                    ((sql[nEnd] == '+' || sql[nEnd] == '-') &&
+                                     (sql[nEnd - 1] == 'e' || sql[nEnd - 1] == 'E'))))
+            {
+                ++nEnd;
+            }
+            append("?");
+        }
+        else if (isIdentifierChar(c))
+        {
+            while (nEnd < nSize && isIdentifierChar(sql[nEnd]))
+            {
+                ++nEnd;
+            }
+            append(sql.substr(nPos, nEnd - nPos));
+        }
+        else
+        {
+            append(sql.substr(nPos, 1));
+        }
+        nPos = nEnd;
+    }
+}
+
 } // namespace
 
 
@@ -80,6 +342,130 @@ void CppSQLite3Config::log(CppSQLite3LogLevel::Level level, CppSQLite3StringView
 
 ////////////////////////////////////////////////////////////////////////////////
 
+class CppSQLite3ExecutionLimits
+{
+public:
+    std::uint64_t add(sqlite3* db, std::chrono::steady_clock::time_point deadline,
+                      std::shared_ptr<std::atomic<bool>> pCancelled)
+    {
+        mLimits.push_back({++mnLastId, deadline, std::move(pCancelled)});
+        install(db);
+        return mnLastId;
+    }
+
+    void remove(sqlite3* db, std::uint64_t nId)
+    {
+        auto isRemoved = [nId](const Limit& limit) { return limit.nId == nId; };
+        mLimits.erase(std::remove_if(mLimits.begin(), mLimits.end(), isRemoved), mLimits.end());
+        mnAbortCode = SQLITE_OK;
+        install(db);
+    }
+
+    /**
+     * @brief install registers the progress handler while there are limits and removes it otherwise
+     */
+    void install(sqlite3* db)
+    {
+        if (db == nullptr)
+        {
+            return;
+        }
+        if (mLimits.empty())
+        {
+            sqlite3_progress_handler(db, 0, nullptr, nullptr);
+        }
+        else
+        {
+            sqlite3_progress_handler(db, mnCheckInterval, &CppSQLite3ExecutionLimits::progress, this);
+        }
+    }
+
+    static int progress(void* pLimits)
+    {
+        return static_cast<CppSQLite3ExecutionLimits*>(pLimits)->check();
+    }
+
+    /**
+     * @brief check tells whether the running statement has to be aborted and remembers why
+     */
+    int check()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& limit : mLimits)
+        {
+            if (limit.pCancelled && limit.pCancelled->load(std::memory_order_relaxed))
+            {
+                mnAbortCode = CPPSQLITE_CANCELLED;
+                return 1;
+            }
+            if (now >= limit.deadline)
+            {
+                mnAbortCode = CPPSQLITE_DEADLINE_EXCEEDED;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief takeAbortCode returns the error code of the latest abort once, SQLITE_OK if there was none
+     */
+    int takeAbortCode()
+    {
+        return std::exchange(mnAbortCode, SQLITE_OK);
+    }
+
+    /**
+     * @brief statementStarted forgets an abort whose interrupt wasn't reported, it belonged to an earlier statement
+     */
+    void statementStarted()
+    {
+        mnAbortCode = SQLITE_OK;
+    }
+
+    bool isActive() const
+    {
+        return !mLimits.empty();
+    }
+
+    int mnCheckInterval = 1000;
+
+private:
+    struct Limit
+    {
+        std::uint64_t nId;
+        std::chrono::steady_clock::time_point deadline;
+        std::shared_ptr<std::atomic<bool>> pCancelled; // null without token
+    };
+
+    std::vector<Limit> mLimits;
+    std::uint64_t mnLastId = 0;
+    int mnAbortCode = SQLITE_OK;
+};
+
+
+void CppSQLite3Config::error(int nErrCode, std::string_view message, std::string_view context)
+{
+    if (nErrCode == SQLITE_INTERRUPT && pLimits != nullptr)
+    {
+        // the progress handler aborts with an interrupt, tell it apart from CppSQLite3DB::interrupt
+        int nAbortCode = pLimits->takeAbortCode();
+        if (nAbortCode == CPPSQLITE_DEADLINE_EXCEEDED)
+        {
+            errorHandler(nAbortCode, "deadline exceeded", context);
+            return;
+        }
+        if (nAbortCode == CPPSQLITE_CANCELLED)
+        {
+            errorHandler(nAbortCode, "cancelled", context);
+            return;
+        }
+    }
+    errorHandler(nErrCode, message, context);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 
 CppSQLite3Exception::CppSQLite3Exception(const int nErrCode, const std::string& errorMessage)
     : std::runtime_error(errorMessage), mnErrCode(nErrCode)
@@ -149,6 +535,10 @@ std::string_view CppSQLite3Exception::errorCodeAsString(int nErrCode)
         return "SQLITE_DONE";
     case CPPSQLITE_ERROR:
         return "CPPSQLITE_ERROR";
+    case CPPSQLITE_DEADLINE_EXCEEDED:
+        return "CPPSQLITE_DEADLINE_EXCEEDED";
+    case CPPSQLITE_CANCELLED:
+        return "CPPSQLITE_CANCELLED";
     default:
         return "UNKNOWN_ERROR";
     }
@@ -156,120 +546,438 @@ std::string_view CppSQLite3Exception::errorCodeAsString(int nErrCode)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CppSQLite3Query::CppSQLite3Query() : mConfig{}
-{
-    mpVM = 0;
-    mbEof = true;
-    mnCols = 0;
-    mbOwnVM = false;
-}
-
-
-CppSQLite3Query::CppSQLite3Query(CppSQLite3Query&& rQuery)
-{
-    mConfig = rQuery.mConfig;
-    mpVM = rQuery.mpVM;
-    // Only one object can own the VM
-    rQuery.mpVM = 0;
-    mbEof = rQuery.mbEof;
-    mnCols = rQuery.mnCols;
-    mbOwnVM = rQuery.mbOwnVM;
-}
-
-
-CppSQLite3Query::CppSQLite3Query(const CppSQLite3Config& config, sqlite3_stmt* pVM, bool bEof, bool bOwnVM /*=true*/)
+class CppSQLite3ColumnMap
 {
-    mConfig = config;
-    mpVM = pVM;
-    mbEof = bEof;
-    mnCols = sqlite3_column_count(mpVM);
-    mbOwnVM = bOwnVM;
-}
+public:
+    CppSQLite3ColumnMap() = default;
 
-
-CppSQLite3Query::~CppSQLite3Query()
-{
-    try
+    /**
+     * @brief CppSQLite3ColumnMap indexes names detached from a statement, e.g. those of a CppSQLite3ResultSet
+     */
+    explicit CppSQLite3ColumnMap(std::vector<std::string> names) : mNames(std::move(names))
     {
-        finalize();
+        mIndex.reserve(mNames.size());
+        for (std::size_t nField = 0; nField < mNames.size(); ++nField)
+        {
+            // emplace keeps the first of duplicate names
+            mIndex.emplace(mNames[nField], static_cast<int>(nField));
+        }
     }
-    catch (const std::exception& e)
+
+    /**
+     * @brief find returns the index of the first detached name that matches or -1
+     */
+    int find(std::string_view name) const
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Query: {}", e.what()));
+        auto it = mIndex.find(name);
+        return it == mIndex.end() ? -1 : it->second;
     }
 
-    catch (...)
+    /**
+     * @brief find returns the index of the first column with the given name or -1
+     */
+    int find(sqlite3_stmt* pVM, std::string_view name)
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3Query"));
+        refresh(pVM);
+        if (mIndex.empty())
+        {
+            build(pVM);
+        }
+        auto it = mIndex.find(name);
+        return it == mIndex.end() ? -1 : it->second;
     }
-}
-
 
-CppSQLite3Query& CppSQLite3Query::operator=(CppSQLite3Query&& rQuery)
-{
-    try
+    /**
+     * @brief isChecked tells whether the row layout of rowType was already checked against the statement's columns
+     */
+    bool isChecked(sqlite3_stmt* pVM, std::type_index rowType)
     {
-        finalize();
+        refresh(pVM);
+        return std::find(mCheckedRowTypes.begin(), mCheckedRowTypes.end(), rowType) != mCheckedRowTypes.end();
     }
-    catch (const std::exception& e)
+
+    void markChecked(std::type_index rowType)
     {
-        mConfig.log(CppSQLite3LogLevel::error,
-                    fmt::format("failed to finalize CppSQLite3Query on reassign: {}", e.what()));
+        mCheckedRowTypes.push_back(rowType);
     }
 
-    catch (...)
+private:
+    void refresh(sqlite3_stmt* pVM)
     {
-        mConfig.log(CppSQLite3LogLevel::error,
-                    fmt::format("unknown error when finalizing CppSQLite3Query on reassign"));
+        // the keys view the names owned by the statement, they change when sqlite recompiles it after a schema change
+        int nReprepares = sqlite3_stmt_status(pVM, SQLITE_STMTSTATUS_REPREPARE, 0);
+        if (nReprepares != mnReprepares)
+        {
+            mIndex.clear();
+            mCheckedRowTypes.clear();
+            mnReprepares = nReprepares;
+        }
     }
-    mpVM = rQuery.mpVM;
-    rQuery.mpVM = 0;
-    mbEof = rQuery.mbEof;
-    mnCols = rQuery.mnCols;
-    mbOwnVM = rQuery.mbOwnVM;
-    mConfig = rQuery.mConfig;
-    return *this;
-}
 
+    void build(sqlite3_stmt* pVM)
+    {
+        int nCols = sqlite3_column_count(pVM);
+        mIndex.reserve(nCols);
+        for (int nField = 0; nField < nCols; nField++)
+        {
+            const char* szName = sqlite3_column_name(pVM, nField);
+            if (szName != nullptr)
+            {
+                // emplace keeps the first of duplicate names
+                mIndex.emplace(szName, nField);
+            }
+        }
+    }
 
-int CppSQLite3Query::numFields() const
-{
-    checkVM();
-    return mnCols;
-}
+    std::vector<std::string> mNames; // names of a detached map, viewed by mIndex
+    std::unordered_map<std::string_view, int> mIndex;
+    std::vector<std::type_index> mCheckedRowTypes;
+    int mnReprepares = -1;
+};
 
+////////////////////////////////////////////////////////////////////////////////
 
-const char* CppSQLite3Query::fieldValue(int nField) const
+class CppSQLite3StatementCache
 {
-    checkVM();
+public:
+    CppSQLite3StatementCache() = default;
+    CppSQLite3StatementCache(const CppSQLite3StatementCache&) = delete;
+    CppSQLite3StatementCache& operator=(const CppSQLite3StatementCache&) = delete;
 
-    if (nField < 0 || nField > mnCols - 1)
+    ~CppSQLite3StatementCache()
     {
-        throw std::invalid_argument("Invalid field index requested");
+        clear();
     }
 
-    return (const char*)sqlite3_column_text(mpVM, nField);
-}
-
+    /**
+     * @brief acquire removes the statement compiled from sql from the cache
+     * @return the reset statement or nullptr if it is not cached
+     */
+    sqlite3_stmt* acquire(std::string_view sql, std::shared_ptr<CppSQLite3ColumnMap>& pColumns)
+    {
+        if (mStats.capacity == 0)
+        {
+            return nullptr;
+        }
+        auto it = mIndex.find(sql);
+        if (it == mIndex.end())
+        {
+            ++mStats.misses;
+            return nullptr;
+        }
+        ++mStats.hits;
+        sqlite3_stmt* pVM = it->second->pVM;
+        pColumns = std::move(it->second->pColumns);
+        mStatements.erase(it->second);
+        mIndex.erase(it);
+        return pVM;
+    }
 
-const char* CppSQLite3Query::fieldValue(CppSQLite3StringView field) const
-{
-    int nField = fieldIndex(field);
-    return (const char*)sqlite3_column_text(mpVM, nField);
-}
+    /**
+     * @brief release resets the statement and puts it back into the cache (or finalizes it if there is no room)
+     * @return the result of sqlite3_reset, i.e. the error code of the last evaluation of the statement
+     */
+    int release(sqlite3_stmt* pVM, std::shared_ptr<CppSQLite3ColumnMap> pColumns)
+    {
+        int nRet = sqlite3_reset(pVM);
+        sqlite3_clear_bindings(pVM);
 
+        // the key views the SQL text that sqlite keeps alive together with the statement
+        std::string_view sql = sqlite3_sql(pVM);
+        if (mStats.capacity == 0 || mIndex.count(sql) != 0)
+        {
+            sqlite3_finalize(pVM);
+            return nRet;
+        }
+        mStatements.push_front(Statement{pVM, ++mnClock, std::move(pColumns)});
+        mIndex.emplace(sql, mStatements.begin());
+        evict(mStats.capacity);
+        return nRet;
+    }
 
-int CppSQLite3Query::getIntField(int nField, int nNullValue /*=0*/) const
-{
-    if (fieldDataType(nField) == SQLITE_NULL)
+    struct Script
     {
-        return nNullValue;
-    }
-    else
+        std::string sql;
+        std::vector<sqlite3_stmt*> vms;
+        std::uint64_t nLastUse;
+        bool bInUse;
+    };
+
+    /**
+     * @brief acquireScript looks up the statements compiled from a (multi-statement) sql text
+     *
+     * The script stays in the cache, but is marked as in use until it is handed back with releaseScript
+     * or discardScript.
+     * @return the cached script or nullptr if it is not cached or already in use
+     */
+    Script* acquireScript(std::string_view sql)
     {
-        return sqlite3_column_int(mpVM, nField);
+        if (mStats.capacity == 0)
+        {
+            return nullptr;
+        }
+        auto it = mScriptIndex.find(sql);
+        if (it == mScriptIndex.end() || it->second->bInUse)
+        {
+            ++mStats.misses;
+            return nullptr;
+        }
+        ++mStats.hits;
+        mScripts.splice(mScripts.begin(), mScripts, it->second);
+        Script& script = mScripts.front();
+        script.nLastUse = ++mnClock;
+        script.bInUse = true;
+        return &script;
     }
-}
+
+    void releaseScript(Script* pScript)
+    {
+        pScript->bInUse = false;
+    }
+
+    /**
+     * @brief discardScript removes a script that failed to execute from the cache
+     */
+    void discardScript(Script* pScript)
+    {
+        auto it = mScriptIndex.find(pScript->sql);
+        finalizeAll(pScript->vms);
+        mScripts.erase(it->second);
+        mScriptIndex.erase(it);
+    }
+
+    /**
+     * @brief insertScript adds the reset statements of a freshly compiled script to the cache
+     */
+    void insertScript(std::string_view sql, std::vector<sqlite3_stmt*> vms)
+    {
+        if (vms.empty())
+        {
+            return;
+        }
+        if (mStats.capacity == 0 || mScriptIndex.count(sql) != 0)
+        {
+            finalizeAll(vms);
+            return;
+        }
+        mScripts.push_front(Script{std::string(sql), std::move(vms), ++mnClock, false});
+        mScriptIndex.emplace(mScripts.front().sql, mScripts.begin());
+        evict(mStats.capacity);
+    }
+
+    void clear()
+    {
+        for (auto& statement : mStatements)
+        {
+            sqlite3_finalize(statement.pVM);
+        }
+        mIndex.clear();
+        mStatements.clear();
+        for (auto& script : mScripts)
+        {
+            finalizeAll(script.vms);
+        }
+        mScriptIndex.clear();
+        mScripts.clear();
+    }
+
+    void setCapacity(std::size_t nStatements)
+    {
+        mStats.capacity = nStatements;
+        evict(nStatements);
+    }
+
+    std::size_t capacity() const
+    {
+        return mStats.capacity;
+    }
+
+    CppSQLite3StatementCacheStats stats() const
+    {
+        CppSQLite3StatementCacheStats stats = mStats;
+        stats.size = mStatements.size() + mScripts.size();
+        return stats;
+    }
+
+    static void finalizeAll(const std::vector<sqlite3_stmt*>& vms)
+    {
+        for (sqlite3_stmt* pVM : vms)
+        {
+            sqlite3_finalize(pVM);
+        }
+    }
+
+private:
+    struct Statement
+    {
+        sqlite3_stmt* pVM;
+        std::uint64_t nLastUse;
+        std::shared_ptr<CppSQLite3ColumnMap> pColumns;
+    };
+
+    void evict(std::size_t nMaxSize)
+    {
+        // statements and scripts share the capacity, whichever was used least recently goes first
+        while (mStatements.size() + mScripts.size() > nMaxSize)
+        {
+            if (mScripts.empty() || (!mStatements.empty() && mStatements.back().nLastUse < mScripts.back().nLastUse))
+            {
+                sqlite3_stmt* pVM = mStatements.back().pVM;
+                mIndex.erase(sqlite3_sql(pVM));
+                mStatements.pop_back();
+                sqlite3_finalize(pVM);
+            }
+            else if (mScripts.back().bInUse)
+            {
+                // only happens while a script is executed, the cache shrinks once it is released
+                break;
+            }
+            else
+            {
+                mScriptIndex.erase(mScripts.back().sql);
+                finalizeAll(mScripts.back().vms);
+                mScripts.pop_back();
+            }
+            ++mStats.evictions;
+        }
+    }
+
+    std::uint64_t mnClock = 0;
+    std::list<Statement> mStatements; // most recently used first
+    std::unordered_map<std::string_view, std::list<Statement>::iterator> mIndex;
+    std::list<Script> mScripts; // most recently used first
+    std::unordered_map<std::string_view, std::list<Script>::iterator> mScriptIndex;
+    CppSQLite3StatementCacheStats mStats;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3Query::CppSQLite3Query() : mConfig{}
+{
+    mpVM = 0;
+    mbEof = true;
+    mnCols = 0;
+    mbOwnVM = false;
+    mnExecution = 0;
+}
+
+
+CppSQLite3Query::CppSQLite3Query(CppSQLite3Query&& rQuery)
+{
+    mConfig = rQuery.mConfig;
+    mpVM = rQuery.mpVM;
+    // Only one object can own the VM
+    rQuery.mpVM = 0;
+    mbEof = rQuery.mbEof;
+    mnCols = rQuery.mnCols;
+    mbOwnVM = rQuery.mbOwnVM;
+    mnExecution = rQuery.mnExecution;
+    mpCache = std::move(rQuery.mpCache);
+    mpColumns = std::move(rQuery.mpColumns);
+}
+
+
+CppSQLite3Query::CppSQLite3Query(const CppSQLite3Config& config, sqlite3_stmt* pVM, bool bEof, bool bOwnVM /*=true*/,
+                                 std::shared_ptr<CppSQLite3StatementCache> pCache /*=nullptr*/,
+                                 std::shared_ptr<CppSQLite3ColumnMap> pColumns /*=nullptr*/)
+{
+    mConfig = config;
+    mpVM = pVM;
+    mbEof = bEof;
+    mnCols = sqlite3_column_count(mpVM);
+    mbOwnVM = bOwnVM;
+    mnExecution = ++gnLastQueryExecution;
+    mpCache = std::move(pCache);
+    mpColumns = std::move(pColumns);
+}
+
+
+CppSQLite3Query::~CppSQLite3Query()
+{
+    try
+    {
+        finalize();
+    }
+    catch (const std::exception& e)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Query: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3Query"));
+    }
+}
+
+
+CppSQLite3Query& CppSQLite3Query::operator=(CppSQLite3Query&& rQuery)
+{
+    try
+    {
+        finalize();
+    }
+    catch (const std::exception& e)
+    {
+        mConfig.log(CppSQLite3LogLevel::error,
+                    fmt::format("failed to finalize CppSQLite3Query on reassign: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        mConfig.log(CppSQLite3LogLevel::error,
+                    fmt::format("unknown error when finalizing CppSQLite3Query on reassign"));
+    }
+    mpVM = rQuery.mpVM;
+    rQuery.mpVM = 0;
+    mbEof = rQuery.mbEof;
+    mnCols = rQuery.mnCols;
+    mbOwnVM = rQuery.mbOwnVM;
+    mnExecution = rQuery.mnExecution;
+    mpCache = std::move(rQuery.mpCache);
+    mpColumns = std::move(rQuery.mpColumns);
+    mConfig = rQuery.mConfig;
+    return *this;
+}
+
+
+int CppSQLite3Query::numFields() const
+{
+    checkVM();
+    return mnCols;
+}
+
+
+const char* CppSQLite3Query::fieldValue(int nField) const
+{
+    checkVM();
+
+    if (nField < 0 || nField > mnCols - 1)
+    {
+        throw std::invalid_argument("Invalid field index requested");
+    }
+
+    return (const char*)sqlite3_column_text(mpVM, nField);
+}
+
+
+const char* CppSQLite3Query::fieldValue(CppSQLite3StringView field) const
+{
+    int nField = fieldIndex(field);
+    return (const char*)sqlite3_column_text(mpVM, nField);
+}
+
+
+int CppSQLite3Query::getIntField(int nField, int nNullValue /*=0*/) const
+{
+    if (fieldDataType(nField) == SQLITE_NULL)
+    {
+        return nNullValue;
+    }
+    else
+    {
+        return sqlite3_column_int(mpVM, nField);
+    }
+}
 
 
 int CppSQLite3Query::getIntField(CppSQLite3StringView field, int nNullValue /*=0*/) const
@@ -360,6 +1068,30 @@ const unsigned char* CppSQLite3Query::getBlobField(CppSQLite3StringView field, i
 }
 
 
+std::string_view CppSQLite3Query::getStringView(int nField) const
+{
+    return get<std::string_view>(nField);
+}
+
+
+std::string_view CppSQLite3Query::getStringView(CppSQLite3StringView field) const
+{
+    return get<std::string_view>(field);
+}
+
+
+CppSQLite3BlobView CppSQLite3Query::getBlobView(int nField) const
+{
+    return get<CppSQLite3BlobView>(nField);
+}
+
+
+CppSQLite3BlobView CppSQLite3Query::getBlobView(CppSQLite3StringView field) const
+{
+    return get<CppSQLite3BlobView>(field);
+}
+
+
 bool CppSQLite3Query::fieldIsNull(int nField) const
 {
     return (fieldDataType(nField) == SQLITE_NULL);
@@ -379,14 +1111,14 @@ int CppSQLite3Query::fieldIndex(CppSQLite3StringView field) const
 
     if (field.c_str())
     {
-        for (int nField = 0; nField < mnCols; nField++)
+        if (!mpColumns)
         {
-            CppSQLite3StringView temp = sqlite3_column_name(mpVM, nField);
-
-            if (field == temp)
-            {
-                return nField;
-            }
+            mpColumns = std::make_shared<CppSQLite3ColumnMap>();
+        }
+        int nField = mpColumns->find(mpVM, field);
+        if (nField >= 0)
+        {
+            return nField;
         }
     }
 
@@ -394,6 +1126,43 @@ int CppSQLite3Query::fieldIndex(CppSQLite3StringView field) const
 }
 
 
+CppSQLite3Column CppSQLite3Query::column(CppSQLite3StringView field) const
+{
+    return CppSQLite3Column(fieldIndex(field));
+}
+
+
+void CppSQLite3Query::checkRowLayout(const std::type_info& rowType, const bool* pbNumericFields, int nFields) const
+{
+    checkVM();
+
+    if (!mpColumns)
+    {
+        mpColumns = std::make_shared<CppSQLite3ColumnMap>();
+    }
+    if (mpColumns->isChecked(mpVM, rowType))
+    {
+        return;
+    }
+
+    if (nFields != mnCols)
+    {
+        throw std::invalid_argument(
+            fmt::format("Invalid row type: {} fields for {} columns in \"{}\"", nFields, mnCols, sqlite3_sql(mpVM)));
+    }
+    for (int nField = 0; nField < nFields; ++nField)
+    {
+        const char* szDeclType = sqlite3_column_decltype(mpVM, nField);
+        if (pbNumericFields[nField] && szDeclType != nullptr && hasTextAffinity(szDeclType))
+        {
+            throw std::invalid_argument(fmt::format("Invalid row type: numeric field {} for column {} of type {}",
+                                                    nField, sqlite3_column_name(mpVM, nField), szDeclType));
+        }
+    }
+    mpColumns->markChecked(rowType);
+}
+
+
 const char* CppSQLite3Query::fieldName(int nCol) const
 {
     checkVM();
@@ -443,7 +1212,12 @@ bool CppSQLite3Query::eof() const
 void CppSQLite3Query::nextRow()
 {
     checkVM();
+    stepRow();
+}
+
 
+bool CppSQLite3Query::stepRow()
+{
     int nRet = sqlite3_step(mpVM);
 
     if (nRet == SQLITE_DONE)
@@ -459,12 +1233,13 @@ void CppSQLite3Query::nextRow()
     {
         if (mbOwnVM)
         {
-            nRet = sqlite3_finalize(mpVM);
-            mpVM = 0;
+            nRet = releaseVM();
         }
         const char* szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRet, szError, "when getting next row");
+        mConfig.error(nRet, szError, "when getting next row");
+        return false;
     }
+    return true;
 }
 
 
@@ -472,17 +1247,24 @@ void CppSQLite3Query::finalize()
 {
     if (mpVM && mbOwnVM)
     {
-        int nRet = sqlite3_finalize(mpVM);
-        mpVM = 0;
+        int nRet = releaseVM();
         if (nRet != SQLITE_OK)
         {
             const char* szError = sqlite3_errmsg(mConfig.db);
-            mConfig.errorHandler(nRet, szError, "during finalize");
+            mConfig.error(nRet, szError, "during finalize");
         }
+        mConfig.logTraceWarnings();
     }
 }
 
 
+CppSQLite3StatementStatus CppSQLite3Query::status(bool bReset) const
+{
+    checkVM();
+    return statementStatus(mpVM, bReset);
+}
+
+
 void CppSQLite3Query::checkVM() const
 {
     if (mpVM == 0)
@@ -491,453 +1273,3725 @@ void CppSQLite3Query::checkVM() const
     }
 }
 
-////////////////////////////////////////////////////////////////////////////////
 
-CppSQLite3Statement::CppSQLite3Statement() : mConfig{}
+CppSQLite3RowIterator CppSQLite3Query::begin()
 {
-    mpVM = 0;
+    checkVM();
+    return mbEof ? CppSQLite3RowIterator() : CppSQLite3RowIterator(*this);
 }
 
 
-CppSQLite3Statement::CppSQLite3Statement(CppSQLite3Statement&& rStatement)
+CppSQLite3RowIterator CppSQLite3Query::end()
 {
-    mConfig = rStatement.mConfig;
-    mpVM = rStatement.mpVM;
-    // Only one object can own VM
-    rStatement.mpVM = 0;
+    return CppSQLite3RowIterator();
 }
 
 
-CppSQLite3Statement::CppSQLite3Statement(const CppSQLite3Config& config, sqlite3_stmt* pVM) : mConfig(config), mpVM(pVM)
+int CppSQLite3Query::releaseVM()
 {
+    sqlite3_stmt* pVM = mpVM;
+    mpVM = 0;
+    if (mpCache)
+    {
+        auto pCache = std::move(mpCache);
+        return pCache->release(pVM, std::move(mpColumns));
+    }
+    return sqlite3_finalize(pVM);
 }
 
-
-CppSQLite3Statement::~CppSQLite3Statement()
+std::size_t CppSQLite3Query::fetchBatch(CppSQLite3ColumnBatch& batch, std::size_t nMaxRows)
 {
-    try
+    checkVM();
+
+    batch.reset(mpVM, mnExecution, mnCols, nMaxRows);
+    while (batch.mnRows < nMaxRows && !mbEof)
     {
-        finalize();
+        batch.appendRow(mpVM);
+        if (!stepRow())
+        {
+            break;
+        }
     }
-    catch (const std::exception& e)
+    return batch.mnRows;
+}
+
+CppSQLite3ResultSet CppSQLite3Query::materialize()
+{
+    checkVM();
+
+    CppSQLite3ResultSet result;
+    result.mnCols = mnCols;
+    for (int nCol = 0; nCol < mnCols; ++nCol)
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Statement: {}", e.what()));
+        result.mNames.emplace_back(sqlite3_column_name(mpVM, nCol));
+        const char* szDeclType = sqlite3_column_decltype(mpVM, nCol);
+        result.mDeclTypes.push_back(szDeclType ? std::optional<std::string>(szDeclType) : std::nullopt);
     }
+    result.mpColumns = std::make_shared<const CppSQLite3ColumnMap>(result.mNames);
 
-    catch (...)
+    while (!mbEof)
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3Statement"));
+        result.appendRow(mpVM);
+        if (!stepRow())
+        {
+            break;
+        }
     }
-}
-
 
-CppSQLite3Statement& CppSQLite3Statement::operator=(CppSQLite3Statement&& rStatement)
-{
-    try
+    if (mbOwnVM)
     {
         finalize();
     }
-    catch (const std::exception& e)
+    else if (mpVM)
     {
-        mConfig.log(CppSQLite3LogLevel::error,
-                    fmt::format("error when finalizing CppSQLite3Statement during reassign: {}", e.what()));
+        // the statement belongs to a CppSQLite3Statement, resetting it ends the read transaction
+        sqlite3_reset(mpVM);
+        mpVM = 0;
     }
+    return result;
+}
 
-    catch (...)
+////////////////////////////////////////////////////////////////////////////////
+
+int CppSQLite3ResultSet::numFields() const
+{
+    return mnCols;
+}
+
+
+int CppSQLite3ResultSet::numRows() const
+{
+    return mnRows;
+}
+
+
+int CppSQLite3ResultSet::fieldIndex(CppSQLite3StringView field) const
+{
+    if (field.c_str() && mpColumns)
     {
-        mConfig.log(CppSQLite3LogLevel::error,
-                    fmt::format("unknown error when finalizing ~CppSQLite3Statement during reassign"));
+        int nField = mpColumns->find(field.c_str());
+        if (nField >= 0)
+        {
+            return nField;
+        }
     }
 
-    mConfig = rStatement.mConfig;
-    mpVM = rStatement.mpVM;
-    // Only one object can own VM
-    rStatement.mpVM = 0;
-    return *this;
+    throw std::invalid_argument("Invalid field name requested");
 }
 
 
-int CppSQLite3Statement::execDML()
+CppSQLite3Column CppSQLite3ResultSet::column(CppSQLite3StringView field) const
 {
-    checkDB();
-    checkVM();
+    return CppSQLite3Column(fieldIndex(field));
+}
 
-    const char* szError = 0;
 
-    mConfig.log(CppSQLite3LogLevel::verbose, sqlite3_expanded_sql(mpVM));
+const char* CppSQLite3ResultSet::fieldName(int nCol) const
+{
+    if (nCol < 0 || nCol > mnCols - 1)
+    {
+        throw std::invalid_argument("Invalid field index requested");
+    }
+
+    return mNames[nCol].c_str();
+}
 
-    int nRet = sqlite3_step(mpVM);
 
-    if (nRet == SQLITE_DONE)
+const char* CppSQLite3ResultSet::fieldDeclType(int nCol) const
+{
+    if (nCol < 0 || nCol > mnCols - 1)
     {
-        int nRowsChanged = sqlite3_changes(mConfig.db);
+        throw std::invalid_argument("Invalid field index requested");
+    }
 
-        nRet = sqlite3_reset(mpVM);
+    return mDeclTypes[nCol] ? mDeclTypes[nCol]->c_str() : nullptr;
+}
 
-        if (nRet != SQLITE_OK)
-        {
-            szError = sqlite3_errmsg(mConfig.db);
-            mConfig.errorHandler(nRet, szError, "when getting number of rows changed");
-        }
 
-        return nRowsChanged;
-    }
-    else
+int CppSQLite3ResultSet::fieldDataType(int nCol) const
+{
+    return cell(nCol).type;
+}
+
+
+const char* CppSQLite3ResultSet::fieldValue(int nField) const
+{
+    const Cell& value = cell(nField);
+    switch (value.type)
     {
-        nRet = sqlite3_reset(mpVM);
-        szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRet, szError, "when executing DML statement");
-        return 0;
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+        return numericText(value).c_str();
+    case SQLITE_NULL:
+        return nullptr;
+    default:
+        return mArena.data() + value.nOffset;
     }
 }
 
 
-CppSQLite3Query CppSQLite3Statement::execQuery()
+const char* CppSQLite3ResultSet::fieldValue(CppSQLite3StringView field) const
 {
-    checkDB();
-    checkVM();
+    return fieldValue(fieldIndex(field));
+}
 
-    mConfig.log(CppSQLite3LogLevel::verbose, sqlite3_expanded_sql(mpVM));
 
-    int nRet = sqlite3_step(mpVM);
+int CppSQLite3ResultSet::getIntField(int nField, int nNullValue /*=0*/) const
+{
+    // truncated like sqlite3_column_int
+    return fieldIsNull(nField) ? nNullValue : static_cast<int>(getInt64Field(nField));
+}
 
-    if (nRet == SQLITE_DONE)
-    {
-        // no rows
-        return CppSQLite3Query(mConfig, mpVM, true /*eof*/, false);
-    }
-    else if (nRet == SQLITE_ROW)
-    {
-        // at least 1 row
-        return CppSQLite3Query(mConfig, mpVM, false /*eof*/, false);
-    }
-    else
+
+int CppSQLite3ResultSet::getIntField(CppSQLite3StringView field, int nNullValue /*=0*/) const
+{
+    return getIntField(fieldIndex(field), nNullValue);
+}
+
+
+long long CppSQLite3ResultSet::getInt64Field(int nField, long long nNullValue /*=0*/) const
+{
+    const Cell& value = cell(nField);
+    switch (value.type)
     {
-        nRet = sqlite3_reset(mpVM);
-        const char* szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRet, szError, "when evaluating query");
-        return CppSQLite3Query();
+    case SQLITE_INTEGER:
+        return value.nValue;
+    case SQLITE_FLOAT:
+        // saturated like sqlite3_column_int64
+        if (value.fValue <= static_cast<double>(std::numeric_limits<long long>::min()))
+        {
+            return std::numeric_limits<long long>::min();
+        }
+        if (value.fValue >= static_cast<double>(std::numeric_limits<long long>::max()))
+        {
+            return std::numeric_limits<long long>::max();
+        }
+        return static_cast<long long>(value.fValue);
+    case SQLITE_NULL:
+        return nNullValue;
+    default:
+        return std::strtoll(mArena.data() + value.nOffset, nullptr, 10);
     }
 }
 
 
-void CppSQLite3Statement::bind(int nParam, CppSQLite3StringView value)
+long long CppSQLite3ResultSet::getInt64Field(CppSQLite3StringView field, long long nNullValue /*=0*/) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_text(mpVM, nParam, value.c_str(), -1, SQLITE_TRANSIENT);
-    checkReturnCode(nRes, "when binding string param");
+    return getInt64Field(fieldIndex(field), nNullValue);
 }
 
 
-void CppSQLite3Statement::bind(int nParam, const int nValue)
+double CppSQLite3ResultSet::getFloatField(int nField, double fNullValue /*=0.0*/) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_int(mpVM, nParam, nValue);
-    checkReturnCode(nRes, "when binding int param");
+    const Cell& value = cell(nField);
+    switch (value.type)
+    {
+    case SQLITE_INTEGER:
+        return static_cast<double>(value.nValue);
+    case SQLITE_FLOAT:
+        return value.fValue;
+    case SQLITE_NULL:
+        return fNullValue;
+    default:
+        return std::strtod(mArena.data() + value.nOffset, nullptr);
+    }
 }
 
 
-void CppSQLite3Statement::bind(int nParam, const long long nValue)
+double CppSQLite3ResultSet::getFloatField(CppSQLite3StringView field, double fNullValue /*=0.0*/) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_int64(mpVM, nParam, nValue);
-    checkReturnCode(nRes, "when binding int64 param");
+    return getFloatField(fieldIndex(field), fNullValue);
 }
 
 
-void CppSQLite3Statement::bind(int nParam, const double dValue)
+const char* CppSQLite3ResultSet::getStringField(int nField, const char* szNullValue /*=""*/) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_double(mpVM, nParam, dValue);
-    checkReturnCode(nRes, "when binding double param");
+    return fieldIsNull(nField) ? szNullValue : fieldValue(nField);
 }
 
 
-void CppSQLite3Statement::bind(int nParam, const unsigned char* blobValue, int nLen)
+const char* CppSQLite3ResultSet::getStringField(CppSQLite3StringView field, const char* szNullValue /*=""*/) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_blob(mpVM, nParam, (const void*)blobValue, nLen, SQLITE_TRANSIENT);
+    return getStringField(fieldIndex(field), szNullValue);
+}
 
-    checkReturnCode(nRes, "when binding blob param");
+
+const unsigned char* CppSQLite3ResultSet::getBlobField(int nField, int& nLen) const
+{
+    CppSQLite3BlobView blob = getBlobView(nField);
+    nLen = static_cast<int>(blob.size());
+    return fieldIsNull(nField) ? nullptr : blob.data();
 }
 
 
-void CppSQLite3Statement::bindNull(int nParam)
+const unsigned char* CppSQLite3ResultSet::getBlobField(CppSQLite3StringView field, int& nLen) const
 {
-    checkVM();
-    int nRes = sqlite3_bind_null(mpVM, nParam);
-    checkReturnCode(nRes, "when binding NULL param");
+    return getBlobField(fieldIndex(field), nLen);
 }
 
 
-void CppSQLite3Statement::reset()
+std::string_view CppSQLite3ResultSet::getStringView(int nField) const
 {
-    if (mpVM)
+    const Cell& value = cell(nField);
+    switch (value.type)
     {
-        int nRet = sqlite3_reset(mpVM);
-        checkReturnCode(nRet, "when reseting statement");
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT:
+        return numericText(value);
+    case SQLITE_NULL:
+        return std::string_view();
+    default:
+        return std::string_view(mArena.data() + value.nOffset, value.nBytes);
     }
 }
 
 
-void CppSQLite3Statement::finalize()
+std::string_view CppSQLite3ResultSet::getStringView(CppSQLite3StringView field) const
 {
-    if (mpVM)
-    {
-        int nRet = sqlite3_finalize(mpVM);
-        mpVM = 0;
-        checkReturnCode(nRet, "when finalizing statement");
-    }
+    return getStringView(fieldIndex(field));
 }
 
 
-void CppSQLite3Statement::checkDB() const
+CppSQLite3BlobView CppSQLite3ResultSet::getBlobView(int nField) const
 {
-    if (mConfig.db == 0)
-    {
-        throw std::logic_error("Database not open");
-    }
+    std::string_view bytes = getStringView(nField);
+    return CppSQLite3BlobView(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
 }
 
 
-void CppSQLite3Statement::checkVM() const
+CppSQLite3BlobView CppSQLite3ResultSet::getBlobView(CppSQLite3StringView field) const
 {
-    if (mpVM == 0)
-    {
-        throw std::logic_error("Null Virtual Machine pointer");
-    }
+    return getBlobView(fieldIndex(field));
 }
 
-void CppSQLite3Statement::checkReturnCode(int nRes, const char* context)
+
+bool CppSQLite3ResultSet::fieldIsNull(int nField) const
 {
-    if (nRes != SQLITE_OK)
-    {
-        const char* szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRes, szError, context);
-    }
+    return cell(nField).type == SQLITE_NULL;
 }
 
 
-////////////////////////////////////////////////////////////////////////////////
+bool CppSQLite3ResultSet::fieldIsNull(CppSQLite3StringView field) const
+{
+    return fieldIsNull(fieldIndex(field));
+}
 
-CppSQLite3DB::CppSQLite3DB() : mConfig{}, mnBusyTimeoutMs(60'000) // 60 seconds
+
+bool CppSQLite3ResultSet::eof() const
 {
+    return mnRow >= mnRows;
 }
 
-CppSQLite3DB::~CppSQLite3DB()
+
+void CppSQLite3ResultSet::nextRow()
 {
-    try
+    if (mnRow < mnRows)
     {
-        close();
+        ++mnRow;
     }
-    catch (std::exception& e)
+}
+
+
+void CppSQLite3ResultSet::setRow(int nRow)
+{
+    if (nRow < 0 || nRow > mnRows - 1)
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3DB: {}", e.what()));
+        throw std::invalid_argument("Invalid row index requested");
     }
-    catch (...)
+    mnRow = nRow;
+}
+
+
+void CppSQLite3ResultSet::appendRow(sqlite3_stmt* pVM)
+{
+    for (int nCol = 0; nCol < mnCols; ++nCol)
     {
-        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3DB"));
+        Cell value{};
+        value.type = sqlite3_column_type(pVM, nCol);
+        switch (value.type)
+        {
+        case SQLITE_INTEGER:
+            value.nValue = sqlite3_column_int64(pVM, nCol);
+            break;
+        case SQLITE_FLOAT:
+            value.fValue = sqlite3_column_double(pVM, nCol);
+            break;
+        case SQLITE_TEXT:
+        case SQLITE_BLOB:
+        {
+            auto pData = static_cast<const char*>(value.type == SQLITE_TEXT ? sqlite3_column_text(pVM, nCol)
+                                                                            : sqlite3_column_blob(pVM, nCol));
+            value.nBytes = sqlite3_column_bytes(pVM, nCol);
+            value.nOffset = mArena.size();
+            if (pData != nullptr)
+            {
+                mArena.insert(mArena.end(), pData, pData + value.nBytes);
+            }
+            // terminated, so getStringField can return text from the arena
+            mArena.push_back('\0');
+            break;
+        }
+        default:
+            break;
+        }
+        mCells.push_back(value);
     }
+    ++mnRows;
 }
 
-void CppSQLite3DB::open(CppSQLite3StringView fileName, int flags)
+
+const CppSQLite3ResultSet::Cell& CppSQLite3ResultSet::cell(int nField) const
 {
-    if (mConfig.db != nullptr)
+    if (nField < 0 || nField > mnCols - 1)
     {
-        throw std::logic_error("Previous db handle was not closed");
+        throw std::invalid_argument("Invalid field index requested");
     }
-    int nRet = sqlite3_open_v2(fileName.c_str(), &mConfig.db, flags, nullptr);
-
-    if (nRet != SQLITE_OK)
+    if (mnRow >= mnRows)
     {
-        const char* szError = sqlite3_errmsg(mConfig.db);
-        auto msg = fmt::format("when opening {:s}", fileName.c_str());
-        mConfig.errorHandler(nRet, szError, msg.c_str());
+        throw std::logic_error("No current row");
     }
-
-    setBusyTimeout(mnBusyTimeoutMs);
+    return mCells[static_cast<std::size_t>(mnRow) * mnCols + nField];
 }
 
 
-void CppSQLite3DB::close()
+const std::string& CppSQLite3ResultSet::numericText(const Cell& value) const
 {
-    if (mConfig.db)
+    // the nodes of the map don't move, so the texts stay valid as long as the result set
+    auto nCell = static_cast<std::size_t>(&value - mCells.data());
+    auto it = mNumericTexts.find(nCell);
+    if (it == mNumericTexts.end())
     {
-        auto nRet = sqlite3_close(mConfig.db);
-        if (nRet == SQLITE_OK)
+        std::string text;
+        if (value.type == SQLITE_INTEGER)
         {
-            mConfig.db = nullptr;
+            text = fmt::format("{}", value.nValue);
         }
         else
         {
-            const char* szError = sqlite3_errmsg(mConfig.db);
-            mConfig.errorHandler(nRet, szError, "when closing connection");
+            // same format sqlite uses to convert REAL values to text
+            char szBuffer[32];
+            sqlite3_snprintf(sizeof(szBuffer), szBuffer, "%!.15g", value.fValue);
+            text = szBuffer;
         }
+        it = mNumericTexts.emplace(nCell, std::move(text)).first;
     }
+    return it->second;
 }
 
-void CppSQLite3DB::enableVerboseLogging(bool enable)
-{
-    mConfig.enableVerboseLogging = enable;
-}
 
-bool CppSQLite3DB::isOpened() const
+void CppSQLite3ResultSet::checkRowLayout(int nFields) const
 {
-    return mConfig.db != nullptr;
+    if (nFields != mnCols)
+    {
+        throw std::invalid_argument(fmt::format("Invalid row type: {} fields for {} columns", nFields, mnCols));
+    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
 
-CppSQLite3Statement CppSQLite3DB::compileStatement(CppSQLite3StringView szSQL)
+bool CppSQLite3ColumnBatch::Column::isNull(std::size_t nRow) const
 {
-    checkDB();
-
-    sqlite3_stmt* pVM = compile(szSQL);
-    return CppSQLite3Statement(mConfig, pVM);
+    return (validity[nRow / 8] & (1u << (nRow % 8))) == 0;
 }
 
 
-bool CppSQLite3DB::tableExists(CppSQLite3StringView table)
+std::string_view CppSQLite3ColumnBatch::Column::text(std::size_t nRow) const
 {
-    std::string buffer(256, '\0');
-    // use sqlite3_snprintf function as it properly escapes the input string
-    sqlite3_snprintf(static_cast<int>(buffer.size()), buffer.data(),
-                     "select count(*) from sqlite_master where type='table' and name=%Q", table.c_str());
-    int nRet = execScalar(buffer.c_str());
-    return (nRet > 0);
+    return std::string_view(data.data() + offsets[nRow], static_cast<std::size_t>(offsets[nRow + 1] - offsets[nRow]));
 }
 
-int CppSQLite3DB::execDML(CppSQLite3StringView szSQL)
-{
-    checkDB();
-
-    char* szError = 0;
-
 
-    mConfig.log(CppSQLite3LogLevel::verbose, szSQL);
+CppSQLite3BlobView CppSQLite3ColumnBatch::Column::blob(std::size_t nRow) const
+{
+    auto pData = reinterpret_cast<const unsigned char*>(data.data());
+    return CppSQLite3BlobView(pData + offsets[nRow], static_cast<std::size_t>(offsets[nRow + 1] - offsets[nRow]));
+}
 
-    int nRet = sqlite3_exec(mConfig.db, szSQL.c_str(), 0, 0, &szError);
 
-    if (nRet == SQLITE_OK)
+void CppSQLite3ColumnBatch::reset(sqlite3_stmt* pVM, std::uint64_t nExecution, int nCols, std::size_t nMaxRows)
+{
+    // column types stay fixed while the batch is filled from the same execution, they come from its first row
+    bool bNewSource = nExecution != mnExecution;
+    if (bNewSource)
     {
-        return sqlite3_changes(mConfig.db);
+        mnExecution = nExecution;
+        mColumns.resize(nCols);
     }
-    else
+    for (int nCol = 0; nCol < nCols; ++nCol)
     {
-        std::string error = "Unknown error";
-        if (szError != nullptr)
+        Column& column = mColumns[nCol];
+        if (bNewSource)
         {
-            error = szError;
-            sqlite3_free((void*)szError);
+            column.name = sqlite3_column_name(pVM, nCol);
+            column.type = storageTypeOf(pVM, nCol);
         }
-        else
+        column.integers.clear();
+        column.floats.clear();
+        column.offsets.assign(1, 0);
+        column.data.clear();
+        column.validity.clear();
+        column.nullCount = 0;
+        switch (column.type)
         {
-            error = sqlite3_errmsg(mConfig.db);
+        case SQLITE_INTEGER:
+            column.integers.reserve(nMaxRows);
+            break;
+        case SQLITE_FLOAT:
+            column.floats.reserve(nMaxRows);
+            break;
+        default:
+            column.offsets.reserve(nMaxRows + 1);
+            break;
         }
-        mConfig.errorHandler(nRet, error.c_str(), "when executing DML query");
-        return nRet;
+        column.validity.reserve((nMaxRows + 7) / 8);
     }
+    mnRows = 0;
 }
 
 
-CppSQLite3Query CppSQLite3DB::execQuery(CppSQLite3StringView szSQL)
+void CppSQLite3ColumnBatch::appendRow(sqlite3_stmt* pVM)
 {
-    checkDB();
-
-    sqlite3_stmt* pVM = compile(szSQL);
+    const std::size_t nRow = mnRows;
+    for (int nCol = 0; nCol < static_cast<int>(mColumns.size()); ++nCol)
+    {
+        Column& column = mColumns[nCol];
+        if (nRow % 8 == 0)
+        {
+            column.validity.push_back(0);
+        }
+        bool bNull = sqlite3_column_type(pVM, nCol) == SQLITE_NULL;
+        if (bNull)
+        {
+            ++column.nullCount;
+        }
+        else
+        {
+            column.validity.back() |= static_cast<std::uint8_t>(1u << (nRow % 8));
+        }
 
-    mConfig.log(CppSQLite3LogLevel::verbose, szSQL);
+        switch (column.type)
+        {
+        case SQLITE_INTEGER:
+            column.integers.push_back(sqlite3_column_int64(pVM, nCol));
+            break;
+        case SQLITE_FLOAT:
+            column.floats.push_back(sqlite3_column_double(pVM, nCol));
+            break;
+        default:
+        {
+            // sqlite3_column_bytes has to be called after reading the pointer, which may convert the value
+            auto pData = column.type == SQLITE_TEXT ? static_cast<const void*>(sqlite3_column_text(pVM, nCol))
+                                                    : sqlite3_column_blob(pVM, nCol);
+            auto nBytes = static_cast<std::size_t>(sqlite3_column_bytes(pVM, nCol));
+            if (pData != nullptr)
+            {
+                auto pBytes = static_cast<const char*>(pData);
+                column.data.insert(column.data.end(), pBytes, pBytes + nBytes);
+            }
+            column.offsets.push_back(static_cast<std::int64_t>(column.data.size()));
+            break;
+        }
+        }
+    }
+    ++mnRows;
+}
 
-    int nRet = sqlite3_step(pVM);
+////////////////////////////////////////////////////////////////////////////////
 
-    if (nRet == SQLITE_DONE)
+class CppSQLite3ArrowPoolState
+{
+public:
+    explicit CppSQLite3ArrowPoolState(std::size_t nMaxIdleBatches) : mnMaxIdleBatches(nMaxIdleBatches)
     {
-        // no rows
-        return CppSQLite3Query(mConfig, pVM, true /*eof*/);
     }
-    else if (nRet == SQLITE_ROW)
+
+    std::unique_ptr<CppSQLite3ColumnBatch> acquire()
     {
-        // at least 1 row
-        return CppSQLite3Query(mConfig, pVM, false /*eof*/);
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mIdle.empty())
+        {
+            return std::make_unique<CppSQLite3ColumnBatch>();
+        }
+        auto pBatch = std::move(mIdle.back());
+        mIdle.pop_back();
+        return pBatch;
     }
-    else
+
+    void release(std::unique_ptr<CppSQLite3ColumnBatch> pBatch)
     {
-        nRet = sqlite3_finalize(pVM);
-        const char* szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRet, szError, "when evaluating query");
-        return CppSQLite3Query();
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mIdle.size() < mnMaxIdleBatches)
+        {
+            mIdle.push_back(std::move(pBatch));
+        }
+    }
+
+    std::size_t idleBatches() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mIdle.size();
     }
+
+private:
+    mutable std::mutex mMutex;
+    std::vector<std::unique_ptr<CppSQLite3ColumnBatch>> mIdle;
+    std::size_t mnMaxIdleBatches;
+};
+
+
+CppSQLite3ArrowBufferPool::CppSQLite3ArrowBufferPool(std::size_t nMaxIdleBatches)
+    : mpState(std::make_shared<CppSQLite3ArrowPoolState>(nMaxIdleBatches))
+{
 }
 
 
-int CppSQLite3DB::execScalar(CppSQLite3StringView szSQL)
+std::size_t CppSQLite3ArrowBufferPool::idleBatches() const
 {
-    CppSQLite3Query q = execQuery(szSQL);
+    return mpState->idleBatches();
+}
 
-    if (q.eof() || q.numFields() < 1)
+namespace
+{
+
+/**
+ * @brief ArrowBatchOwner keeps an exported batch alive until the parent and all moved out children are released
+ */
+struct ArrowBatchOwner
+{
+    std::unique_ptr<CppSQLite3ColumnBatch> pBatch;
+    std::weak_ptr<CppSQLite3ArrowPoolState> pPool;
+
+    ~ArrowBatchOwner()
     {
-        throw std::invalid_argument("Invalid scalar query");
+        if (auto pState = pPool.lock())
+        {
+            pState->release(std::move(pBatch));
+        }
     }
+};
 
-    return atoi(q.fieldValue(0));
+struct ArrowArrayData
+{
+    std::shared_ptr<ArrowBatchOwner> pOwner;
+    std::array<const void*, 3> buffers{};
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> childPointers;
+};
+
+struct ArrowSchemaData
+{
+    std::string name;
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> childPointers;
+};
+
+// buffers of empty columns, the interface allows null pointers only for the validity bitmap
+const std::int64_t gEmptyArrowBuffer = 0;
+
+const void* arrowBuffer(const void* pData)
+{
+    return pData != nullptr ? pData : &gEmptyArrowBuffer;
 }
 
-sqlite_int64 CppSQLite3DB::lastRowId() const
+void releaseArrowArray(ArrowArray* pArray)
 {
-    return sqlite3_last_insert_rowid(mConfig.db);
+    auto pData = static_cast<ArrowArrayData*>(pArray->private_data);
+    for (ArrowArray& child : pData->children)
+    {
+        // children moved out by the consumer have been marked released
+        if (child.release != nullptr)
+        {
+            child.release(&child);
+        }
+    }
+    delete pData;
+    pArray->release = nullptr;
 }
 
+void releaseArrowSchema(ArrowSchema* pSchema)
+{
+    auto pData = static_cast<ArrowSchemaData*>(pSchema->private_data);
+    for (ArrowSchema& child : pData->children)
+    {
+        if (child.release != nullptr)
+        {
+            child.release(&child);
+        }
+    }
+    delete pData;
+    pSchema->release = nullptr;
+}
 
-void CppSQLite3DB::setBusyTimeout(int nMillisecs)
+const char* arrowFormatOf(int nType)
 {
-    mnBusyTimeoutMs = nMillisecs;
-    sqlite3_busy_timeout(mConfig.db, mnBusyTimeoutMs);
+    switch (nType)
+    {
+    case SQLITE_INTEGER:
+        return "l";
+    case SQLITE_FLOAT:
+        return "g";
+    case SQLITE_BLOB:
+        return "Z";
+    default:
+        return "U";
+    }
 }
 
-void CppSQLite3DB::setErrorHandler(CppSQLite3ErrorHandler h)
+void exportArrowSchema(const CppSQLite3ColumnBatch& batch, ArrowSchema* pSchema)
 {
-    mConfig.errorHandler = h;
+    auto pData = std::make_unique<ArrowSchemaData>();
+    pData->children.resize(batch.numColumns());
+    for (int nCol = 0; nCol < batch.numColumns(); ++nCol)
+    {
+        const auto& column = batch.column(nCol);
+        auto pChildData = new ArrowSchemaData{column.name, {}, {}};
+        pData->children[nCol] = ArrowSchema{arrowFormatOf(column.type),
+                                            pChildData->name.c_str(),
+                                            nullptr,
+                                            ARROW_FLAG_NULLABLE,
+                                            0,
+                                            nullptr,
+                                            nullptr,
+                                            &releaseArrowSchema,
+                                            pChildData};
+        pData->childPointers.push_back(&pData->children[nCol]);
+    }
+    *pSchema = ArrowSchema{"+s",
+                           pData->name.c_str(),
+                           nullptr,
+                           0,
+                           static_cast<int64_t>(batch.numColumns()),
+                           pData->childPointers.data(),
+                           nullptr,
+                           &releaseArrowSchema,
+                           pData.get()};
+    pData.release();
 }
 
-void CppSQLite3DB::setLogHandler(CppSQLite3LogHandler h)
+void exportArrowArray(const std::shared_ptr<ArrowBatchOwner>& pOwner, ArrowArray* pArray)
 {
-    mConfig.logHandler = h;
+    const CppSQLite3ColumnBatch& batch = *pOwner->pBatch;
+    const auto nRows = static_cast<int64_t>(batch.numRows());
+
+    auto pData = std::make_unique<ArrowArrayData>();
+    pData->pOwner = pOwner;
+    pData->children.resize(batch.numColumns());
+    for (int nCol = 0; nCol < batch.numColumns(); ++nCol)
+    {
+        const auto& column = batch.column(nCol);
+        auto pChildData = new ArrowArrayData{pOwner, {}, {}, {}};
+        auto& buffers = pChildData->buffers;
+        buffers[0] = column.nullCount > 0 ? column.validity.data() : nullptr;
+        int64_t nBuffers = 2;
+        switch (column.type)
+        {
+        case SQLITE_INTEGER:
+            buffers[1] = arrowBuffer(column.integers.data());
+            break;
+        case SQLITE_FLOAT:
+            buffers[1] = arrowBuffer(column.floats.data());
+            break;
+        default:
+            buffers[1] = column.offsets.data();
+            buffers[2] = arrowBuffer(column.data.data());
+            nBuffers = 3;
+            break;
+        }
+        pData->children[nCol] = ArrowArray{nRows,
+                                           static_cast<int64_t>(column.nullCount),
+                                           0,
+                                           nBuffers,
+                                           0,
+                                           buffers.data(),
+                                           nullptr,
+                                           nullptr,
+                                           &releaseArrowArray,
+                                           pChildData};
+        pData->childPointers.push_back(&pData->children[nCol]);
+    }
+    pData->buffers[0] = nullptr;
+    *pArray = ArrowArray{nRows,
+                         0,
+                         0,
+                         1,
+                         static_cast<int64_t>(batch.numColumns()),
+                         pData->buffers.data(),
+                         pData->childPointers.data(),
+                         nullptr,
+                         &releaseArrowArray,
+                         pData.get()};
+    pData.release();
 }
 
-void CppSQLite3DB::performCheckpoint(CppSQLite3StringView dbName, int mode)
+} // namespace
+
+
+std::size_t CppSQLite3Query::exportArrowBatch(ArrowSchema* pSchema, ArrowArray* pArray, std::size_t nMaxRows,
+                                              CppSQLite3ArrowBufferPool& pool)
 {
-    int nRet = sqlite3_wal_checkpoint_v2(mConfig.db, dbName.c_str(), mode, nullptr, nullptr);
-    if (nRet != SQLITE_OK)
+    auto pOwner = std::make_shared<ArrowBatchOwner>();
+    pOwner->pBatch = pool.mpState->acquire();
+    pOwner->pPool = pool.mpState;
+
+    std::size_t nRows = fetchBatch(*pOwner->pBatch, nMaxRows);
+    if (pSchema != nullptr)
     {
-        const char* szError = sqlite3_errmsg(mConfig.db);
-        mConfig.errorHandler(nRet, szError, "when performing checkpoint");
+        exportArrowSchema(*pOwner->pBatch, pSchema);
     }
+    exportArrowArray(pOwner, pArray);
+    return nRows;
 }
 
 
-void CppSQLite3DB::checkDB() const
+std::size_t CppSQLite3Query::exportArrowBatch(ArrowSchema* pSchema, ArrowArray* pArray, std::size_t nMaxRows)
 {
-    if (!mConfig.db)
+    CppSQLite3ArrowBufferPool pool(0);
+    return exportArrowBatch(pSchema, pArray, nMaxRows, pool);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3RowIterator& CppSQLite3RowIterator::operator++()
+{
+    // a failed step ends the iteration even if the error handler didn't throw, stepping the statement again would
+    // reset and rerun it
+    if (!mpQuery->stepRow() || mpQuery->mbEof)
     {
-        throw std::logic_error("Database not open");
+        *this = CppSQLite3RowIterator();
+    }
+    return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3Statement::CppSQLite3Statement() : mConfig{}
+{
+    mpVM = 0;
+}
+
+
+CppSQLite3Statement::CppSQLite3Statement(CppSQLite3Statement&& rStatement)
+{
+    mConfig = rStatement.mConfig;
+    mpVM = rStatement.mpVM;
+    // Only one object can own VM
+    rStatement.mpVM = 0;
+    mpCache = std::move(rStatement.mpCache);
+    mpColumns = std::move(rStatement.mpColumns);
+    mStaticParams = std::move(rStatement.mStaticParams);
+}
+
+
+CppSQLite3Statement::CppSQLite3Statement(const CppSQLite3Config& config, sqlite3_stmt* pVM,
+                                         std::shared_ptr<CppSQLite3StatementCache> pCache /*=nullptr*/,
+                                         std::shared_ptr<CppSQLite3ColumnMap> pColumns /*=nullptr*/)
+    : mConfig(config), mpVM(pVM), mpCache(std::move(pCache)), mpColumns(std::move(pColumns))
+{
+}
+
+
+CppSQLite3Statement::~CppSQLite3Statement()
+{
+    try
+    {
+        finalize();
+    }
+    catch (const std::exception& e)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Statement: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3Statement"));
+    }
+}
+
+
+CppSQLite3Statement& CppSQLite3Statement::operator=(CppSQLite3Statement&& rStatement)
+{
+    try
+    {
+        finalize();
     }
+    catch (const std::exception& e)
+    {
+        mConfig.log(CppSQLite3LogLevel::error,
+                    fmt::format("error when finalizing CppSQLite3Statement during reassign: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        mConfig.log(CppSQLite3LogLevel::error,
+                    fmt::format("unknown error when finalizing ~CppSQLite3Statement during reassign"));
+    }
+
+    mConfig = rStatement.mConfig;
+    mpVM = rStatement.mpVM;
+    // Only one object can own VM
+    rStatement.mpVM = 0;
+    mpCache = std::move(rStatement.mpCache);
+    mpColumns = std::move(rStatement.mpColumns);
+    mStaticParams = std::move(rStatement.mStaticParams);
+    return *this;
 }
 
 
-sqlite3_stmt* CppSQLite3DB::compile(CppSQLite3StringView szSQL)
+int CppSQLite3Statement::execDML()
 {
     checkDB();
+    checkVM();
 
-    const char* szTail = 0;
-    sqlite3_stmt* pVM;
+    const char* szError = 0;
 
-    int prepareFlags = 0;
-    int nRet = sqlite3_prepare_v3(mConfig.db, szSQL.c_str(), -1, prepareFlags, &pVM, &szTail);
-    const char* szError = sqlite3_errmsg(mConfig.db);
+    logExpandedSQL(mConfig, mpVM);
 
-    if (nRet != SQLITE_OK)
+    int nRet = sqlite3_step(mpVM);
+
+    if (nRet == SQLITE_DONE)
+    {
+        int nRowsChanged = sqlite3_changes(mConfig.db);
+
+        nRet = sqlite3_reset(mpVM);
+        releaseStaticBindings();
+
+        if (nRet != SQLITE_OK)
+        {
+            szError = sqlite3_errmsg(mConfig.db);
+            mConfig.error(nRet, szError, "when getting number of rows changed");
+        }
+
+        mConfig.logTraceWarnings();
+        return nRowsChanged;
+    }
+    else
     {
-        mConfig.errorHandler(nRet, szError, "when compiling statement");
+        nRet = sqlite3_reset(mpVM);
+        // rebinding parameters clears the error message
+        std::string error = sqlite3_errmsg(mConfig.db);
+        releaseStaticBindings();
+        mConfig.logTraceWarnings();
+        mConfig.error(nRet, error, "when executing DML statement");
+        return 0;
     }
+}
 
-    return pVM;
+
+CppSQLite3Query CppSQLite3Statement::execQuery()
+{
+    checkDB();
+    checkVM();
+
+    logExpandedSQL(mConfig, mpVM);
+
+    int nRet = sqlite3_step(mpVM);
+
+    if (!mpColumns)
+    {
+        mpColumns = std::make_shared<CppSQLite3ColumnMap>();
+    }
+
+    if (nRet == SQLITE_DONE)
+    {
+        // no rows, a previous run that wasn't reset ended with this step
+        mConfig.logTraceWarnings();
+        return CppSQLite3Query(mConfig, mpVM, true /*eof*/, false, nullptr, mpColumns);
+    }
+    else if (nRet == SQLITE_ROW)
+    {
+        // at least 1 row
+        mConfig.logTraceWarnings();
+        return CppSQLite3Query(mConfig, mpVM, false /*eof*/, false, nullptr, mpColumns);
+    }
+    else
+    {
+        nRet = sqlite3_reset(mpVM);
+        // rebinding parameters clears the error message
+        std::string error = sqlite3_errmsg(mConfig.db);
+        releaseStaticBindings();
+        mConfig.logTraceWarnings();
+        mConfig.error(nRet, error, "when evaluating query");
+        return CppSQLite3Query();
+    }
+}
+
+
+void CppSQLite3Statement::bind(int nParam, CppSQLite3StringView value)
+{
+    checkVM();
+    int nRes = sqlite3_bind_text(mpVM, nParam, value.c_str(), -1, SQLITE_TRANSIENT);
+    checkReturnCode(nRes, "when binding string param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bind(int nParam, const int nValue)
+{
+    checkVM();
+    int nRes = sqlite3_bind_int(mpVM, nParam, nValue);
+    checkReturnCode(nRes, "when binding int param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bind(int nParam, const long long nValue)
+{
+    checkVM();
+    int nRes = sqlite3_bind_int64(mpVM, nParam, nValue);
+    checkReturnCode(nRes, "when binding int64 param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bind(int nParam, const double dValue)
+{
+    checkVM();
+    int nRes = sqlite3_bind_double(mpVM, nParam, dValue);
+    checkReturnCode(nRes, "when binding double param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bind(int nParam, const unsigned char* blobValue, int nLen)
+{
+    checkVM();
+    int nRes = sqlite3_bind_blob(mpVM, nParam, (const void*)blobValue, nLen, SQLITE_TRANSIENT);
+
+    checkReturnCode(nRes, "when binding blob param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bindNull(int nParam)
+{
+    checkVM();
+    int nRes = sqlite3_bind_null(mpVM, nParam);
+    checkReturnCode(nRes, "when binding NULL param");
+    trackBinding(nParam, CppSQLite3BindMode::copy);
+}
+
+
+void CppSQLite3Statement::bindText(int nParam, std::string_view value, CppSQLite3BindMode mode)
+{
+    checkVM();
+    // a default constructed view has no data pointer, bind it as empty string rather than NULL
+    const char* szData = value.data() == nullptr ? "" : value.data();
+    auto destructor = mode == CppSQLite3BindMode::copy ? SQLITE_TRANSIENT : SQLITE_STATIC;
+    int nRes = sqlite3_bind_text64(mpVM, nParam, szData, value.size(), destructor, SQLITE_UTF8);
+    checkReturnCode(nRes, "when binding string param");
+    trackBinding(nParam, mode);
+}
+
+
+void CppSQLite3Statement::bindBlob(int nParam, CppSQLite3BlobView value, CppSQLite3BindMode mode)
+{
+    checkVM();
+    // sqlite binds a nullptr as NULL, so empty blobs need a valid pointer
+    static const unsigned char empty = 0;
+    const void* pData = value.data() == nullptr ? &empty : value.data();
+    auto destructor = mode == CppSQLite3BindMode::copy ? SQLITE_TRANSIENT : SQLITE_STATIC;
+    int nRes = sqlite3_bind_blob64(mpVM, nParam, pData, value.size(), destructor);
+    checkReturnCode(nRes, "when binding blob param");
+    trackBinding(nParam, mode);
+}
+
+
+void CppSQLite3Statement::reset()
+{
+    if (mpVM)
+    {
+        int nRet = sqlite3_reset(mpVM);
+        if (nRet != SQLITE_OK)
+        {
+            // rebinding parameters clears the error message
+            std::string error = sqlite3_errmsg(mConfig.db);
+            releaseStaticBindings();
+            mConfig.error(nRet, error, "when reseting statement");
+        }
+        releaseStaticBindings();
+        mConfig.logTraceWarnings();
+    }
+}
+
+
+void CppSQLite3Statement::finalize()
+{
+    if (mpVM)
+    {
+        sqlite3_stmt* pVM = mpVM;
+        mpVM = 0;
+        int nRet = SQLITE_OK;
+        if (mpCache)
+        {
+            auto pCache = std::move(mpCache);
+            nRet = pCache->release(pVM, std::move(mpColumns));
+        }
+        else
+        {
+            nRet = sqlite3_finalize(pVM);
+        }
+        checkReturnCode(nRet, "when finalizing statement");
+        mConfig.logTraceWarnings();
+    }
+}
+
+
+CppSQLite3StatementStatus CppSQLite3Statement::status(bool bReset) const
+{
+    checkVM();
+    return statementStatus(mpVM, bReset);
+}
+
+
+void CppSQLite3Statement::checkDB() const
+{
+    if (mConfig.db == 0)
+    {
+        throw std::logic_error("Database not open");
+    }
+}
+
+
+void CppSQLite3Statement::checkVM() const
+{
+    if (mpVM == 0)
+    {
+        throw std::logic_error("Null Virtual Machine pointer");
+    }
+}
+
+void CppSQLite3Statement::checkReturnCode(int nRes, const char* context)
+{
+    if (nRes != SQLITE_OK)
+    {
+        const char* szError = sqlite3_errmsg(mConfig.db);
+        mConfig.error(nRes, szError, context);
+    }
+}
+
+
+void CppSQLite3Statement::trackBinding(int nParam, CppSQLite3BindMode mode)
+{
+    if (mode == CppSQLite3BindMode::copy && mStaticParams.empty())
+    {
+        return;
+    }
+    auto it = std::find(mStaticParams.begin(), mStaticParams.end(), nParam);
+    if (mode == CppSQLite3BindMode::noCopy && it == mStaticParams.end())
+    {
+        mStaticParams.push_back(nParam);
+    }
+    else if (mode == CppSQLite3BindMode::copy && it != mStaticParams.end())
+    {
+        mStaticParams.erase(it);
+    }
+}
+
+
+void CppSQLite3Statement::releaseStaticBindings()
+{
+    // the caller only guarantees buffers bound without copy until the next reset
+    for (int nParam : mStaticParams)
+    {
+        sqlite3_bind_null(mpVM, nParam);
+    }
+    mStaticParams.clear();
+}
+
+
+void CppSQLite3Statement::checkParameterCount(int nParams)
+{
+    checkVM();
+    int nExpected = sqlite3_bind_parameter_count(mpVM);
+    if (nParams != nExpected)
+    {
+        throw std::invalid_argument(
+            fmt::format("Invalid number of parameters: statement expects {} but got {}", nExpected, nParams));
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+class CppSQLite3TransactionStatements
+{
+public:
+    ~CppSQLite3TransactionStatements()
+    {
+        clear();
+    }
+
+    /**
+     * @brief get returns the statement for nControl (a CppSQLite3DB::TransactionControl), compiled on first use
+     * @return SQLITE_OK or the error of sqlite3_prepare_v3
+     */
+    int get(sqlite3* db, std::size_t nControl, int nDepth, sqlite3_stmt*& pVM)
+    {
+        // the statements without parameter are followed by 3 savepoint statements per nesting depth
+        const std::size_t nControls = std::size(gszControlSQL);
+        bool bSavepoint = nControl >= nControls;
+        std::size_t nIndex = bSavepoint ? nControls + (nDepth - 1) * 3 + (nControl - nControls) : nControl;
+        if (nIndex >= mStatements.size())
+        {
+            mStatements.resize(std::max(nIndex + 1, nControls), nullptr);
+        }
+        pVM = mStatements[nIndex];
+        if (pVM != nullptr)
+        {
+            return SQLITE_OK;
+        }
+
+        std::string sql =
+            bSavepoint ? fmt::format(gszSavepointSQL[nControl - nControls], nDepth) : gszControlSQL[nControl];
+        int nRet = sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &pVM, nullptr);
+        mStatements[nIndex] = pVM;
+        return nRet;
+    }
+
+    void clear()
+    {
+        for (sqlite3_stmt* pVM : mStatements)
+        {
+            sqlite3_finalize(pVM);
+        }
+        mStatements.clear();
+    }
+
+private:
+    // in the order of CppSQLite3DB::TransactionControl
+    static constexpr const char* gszControlSQL[] = {"BEGIN DEFERRED", "BEGIN IMMEDIATE", "BEGIN EXCLUSIVE", "COMMIT",
+                                                    "ROLLBACK"};
+    static constexpr const char* gszSavepointSQL[] = {"SAVEPOINT cppsqlite3_savepoint_{}",
+                                                      "RELEASE cppsqlite3_savepoint_{}",
+                                                      "ROLLBACK TO cppsqlite3_savepoint_{}"};
+
+    std::vector<sqlite3_stmt*> mStatements;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::uint64_t CppSQLite3StatementProfile::percentileNs(double fraction) const
+{
+    const double nRank = fraction * static_cast<double>(executions);
+    std::uint64_t nCount = 0;
+    for (std::size_t nBucket = 0; nBucket < nBuckets; ++nBucket)
+    {
+        nCount += buckets[nBucket];
+        if (nCount > 0 && static_cast<double>(nCount) >= nRank)
+        {
+            return bucketUpperBoundNs(nBucket);
+        }
+    }
+    return 0;
+}
+
+
+class CppSQLite3ProfilerShards
+{
+public:
+    static constexpr std::size_t nShards = 16;
+
+    // a cache line each, so threads recording into neighbouring shards don't slow each other down
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, CppSQLite3StatementProfile> profiles; // by normalized SQL
+        std::unordered_map<std::string, CppSQLite3StatementProfile*> bySQL;   // by SQL as run, saves normalizing
+
+        void clear()
+        {
+            bySQL.clear();
+            profiles.clear();
+        }
+    };
+
+    /**
+     * @brief local returns the shard of the calling thread, threads are spread round robin
+     */
+    Shard& local()
+    {
+        static std::atomic<std::size_t> nNextShard{0};
+        thread_local const std::size_t nShard = nNextShard++ % nShards;
+        return mShards[nShard];
+    }
+
+    /**
+     * @brief profileOf returns the profile of sql's normalized text, creating it unless there are nMaxStatements
+     */
+    static CppSQLite3StatementProfile& profileOf(Shard& shard, std::string_view sql, std::size_t nMaxStatements)
+    {
+        std::string normalized;
+        normalizeSQL(sql, normalized);
+        auto it = shard.profiles.find(normalized);
+        if (it == shard.profiles.end())
+        {
+            if (shard.profiles.size() >= nMaxStatements)
+            {
+                normalized = "(other statements)";
+                it = shard.profiles.find(normalized);
+            }
+            if (it == shard.profiles.end())
+            {
+                it = shard.profiles.emplace(normalized, CppSQLite3StatementProfile()).first;
+                it->second.sql = normalized;
+            }
+        }
+        return it->second;
+    }
+
+    std::array<Shard, nShards> mShards;
+};
+
+
+class CppSQLite3Tracer
+{
+public:
+    /**
+     * @brief install registers the trace callback while profiling, the slow query log or the status monitor is on,
+     * and for the starts of statements while deadlines apply
+     */
+    void install(sqlite3* db)
+    {
+        if (db == nullptr)
+        {
+            return;
+        }
+        if (isTiming())
+        {
+            sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE,
+                             &CppSQLite3Tracer::callback, this);
+            return;
+        }
+        mRunning.clear();
+        if (mpLimits != nullptr && mpLimits->isActive())
+        {
+            sqlite3_trace_v2(db, SQLITE_TRACE_STMT, &CppSQLite3Tracer::callback, this);
+        }
+        else
+        {
+            sqlite3_trace_v2(db, 0, nullptr, nullptr);
+        }
+    }
+
+    static int callback(unsigned nEvent, void* pTracer, void* pStatement, void* /*pDetail*/)
+    {
+        static_cast<CppSQLite3Tracer*>(pTracer)->trace(nEvent, static_cast<sqlite3_stmt*>(pStatement));
+        return 0;
+    }
+
+    /**
+     * @brief trace times statements from their start to their reset
+     *
+     * The durations of SQLITE_TRACE_PROFILE have millisecond resolution only, so the tracer takes its own time.
+     */
+    void trace(unsigned nEvent, sqlite3_stmt* pVM)
+    {
+        if (nEvent == SQLITE_TRACE_STMT && mpLimits != nullptr)
+        {
+            mpLimits->statementStarted();
+        }
+        if (mbExplaining || !isTiming())
+        {
+            return;
+        }
+        auto it = std::find_if(mRunning.begin(), mRunning.end(), [pVM](const Run& run) { return run.pVM == pVM; });
+        if (nEvent == SQLITE_TRACE_STMT)
+        {
+            // triggers report their subprograms as well, the statement keeps its start
+            if (it == mRunning.end())
+            {
+                CppSQLite3StatementStatus start;
+                if (mbMonitorStatus)
+                {
+                    start = runCounters(pVM);
+                }
+                mRunning.push_back({pVM, std::chrono::steady_clock::now(), 0, start});
+            }
+        }
+        else if (nEvent == SQLITE_TRACE_ROW)
+        {
+            if (it != mRunning.end())
+            {
+                ++it->nRows;
+            }
+        }
+        else if (nEvent == SQLITE_TRACE_PROFILE && it != mRunning.end())
+        {
+            auto elapsed = std::chrono::steady_clock::now() - it->start;
+            auto nNanoseconds =
+                static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            const char* szSQL = sqlite3_sql(pVM);
+            if (mpProfiler)
+            {
+                mpProfiler->record(szSQL, nNanoseconds, it->nRows);
+            }
+            if (mnSlowQueryNs > 0 && nNanoseconds >= mnSlowQueryNs)
+            {
+                addWarning(pVM, szSQL,
+                           [&](std::string_view expandedSQL)
+                           {
+                               return fmt::format("slow query ({:.3f} ms, {} rows): {}", nNanoseconds / 1e6,
+                                                  it->nRows, expandedSQL);
+                           });
+            }
+            if (mbMonitorStatus)
+            {
+                monitorStatus(pVM, szSQL, it->startStatus);
+            }
+            *it = mRunning.back();
+            mRunning.pop_back();
+        }
+    }
+
+    bool hasWarnings() const
+    {
+        return !mWarnings.empty();
+    }
+
+    /**
+     * @brief logWarnings logs the slow queries and status warnings found by the trace callback with their query plans
+     *
+     * Statements can't run inside the trace callback, so the plans are explained afterwards.
+     */
+    void logWarnings(CppSQLite3Config& config)
+    {
+        auto warnings = std::move(mWarnings);
+        mWarnings.clear();
+        for (const auto& warning : warnings)
+        {
+            const std::string& plan = queryPlan(config, warning.sql);
+            config.log(CppSQLite3LogLevel::warning, warning.message + plan);
+        }
+    }
+
+    /**
+     * @brief enableStatusMonitor turns the status monitor on or off, the sums and warned statements start over
+     */
+    void enableStatusMonitor(bool bEnable, const CppSQLite3StatusMonitorOptions& options)
+    {
+        mbMonitorStatus = bEnable;
+        mMonitorOptions = options;
+        mStatusTotals = {};
+        mWarnedSQL.clear();
+    }
+
+    CppSQLite3StatementStatus statusTotals(bool bReset)
+    {
+        CppSQLite3StatementStatus totals = mStatusTotals;
+        if (bReset)
+        {
+            mStatusTotals = {};
+        }
+        return totals;
+    }
+
+    std::shared_ptr<CppSQLite3Profiler> mpProfiler;
+    std::uint64_t mnSlowQueryNs = 0;               // 0: slow query log off
+    CppSQLite3ExecutionLimits* mpLimits = nullptr; // of the connection, told when statements start
+
+private:
+    bool isTiming() const
+    {
+        return mpProfiler || mnSlowQueryNs > 0 || mbMonitorStatus;
+    }
+
+    /**
+     * @brief addWarning queues the message made by format from the expanded SQL of pVM, up to nMaxWarnings
+     */
+    template <typename Format>
+    void addWarning(sqlite3_stmt* pVM, const char* szSQL, Format format)
+    {
+        if (mWarnings.size() >= nMaxWarnings)
+        {
+            return;
+        }
+        char* szExpandedSQL = sqlite3_expanded_sql(pVM);
+        mWarnings.push_back({format(szExpandedSQL ? szExpandedSQL : ""), szSQL ? szSQL : ""});
+        sqlite3_free(szExpandedSQL);
+    }
+
+    /**
+     * @brief monitorStatus adds the counters of the run of pVM to the sums and warns about automatic indexes and large
+     * sorts
+     */
+    void monitorStatus(sqlite3_stmt* pVM, const char* szSQL, const CppSQLite3StatementStatus& start)
+    {
+        CppSQLite3StatementStatus status = statementStatus(pVM, false);
+        // counters that went back were reset by the caller during the run
+        auto delta = [](std::uint64_t nEnd, std::uint64_t nStart) { return nEnd >= nStart ? nEnd - nStart : nEnd; };
+        CppSQLite3StatementStatus run;
+        run.fullscanSteps = delta(status.fullscanSteps, start.fullscanSteps);
+        run.sorts = delta(status.sorts, start.sorts);
+        run.autoindexRows = delta(status.autoindexRows, start.autoindexRows);
+        run.vmSteps = delta(status.vmSteps, start.vmSteps);
+        run.reprepares = delta(status.reprepares, start.reprepares);
+
+        mStatusTotals.fullscanSteps += run.fullscanSteps;
+        mStatusTotals.sorts += run.sorts;
+        mStatusTotals.autoindexRows += run.autoindexRows;
+        mStatusTotals.vmSteps += run.vmSteps;
+        mStatusTotals.reprepares += run.reprepares;
+        ++mStatusTotals.runs;
+        mStatusTotals.memoryUsed = std::max(mStatusTotals.memoryUsed, status.memoryUsed);
+
+        const bool bAutoindex = mMonitorOptions.warnOnAutoindex && run.autoindexRows > 0;
+        const bool bLargeSort =
+            mMonitorOptions.sortVmSteps > 0 && run.sorts > 0 && run.vmSteps >= mMonitorOptions.sortVmSteps;
+        if (!bAutoindex && !bLargeSort)
+        {
+            return;
+        }
+        if (mWarnedSQL.size() >= nMaxQueryPlans)
+        {
+            mWarnedSQL.clear();
+        }
+        if (!mWarnedSQL.insert(szSQL ? szSQL : "").second)
+        {
+            return;
+        }
+        addWarning(pVM, szSQL,
+                   [&](std::string_view expandedSQL)
+                   {
+                       return fmt::format("{} ({} automatic index rows, {} sorts, {} full scan steps, {} VM steps): {}",
+                                          bAutoindex ? "automatic index" : "large sort", run.autoindexRows, run.sorts,
+                                          run.fullscanSteps, run.vmSteps, expandedSQL);
+                   });
+    }
+
+    /**
+     * @brief queryPlan returns the EXPLAIN QUERY PLAN output of sql, explained once per distinct SQL text
+     */
+    const std::string& queryPlan(CppSQLite3Config& config, const std::string& sql)
+    {
+        auto it = mQueryPlans.find(sql);
+        if (it != mQueryPlans.end())
+        {
+            return it->second;
+        }
+        if (mQueryPlans.size() >= nMaxQueryPlans)
+        {
+            mQueryPlans.clear();
+        }
+
+        std::string plan;
+        sqlite3_stmt* pVM = nullptr;
+        mbExplaining = true;
+        // deadlines don't apply to the plan, an abort here would leave its code for the next unrelated interrupt
+        sqlite3_progress_handler(config.db, 0, nullptr, nullptr);
+        std::string explain = "EXPLAIN QUERY PLAN " + sql;
+        if (sqlite3_prepare_v2(config.db, explain.c_str(), -1, &pVM, nullptr) == SQLITE_OK && pVM != nullptr)
+        {
+            // rows are id, parent id, unused, detail; children are indented below their parent
+            std::unordered_map<int, int> depths;
+            while (sqlite3_step(pVM) == SQLITE_ROW)
+            {
+                int nDepth = depths[sqlite3_column_int(pVM, 1)] + 1;
+                depths[sqlite3_column_int(pVM, 0)] = nDepth;
+                auto szDetail = reinterpret_cast<const char*>(sqlite3_column_text(pVM, 3));
+                plan += fmt::format("\n{:>{}}{}", "", 2 * nDepth, szDetail ? szDetail : "");
+            }
+        }
+        sqlite3_finalize(pVM);
+        if (config.pLimits != nullptr)
+        {
+            config.pLimits->install(config.db);
+        }
+        mbExplaining = false;
+        if (!plan.empty())
+        {
+            plan.insert(0, "\nQUERY PLAN");
+        }
+        return mQueryPlans.emplace(sql, std::move(plan)).first->second;
+    }
+
+    static constexpr std::size_t nMaxWarnings = 16; // logged per wrapper call, more are dropped
+    static constexpr std::size_t nMaxQueryPlans = 256;
+
+    struct Run
+    {
+        sqlite3_stmt* pVM;
+        std::chrono::steady_clock::time_point start;
+        std::uint64_t nRows;
+        CppSQLite3StatementStatus startStatus; // only read while the status monitor is on
+    };
+
+    struct Warning
+    {
+        std::string message;
+        std::string sql; // explained for the query plan appended to message
+    };
+
+    std::vector<Run> mRunning; // started statements that weren't reset yet, queries may nest
+    std::vector<Warning> mWarnings;
+    std::unordered_map<std::string, std::string> mQueryPlans;
+    bool mbExplaining = false;
+
+    bool mbMonitorStatus = false;
+    CppSQLite3StatusMonitorOptions mMonitorOptions;
+    CppSQLite3StatementStatus mStatusTotals;
+    std::unordered_set<std::string> mWarnedSQL; // status warnings are logged once per SQL text
+};
+
+
+void CppSQLite3Config::logTraceWarnings()
+{
+    if (pTracer && pTracer->hasWarnings())
+    {
+        pTracer->logWarnings(*this);
+    }
+}
+
+
+CppSQLite3Profiler::CppSQLite3Profiler(std::size_t nMaxStatements)
+    : mnMaxStatements(nMaxStatements), mpShards(std::make_unique<CppSQLite3ProfilerShards>())
+{
+}
+
+
+CppSQLite3Profiler::~CppSQLite3Profiler() = default;
+
+
+void CppSQLite3Profiler::record(std::string_view sql, std::uint64_t nNanoseconds, std::uint64_t nRows)
+{
+    // reused, so looking up a known statement doesn't allocate
+    thread_local std::string key;
+    key.assign(sql.data(), sql.size());
+
+    auto& shard = mpShards->local();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto itSQL = shard.bySQL.find(key);
+    if (itSQL == shard.bySQL.end())
+    {
+        // texts with inlined values would let the index grow without bounds
+        if (shard.bySQL.size() >= 4 * mnMaxStatements)
+        {
+            shard.bySQL.clear();
+        }
+        auto& profile = CppSQLite3ProfilerShards::profileOf(shard, key, mnMaxStatements);
+        itSQL = shard.bySQL.emplace(key, &profile).first;
+    }
+
+    auto& profile = *itSQL->second;
+    ++profile.executions;
+    profile.rows += nRows;
+    profile.totalNs += nNanoseconds;
+    profile.maxNs = std::max(profile.maxNs, nNanoseconds);
+    std::size_t nBucket = 0;
+    while (nBucket + 1 < CppSQLite3StatementProfile::nBuckets &&
+           nNanoseconds >= CppSQLite3StatementProfile::bucketUpperBoundNs(nBucket))
+    {
+        ++nBucket;
+    }
+    ++profile.buckets[nBucket];
+}
+
+
+std::vector<CppSQLite3StatementProfile> CppSQLite3Profiler::snapshot(bool bReset)
+{
+    std::unordered_map<std::string, CppSQLite3StatementProfile> merged;
+    for (auto& shard : mpShards->mShards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& [sql, profile] : shard.profiles)
+        {
+            auto& total = merged[sql];
+            total.sql = sql;
+            total.executions += profile.executions;
+            total.rows += profile.rows;
+            total.totalNs += profile.totalNs;
+            total.maxNs = std::max(total.maxNs, profile.maxNs);
+            for (std::size_t nBucket = 0; nBucket < CppSQLite3StatementProfile::nBuckets; ++nBucket)
+            {
+                total.buckets[nBucket] += profile.buckets[nBucket];
+            }
+        }
+        if (bReset)
+        {
+            shard.clear();
+        }
+    }
+
+    std::vector<CppSQLite3StatementProfile> profiles;
+    profiles.reserve(merged.size());
+    for (auto& entry : merged)
+    {
+        profiles.push_back(std::move(entry.second));
+    }
+    std::sort(profiles.begin(), profiles.end(),
+              [](const CppSQLite3StatementProfile& lhs, const CppSQLite3StatementProfile& rhs)
+              { return lhs.totalNs > rhs.totalNs; });
+    return profiles;
+}
+
+
+void CppSQLite3Profiler::reset()
+{
+    for (auto& shard : mpShards->mShards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.clear();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class CppSQLite3BusyHandler
+{
+public:
+    explicit CppSQLite3BusyHandler(const CppSQLite3BusyPolicy& policy)
+        : mPolicy(policy), mRandom(std::random_device{}())
+    {
+    }
+
+    static int callback(void* pHandler, int nCalls)
+    {
+        return static_cast<CppSQLite3BusyHandler*>(pHandler)->wait(nCalls);
+    }
+
+    /**
+     * @brief setPolicy replaces the policy and starts new counters, the handler itself stays for busyStats
+     */
+    void setPolicy(const CppSQLite3BusyPolicy& policy)
+    {
+        mPolicy = policy;
+        resetStats();
+    }
+
+    void resetStats()
+    {
+        mnBusyEvents = 0;
+        mnTimeouts = 0;
+        mnTotalWaitUs = 0;
+        mnMaxWaitUs = 0;
+    }
+
+    /**
+     * @brief wait is called by SQLite each time a lock is busy, nCalls counts the calls for the same conflict
+     * @return 0 to give up with SQLITE_BUSY, 1 to retry
+     */
+    int wait(int nCalls)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (nCalls == 0)
+        {
+            mWaitStart = now;
+            mnWaitedUs = 0;
+            mnSleeps = 0;
+            ++mnBusyEvents;
+        }
+
+        auto nElapsedUs = elapsedUs(now);
+        if (nElapsedUs >= std::int64_t{mPolicy.timeoutMs} * 1000)
+        {
+            ++mnTimeouts;
+            return 0;
+        }
+
+        if (nElapsedUs < mPolicy.spinUs)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            // the backoff is capped long before a larger shift could overflow
+            int nShift = std::min(mnSleeps, 30);
+            std::int64_t nBackoffUs =
+                std::min<std::int64_t>(std::int64_t{mPolicy.initialBackoffUs} << nShift, mPolicy.maxBackoffUs);
+            double fraction = 1.0 - mPolicy.jitter * std::uniform_real_distribution<double>(0.0, 1.0)(mRandom);
+            auto nSleepUs = static_cast<std::int64_t>(nBackoffUs * fraction);
+            nSleepUs = std::min(nSleepUs, std::int64_t{mPolicy.timeoutMs} * 1000 - nElapsedUs);
+            std::this_thread::sleep_for(std::chrono::microseconds(std::max<std::int64_t>(nSleepUs, 1)));
+            ++mnSleeps;
+        }
+
+        // SQLite retries right after the handler returns, so the wait is complete up to here
+        nElapsedUs = elapsedUs(std::chrono::steady_clock::now());
+        mnTotalWaitUs += nElapsedUs - mnWaitedUs;
+        mnWaitedUs = nElapsedUs;
+        if (nElapsedUs > mnMaxWaitUs)
+        {
+            mnMaxWaitUs = nElapsedUs;
+        }
+        return 1;
+    }
+
+    CppSQLite3BusyStats stats() const
+    {
+        CppSQLite3BusyStats stats;
+        stats.busyEvents = mnBusyEvents;
+        stats.timeouts = mnTimeouts;
+        stats.totalWaitUs = mnTotalWaitUs;
+        stats.maxWaitUs = mnMaxWaitUs;
+        return stats;
+    }
+
+private:
+    std::int64_t elapsedUs(std::chrono::steady_clock::time_point now) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(now - mWaitStart).count();
+    }
+
+    CppSQLite3BusyPolicy mPolicy;
+    std::minstd_rand mRandom;
+    std::chrono::steady_clock::time_point mWaitStart;
+    std::int64_t mnWaitedUs = 0; // part of the current wait that is already counted
+    int mnSleeps = 0;
+    // read by busyStats on other threads
+    std::atomic<std::size_t> mnBusyEvents{0};
+    std::atomic<std::size_t> mnTimeouts{0};
+    std::atomic<std::int64_t> mnTotalWaitUs{0};
+    std::atomic<std::int64_t> mnMaxWaitUs{0};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3DB::CppSQLite3DB()
+    : mConfig{}, mnBusyTimeoutMs(60'000), // 60 seconds
+      mbPreparedExecDML(false), mpStatementCache(std::make_shared<CppSQLite3StatementCache>()),
+      mpTransactionStatements(std::make_unique<CppSQLite3TransactionStatements>()),
+      mpBusyHandler(std::make_unique<CppSQLite3BusyHandler>(CppSQLite3BusyPolicy())),
+      mpLimits(std::make_unique<CppSQLite3ExecutionLimits>())
+{
+    mConfig.pLimits = mpLimits.get();
+    mConfig.pTracer = std::make_shared<CppSQLite3Tracer>();
+    mConfig.pTracer->mpLimits = mpLimits.get();
+}
+
+CppSQLite3DB::~CppSQLite3DB()
+{
+    try
+    {
+        close();
+    }
+    catch (std::exception& e)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3DB: {}", e.what()));
+    }
+    catch (...)
+    {
+        mConfig.log(CppSQLite3LogLevel::error, fmt::format("unknown error during ~CppSQLite3DB"));
+    }
+}
+
+void CppSQLite3DB::open(CppSQLite3StringView fileName, int flags)
+{
+    if (mConfig.db != nullptr)
+    {
+        throw std::logic_error("Previous db handle was not closed");
+    }
+    int nRet = sqlite3_open_v2(fileName.c_str(), &mConfig.db, flags, nullptr);
+
+    if (nRet != SQLITE_OK)
+    {
+        const char* szError = sqlite3_errmsg(mConfig.db);
+        auto msg = fmt::format("when opening {:s}", fileName.c_str());
+        mConfig.error(nRet, szError, msg.c_str());
+    }
+
+    if (mbBusyPolicy)
+    {
+        sqlite3_busy_handler(mConfig.db, &CppSQLite3BusyHandler::callback, mpBusyHandler.get());
+    }
+    else
+    {
+        setBusyTimeout(mnBusyTimeoutMs);
+    }
+    mpLimits->install(mConfig.db);
+    mConfig.pTracer->install(mConfig.db);
+}
+
+
+CppSQLite3OpenOptions CppSQLite3OpenOptions::oltpWAL()
+{
+    CppSQLite3OpenOptions options;
+    options.journalMode = "wal";
+    options.synchronous = "normal";
+    options.cacheSize = -64 * 1024;
+    options.mmapSize = std::int64_t{256} << 20;
+    options.tempStore = "memory";
+    options.walAutocheckpoint = 1000;
+    options.foreignKeys = true;
+    return options;
+}
+
+
+CppSQLite3OpenOptions CppSQLite3OpenOptions::bulkLoad()
+{
+    // without any journal ROLLBACK would be undefined, the in-memory journal keeps it working
+    CppSQLite3OpenOptions options;
+    options.journalMode = "memory";
+    options.synchronous = "off";
+    options.cacheSize = -256 * 1024;
+    options.tempStore = "memory";
+    options.foreignKeys = false;
+    return options;
+}
+
+
+CppSQLite3OpenOptions CppSQLite3OpenOptions::readOnlyAnalytics()
+{
+    CppSQLite3OpenOptions options;
+    options.flags = SQLITE_OPEN_READONLY;
+    options.cacheSize = -256 * 1024;
+    options.mmapSize = std::int64_t{1} << 30;
+    options.tempStore = "memory";
+    return options;
+}
+
+
+CppSQLite3OpenOptions CppSQLite3OpenOptions::inMemory()
+{
+    CppSQLite3OpenOptions options;
+    options.journalMode = "memory";
+    options.synchronous = "off";
+    options.tempStore = "memory";
+    options.foreignKeys = true;
+    return options;
+}
+
+
+CppSQLite3OpenOptions CppSQLite3OpenOptions::immutableReadOnly()
+{
+    CppSQLite3OpenOptions options;
+    options.flags = SQLITE_OPEN_READONLY;
+    options.immutable = true;
+    // the default SQLITE_MAX_MMAP_SIZE
+    options.mmapSize = 0x7fff0000;
+    options.tempStore = "memory";
+    return options;
+}
+
+
+void CppSQLite3DB::open(CppSQLite3StringView fileName, const CppSQLite3OpenOptions& options)
+{
+    auto checkName = [](const std::optional<std::string>& value)
+    {
+        if (value && !std::all_of(value->begin(), value->end(),
+                                  [](char c) { return std::isalpha(static_cast<unsigned char>(c)) != 0; }))
+        {
+            throw std::invalid_argument(fmt::format("invalid PRAGMA value '{}'", *value));
+        }
+    };
+    checkName(options.journalMode);
+    checkName(options.synchronous);
+    checkName(options.tempStore);
+
+    if (options.immutable)
+    {
+        // a file name becomes a URI with ?, # and % escaped, a URI gets another parameter before its fragment
+        std::string_view name = fileName.c_str();
+        std::string uri;
+        if (name.substr(0, 5) == "file:")
+        {
+            std::string_view query = name.substr(0, name.find('#'));
+            uri = fmt::format("{}{}immutable=1{}", query, query.find('?') == std::string_view::npos ? '?' : '&',
+                              name.substr(query.size()));
+        }
+        else
+        {
+            uri = "file:";
+            for (char c : name)
+            {
+                if (c == '?' || c == '#' || c == '%')
+                {
+                    uri += fmt::format("%{:02x}", static_cast<unsigned char>(c));
+                }
+                else
+                {
+                    uri += c;
+                }
+            }
+            uri += "?immutable=1";
+        }
+        open(uri, options.flags | SQLITE_OPEN_URI);
+    }
+    else
+    {
+        open(fileName, options.flags);
+    }
+
+    // page_size has to be set before WAL mode writes the database header
+    std::vector<std::pair<std::string_view, std::string>> pragmas;
+    if (options.pageSize)
+    {
+        pragmas.emplace_back("page_size", std::to_string(*options.pageSize));
+    }
+    if (options.journalMode)
+    {
+        pragmas.emplace_back("journal_mode", *options.journalMode);
+    }
+    if (options.synchronous)
+    {
+        pragmas.emplace_back("synchronous", *options.synchronous);
+    }
+    if (options.cacheSize)
+    {
+        pragmas.emplace_back("cache_size", std::to_string(*options.cacheSize));
+    }
+    if (options.mmapSize)
+    {
+        pragmas.emplace_back("mmap_size", std::to_string(*options.mmapSize));
+    }
+    if (options.tempStore)
+    {
+        pragmas.emplace_back("temp_store", *options.tempStore);
+    }
+    if (options.walAutocheckpoint)
+    {
+        pragmas.emplace_back("wal_autocheckpoint", std::to_string(*options.walAutocheckpoint));
+    }
+    if (options.foreignKeys)
+    {
+        pragmas.emplace_back("foreign_keys", *options.foreignKeys ? "1" : "0");
+    }
+    for (const auto& [name, value] : pragmas)
+    {
+        // some PRAGMAs report the new value as row
+        execQuery(fmt::format("PRAGMA {} = {}", name, value));
+    }
+
+    auto settings = readSettings();
+    auto confirm = [this](std::string_view name, const auto& requested, const auto& reported)
+    {
+        if (requested && requested != reported)
+        {
+            mConfig.log(CppSQLite3LogLevel::warning,
+                        fmt::format("PRAGMA {} = {} was not applied, the connection reports {}", name, *requested,
+                                    reported ? fmt::format("{}", *reported) : "nothing"));
+        }
+    };
+    auto lowerCase = [](std::optional<std::string> value)
+    {
+        if (value)
+        {
+            std::transform(value->begin(), value->end(), value->begin(),
+                           [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        }
+        return value;
+    };
+    confirm("page_size", options.pageSize, settings.pageSize);
+    confirm("journal_mode", lowerCase(options.journalMode), settings.journalMode);
+    confirm("synchronous", lowerCase(options.synchronous), settings.synchronous);
+    confirm("cache_size", options.cacheSize, settings.cacheSize);
+    confirm("mmap_size", options.mmapSize, settings.mmapSize);
+    confirm("temp_store", lowerCase(options.tempStore), settings.tempStore);
+    confirm("wal_autocheckpoint", options.walAutocheckpoint, settings.walAutocheckpoint);
+    confirm("foreign_keys", options.foreignKeys, settings.foreignKeys);
+}
+
+
+CppSQLite3OpenOptions CppSQLite3DB::readSettings()
+{
+    checkDB();
+    CppSQLite3OpenOptions settings;
+    settings.flags = sqlite3_db_readonly(mConfig.db, "main") == 1 ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
+
+    // a PRAGMA without result (e.g. mmap_size of an in-memory database) stays unset
+    auto readInt64 = [this](std::string_view name) -> std::optional<std::int64_t>
+    {
+        auto query = execQuery(fmt::format("PRAGMA {}", name));
+        return query.eof() ? std::nullopt : std::optional<std::int64_t>(query.getInt64Field(0));
+    };
+    auto readInt = [&readInt64](std::string_view name) -> std::optional<int>
+    {
+        auto value = readInt64(name);
+        return value ? std::optional<int>(static_cast<int>(*value)) : std::nullopt;
+    };
+    // synchronous and temp_store are reported as numbers
+    auto readName = [&readInt64](std::string_view name,
+                                 std::initializer_list<const char*> names) -> std::optional<std::string>
+    {
+        auto value = readInt64(name);
+        if (!value || *value < 0 || *value >= static_cast<std::int64_t>(names.size()))
+        {
+            return std::nullopt;
+        }
+        return std::string(names.begin()[*value]);
+    };
+
+    settings.pageSize = readInt("page_size");
+    auto query = execQuery("PRAGMA journal_mode");
+    if (!query.eof())
+    {
+        settings.journalMode = query.getStringField(0);
+    }
+    query.finalize();
+    settings.synchronous = readName("synchronous", {"off", "normal", "full", "extra"});
+    settings.cacheSize = readInt("cache_size");
+    settings.mmapSize = readInt64("mmap_size");
+    settings.tempStore = readName("temp_store", {"default", "file", "memory"});
+    settings.walAutocheckpoint = readInt("wal_autocheckpoint");
+    auto foreignKeys = readInt64("foreign_keys");
+    if (foreignKeys)
+    {
+        settings.foreignKeys = *foreignKeys != 0;
+    }
+    return settings;
+}
+
+
+void CppSQLite3DB::close()
+{
+    if (mConfig.db)
+    {
+        // cached statements would keep the connection busy
+        mpStatementCache->clear();
+        mpTransactionStatements->clear();
+        mnSavepoints = 0;
+        auto nRet = sqlite3_close(mConfig.db);
+        if (nRet == SQLITE_OK)
+        {
+            mConfig.db = nullptr;
+        }
+        else
+        {
+            const char* szError = sqlite3_errmsg(mConfig.db);
+            mConfig.error(nRet, szError, "when closing connection");
+        }
+    }
+}
+
+void CppSQLite3DB::enableVerboseLogging(bool enable)
+{
+    mConfig.enableVerboseLogging = enable;
+}
+
+void CppSQLite3DB::enablePreparedExecDML(bool enable)
+{
+    mbPreparedExecDML = enable;
+}
+
+bool CppSQLite3DB::isOpened() const
+{
+    return mConfig.db != nullptr;
+}
+
+
+CppSQLite3Statement CppSQLite3DB::compileStatement(CppSQLite3StringView szSQL)
+{
+    checkDB();
+
+    std::shared_ptr<CppSQLite3StatementCache> pCache;
+    std::shared_ptr<CppSQLite3ColumnMap> pColumns;
+    sqlite3_stmt* pVM = compile(szSQL, pCache, pColumns);
+    return CppSQLite3Statement(mConfig, pVM, std::move(pCache), std::move(pColumns));
+}
+
+
+bool CppSQLite3DB::tableExists(CppSQLite3StringView table)
+{
+    std::string buffer(256, '\0');
+    // use sqlite3_snprintf function as it properly escapes the input string
+    sqlite3_snprintf(static_cast<int>(buffer.size()), buffer.data(),
+                     "select count(*) from sqlite_master where type='table' and name=%Q", table.c_str());
+    int nRet = execScalar(buffer.c_str());
+    return (nRet > 0);
+}
+
+int CppSQLite3DB::execDML(CppSQLite3StringView szSQL)
+{
+    checkDB();
+
+    if (mbPreparedExecDML)
+    {
+        return execPreparedDML(szSQL);
+    }
+
+    char* szError = 0;
+
+
+    mConfig.log(CppSQLite3LogLevel::verbose, szSQL);
+
+    int nRet = sqlite3_exec(mConfig.db, szSQL.c_str(), 0, 0, &szError);
+
+    if (nRet == SQLITE_OK)
+    {
+        int nRowsChanged = sqlite3_changes(mConfig.db);
+        mConfig.logTraceWarnings();
+        return nRowsChanged;
+    }
+    else
+    {
+        std::string error = "Unknown error";
+        if (szError != nullptr)
+        {
+            error = szError;
+            sqlite3_free((void*)szError);
+        }
+        else
+        {
+            error = sqlite3_errmsg(mConfig.db);
+        }
+        mConfig.logTraceWarnings();
+        mConfig.error(nRet, error.c_str(), "when executing DML query");
+        return nRet;
+    }
+}
+
+
+int CppSQLite3DB::execPreparedDML(CppSQLite3StringView szSQL)
+{
+    mConfig.log(CppSQLite3LogLevel::verbose, szSQL);
+
+    CppSQLite3StatementCache::Script* pScript = mpStatementCache->acquireScript(szSQL);
+    std::vector<sqlite3_stmt*> compiled;
+    const int prepareFlags = mpStatementCache->capacity() > 0 ? SQLITE_PREPARE_PERSISTENT : 0;
+    const char* szTail = szSQL.c_str();
+
+    // statements of a script may depend on the effects of the previous ones (e.g. CREATE TABLE followed by INSERT),
+    // so on a cache miss each statement is compiled right before it is executed, just like sqlite3_exec does
+    int nRet = SQLITE_OK;
+    std::size_t nStatement = 0;
+    while (nRet == SQLITE_OK)
+    {
+        sqlite3_stmt* pVM = nullptr;
+        if (pScript)
+        {
+            if (nStatement == pScript->vms.size())
+            {
+                break;
+            }
+            pVM = pScript->vms[nStatement++];
+        }
+        else
+        {
+            if (szTail == nullptr || *szTail == '\0')
+            {
+                break;
+            }
+            nRet = sqlite3_prepare_v3(mConfig.db, szTail, -1, prepareFlags, &pVM, &szTail);
+            if (nRet != SQLITE_OK || pVM == nullptr)
+            {
+                // compile error, or only whitespace / comments left
+                continue;
+            }
+            compiled.push_back(pVM);
+        }
+
+        do
+        {
+            nRet = sqlite3_step(pVM);
+        } while (nRet == SQLITE_ROW);
+
+        nRet = sqlite3_reset(pVM);
+    }
+
+    if (nRet != SQLITE_OK)
+    {
+        std::string error = sqlite3_errmsg(mConfig.db);
+        if (pScript)
+        {
+            mpStatementCache->discardScript(pScript);
+        }
+        CppSQLite3StatementCache::finalizeAll(compiled);
+        mConfig.logTraceWarnings();
+        mConfig.error(nRet, error, "when executing DML query");
+        return nRet;
+    }
+
+    int nRowsChanged = sqlite3_changes(mConfig.db);
+    mConfig.logTraceWarnings();
+    if (pScript)
+    {
+        mpStatementCache->releaseScript(pScript);
+    }
+    else
+    {
+        mpStatementCache->insertScript(szSQL, std::move(compiled));
+    }
+    return nRowsChanged;
+}
+
+
+CppSQLite3Query CppSQLite3DB::execQuery(CppSQLite3StringView szSQL)
+{
+    checkDB();
+
+    std::shared_ptr<CppSQLite3StatementCache> pCache;
+    std::shared_ptr<CppSQLite3ColumnMap> pColumns;
+    sqlite3_stmt* pVM = compile(szSQL, pCache, pColumns);
+
+    mConfig.log(CppSQLite3LogLevel::verbose, szSQL);
+
+    int nRet = sqlite3_step(pVM);
+
+    if (nRet == SQLITE_DONE)
+    {
+        // no rows
+        return CppSQLite3Query(mConfig, pVM, true /*eof*/, true, std::move(pCache), std::move(pColumns));
+    }
+    else if (nRet == SQLITE_ROW)
+    {
+        // at least 1 row
+        return CppSQLite3Query(mConfig, pVM, false /*eof*/, true, std::move(pCache), std::move(pColumns));
+    }
+    else
+    {
+        nRet = pCache ? pCache->release(pVM, std::move(pColumns)) : sqlite3_finalize(pVM);
+        const char* szError = sqlite3_errmsg(mConfig.db);
+        mConfig.error(nRet, szError, "when evaluating query");
+        return CppSQLite3Query();
+    }
+}
+
+
+int CppSQLite3DB::execScalar(CppSQLite3StringView szSQL)
+{
+    CppSQLite3Query q = execQuery(szSQL);
+
+    if (q.eof() || q.numFields() < 1)
+    {
+        throw std::invalid_argument("Invalid scalar query");
+    }
+
+    return atoi(q.fieldValue(0));
+}
+
+sqlite_int64 CppSQLite3DB::lastRowId() const
+{
+    return sqlite3_last_insert_rowid(mConfig.db);
+}
+
+
+void CppSQLite3DB::setBusyTimeout(int nMillisecs)
+{
+    mnBusyTimeoutMs = nMillisecs;
+    sqlite3_busy_timeout(mConfig.db, mnBusyTimeoutMs);
+    // the handler is kept for busyStats on other threads, its counters read zero while it is not installed
+    mbBusyPolicy = false;
+    mpBusyHandler->resetStats();
+}
+
+
+void CppSQLite3DB::setBusyPolicy(const CppSQLite3BusyPolicy& policy)
+{
+    mpBusyHandler->setPolicy(policy);
+    if (mConfig.db != nullptr)
+    {
+        sqlite3_busy_handler(mConfig.db, &CppSQLite3BusyHandler::callback, mpBusyHandler.get());
+    }
+    mbBusyPolicy = true;
+}
+
+
+CppSQLite3BusyStats CppSQLite3DB::busyStats() const
+{
+    return mpBusyHandler->stats();
+}
+
+
+CppSQLite3DBStats CppSQLite3DB::stats(bool bReset)
+{
+    checkDB();
+    const int nReset = bReset ? 1 : 0;
+    auto dbStatus = [this, nReset](int nOp, std::int64_t* pnHighwater = nullptr)
+    {
+        int nCurrent = 0;
+        int nHighwater = 0;
+        sqlite3_db_status(mConfig.db, nOp, &nCurrent, &nHighwater, nReset);
+        if (pnHighwater)
+        {
+            *pnHighwater = nHighwater;
+        }
+        return static_cast<std::int64_t>(nCurrent);
+    };
+    // the lookaside hits and misses are reported as high-water marks only
+    auto dbHighwater = [&dbStatus](int nOp)
+    {
+        std::int64_t nHighwater = 0;
+        dbStatus(nOp, &nHighwater);
+        return nHighwater;
+    };
+
+    CppSQLite3DBStats stats;
+    stats.cacheHits = dbStatus(SQLITE_DBSTATUS_CACHE_HIT);
+    stats.cacheMisses = dbStatus(SQLITE_DBSTATUS_CACHE_MISS);
+    stats.cacheWrites = dbStatus(SQLITE_DBSTATUS_CACHE_WRITE);
+    stats.cacheSpills = dbStatus(SQLITE_DBSTATUS_CACHE_SPILL);
+    stats.cacheUsed = dbStatus(SQLITE_DBSTATUS_CACHE_USED);
+    stats.lookasideUsed = dbStatus(SQLITE_DBSTATUS_LOOKASIDE_USED, &stats.lookasideHighwater);
+    stats.lookasideHits = dbHighwater(SQLITE_DBSTATUS_LOOKASIDE_HIT);
+    stats.lookasideMissSize = dbHighwater(SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE);
+    stats.lookasideMissFull = dbHighwater(SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL);
+    stats.schemaUsed = dbStatus(SQLITE_DBSTATUS_SCHEMA_USED);
+    stats.statementsUsed = dbStatus(SQLITE_DBSTATUS_STMT_USED);
+
+    sqlite3_int64 nCurrent = 0;
+    sqlite3_int64 nHighwater = 0;
+    sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &nCurrent, &nHighwater, nReset);
+    stats.memoryUsed = nCurrent;
+    stats.memoryHighwater = nHighwater;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_SIZE, &nCurrent, &nHighwater, nReset);
+    stats.largestAllocation = nHighwater;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_COUNT, &nCurrent, &nHighwater, nReset);
+    stats.allocations = nCurrent;
+    return stats;
+}
+
+
+CppSQLite3DeadlineScope CppSQLite3DB::withDeadline(std::chrono::milliseconds timeout)
+{
+    checkDB();
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    CppSQLite3DeadlineScope scope(*this, mpLimits->add(mConfig.db, deadline, nullptr));
+    mConfig.pTracer->install(mConfig.db);
+    return scope;
+}
+
+
+CppSQLite3DeadlineScope CppSQLite3DB::withDeadline(std::chrono::milliseconds timeout,
+                                                   const CppSQLite3CancellationToken& token)
+{
+    return withDeadline(std::chrono::steady_clock::now() + timeout, token);
+}
+
+
+CppSQLite3DeadlineScope CppSQLite3DB::withDeadline(std::chrono::steady_clock::time_point deadline,
+                                                   const CppSQLite3CancellationToken& token)
+{
+    checkDB();
+    CppSQLite3DeadlineScope scope(*this, mpLimits->add(mConfig.db, deadline, token.mpCancelled));
+    mConfig.pTracer->install(mConfig.db);
+    return scope;
+}
+
+
+CppSQLite3DeadlineScope CppSQLite3DB::withCancellation(const CppSQLite3CancellationToken& token)
+{
+    return withDeadline(std::chrono::steady_clock::time_point::max(), token);
+}
+
+
+void CppSQLite3DB::setDeadlineCheckInterval(int nInstructions)
+{
+    if (nInstructions < 1)
+    {
+        throw std::invalid_argument("Deadline check interval must be positive");
+    }
+    mpLimits->mnCheckInterval = nInstructions;
+    mpLimits->install(mConfig.db);
+}
+
+bool CppSQLite3DB::isInTransaction() const
+{
+    return mConfig.db != nullptr && !sqlite3_get_autocommit(mConfig.db);
+}
+
+void CppSQLite3DB::setErrorHandler(CppSQLite3ErrorHandler h)
+{
+    mConfig.errorHandler = h;
+}
+
+void CppSQLite3DB::setLogHandler(CppSQLite3LogHandler h)
+{
+    mConfig.logHandler = h;
+}
+
+int CppSQLite3DB::performCheckpoint(CppSQLite3StringView dbName, int mode, int* pnLogFrames,
+                                    int* pnCheckpointedFrames)
+{
+    int nRet = sqlite3_wal_checkpoint_v2(mConfig.db, dbName.c_str(), mode, pnLogFrames, pnCheckpointedFrames);
+    if (nRet != SQLITE_OK)
+    {
+        const char* szError = sqlite3_errmsg(mConfig.db);
+        mConfig.error(nRet, szError, "when performing checkpoint");
+    }
+    return nRet;
+}
+
+
+void CppSQLite3DB::setStatementCacheSize(std::size_t nStatements)
+{
+    mpStatementCache->setCapacity(nStatements);
+}
+
+
+CppSQLite3StatementCacheStats CppSQLite3DB::statementCacheStats() const
+{
+    return mpStatementCache->stats();
+}
+
+
+void CppSQLite3DB::setProfiler(std::shared_ptr<CppSQLite3Profiler> pProfiler)
+{
+    mConfig.pTracer->mpProfiler = std::move(pProfiler);
+    mConfig.pTracer->install(mConfig.db);
+}
+
+
+void CppSQLite3DB::setSlowQueryThreshold(std::chrono::microseconds threshold)
+{
+    auto nNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(threshold).count();
+    mConfig.pTracer->mnSlowQueryNs = static_cast<std::uint64_t>(std::max<std::int64_t>(nNanoseconds, 0));
+    mConfig.pTracer->install(mConfig.db);
+}
+
+
+void CppSQLite3DB::enableStatementStatusMonitor(bool bEnable, const CppSQLite3StatusMonitorOptions& options)
+{
+    mConfig.pTracer->enableStatusMonitor(bEnable, options);
+    mConfig.pTracer->install(mConfig.db);
+}
+
+
+CppSQLite3StatementStatus CppSQLite3DB::statementStatus(bool bReset)
+{
+    return mConfig.pTracer->statusTotals(bReset);
+}
+
+
+void CppSQLite3DB::checkDB() const
+{
+    if (!mConfig.db)
+    {
+        throw std::logic_error("Database not open");
+    }
+}
+
+
+sqlite3_stmt* CppSQLite3DB::compile(CppSQLite3StringView szSQL, std::shared_ptr<CppSQLite3StatementCache>& pCache,
+                                    std::shared_ptr<CppSQLite3ColumnMap>& pColumns)
+{
+    checkDB();
+
+    bool bUseCache = mpStatementCache->capacity() > 0 && szSQL.c_str() != nullptr;
+    if (bUseCache)
+    {
+        if (sqlite3_stmt* pCached = mpStatementCache->acquire(szSQL, pColumns))
+        {
+            pCache = mpStatementCache;
+            return pCached;
+        }
+    }
+
+    const char* szTail = 0;
+    sqlite3_stmt* pVM;
+
+    int prepareFlags = bUseCache ? SQLITE_PREPARE_PERSISTENT : 0;
+    int nRet = sqlite3_prepare_v3(mConfig.db, szSQL.c_str(), -1, prepareFlags, &pVM, &szTail);
+    const char* szError = sqlite3_errmsg(mConfig.db);
+
+    if (nRet != SQLITE_OK)
+    {
+        mConfig.error(nRet, szError, "when compiling statement");
+    }
+
+    // the cache is keyed by the statement's SQL text, so texts with trailing statements can't be cached
+    if (bUseCache && pVM != nullptr && szTail != nullptr && *szTail == '\0')
+    {
+        pCache = mpStatementCache;
+    }
+
+    return pVM;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+std::string quoteIdentifier(std::string_view identifier)
+{
+    std::string quoted = "\"";
+    for (char c : identifier)
+    {
+        quoted += c;
+        if (c == '"')
+        {
+            quoted += c;
+        }
+    }
+    quoted += '"';
+    return quoted;
+}
+
+} // namespace
+
+
+CppSQLite3BatchInserter::CppSQLite3BatchInserter(CppSQLite3DB& db, std::string_view table,
+                                                 const std::vector<std::string>& columns,
+                                                 const CppSQLite3BatchInsertOptions& options)
+    : mDB(db), mTable(table), mColumns(columns), mOptions(options), mnUncaughtExceptions(std::uncaught_exceptions())
+{
+    mDB.checkDB();
+    if (mColumns.empty())
+    {
+        throw std::invalid_argument("Batch insert needs at least one column");
+    }
+
+    auto nMaxVariables = static_cast<std::size_t>(sqlite3_limit(mDB.mConfig.db, SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+    mnRowsPerStatement = nMaxVariables / mColumns.size();
+    if (mnRowsPerStatement == 0)
+    {
+        throw std::invalid_argument(fmt::format("Batch insert of {} columns exceeds the limit of {} variables",
+                                                mColumns.size(), nMaxVariables));
+    }
+    if (mOptions.maxRowsPerStatement > 0)
+    {
+        mnRowsPerStatement = std::min(mnRowsPerStatement, mOptions.maxRowsPerStatement);
+    }
+    mValues.reserve(mnRowsPerStatement * mColumns.size());
+}
+
+
+CppSQLite3BatchInserter::~CppSQLite3BatchInserter()
+{
+    try
+    {
+        if (std::uncaught_exceptions() > mnUncaughtExceptions)
+        {
+            // the scope that filled the inserter failed, committing its rows would persist half of its work
+            discardRows();
+        }
+        else
+        {
+            flush();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        mDB.mConfig.log(CppSQLite3LogLevel::error,
+                        fmt::format("error during ~CppSQLite3BatchInserter: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        mDB.mConfig.log(CppSQLite3LogLevel::error, "unknown error during ~CppSQLite3BatchInserter");
+    }
+    sqlite3_finalize(mpBatchVM);
+    sqlite3_finalize(mpPartialVM);
+}
+
+
+void CppSQLite3BatchInserter::flush()
+{
+    if (mnBufferedRows > 0)
+    {
+        writeRows(mnBufferedRows);
+    }
+    if (mTransaction.isActive())
+    {
+        mTransaction.commit();
+    }
+    mnRowsInTransaction = 0;
+}
+
+
+CppSQLite3BatchInserter::Value& CppSQLite3BatchInserter::appendValue(int nType)
+{
+    Value& value = mValues.emplace_back();
+    value.type = nType;
+    value.nSize = 0;
+    return value;
+}
+
+
+void CppSQLite3BatchInserter::appendBytes(int nType, const void* pData, std::size_t nSize)
+{
+    Value& value = appendValue(nType);
+    value.nOffset = mData.size();
+    value.nSize = nSize;
+    auto pBytes = static_cast<const char*>(pData);
+    mData.insert(mData.end(), pBytes, pBytes + nSize);
+}
+
+
+void CppSQLite3BatchInserter::checkRowSize(std::size_t nValues) const
+{
+    if (nValues != mColumns.size())
+    {
+        throw std::invalid_argument(
+            fmt::format("Invalid number of values: batch insert expects {} but got {}", mColumns.size(), nValues));
+    }
+}
+
+
+void CppSQLite3BatchInserter::rowAppended()
+{
+    if (++mnBufferedRows == mnRowsPerStatement)
+    {
+        writeRows(mnBufferedRows);
+    }
+}
+
+
+void CppSQLite3BatchInserter::writeRows(std::size_t nRows)
+{
+    int nRet = SQLITE_OK;
+    try
+    {
+        if (mOptions.useTransaction && !mTransaction.isActive() && sqlite3_get_autocommit(mDB.mConfig.db))
+        {
+            // a bulk load writes anyway, taking the write lock up front avoids SQLITE_BUSY halfway through
+            mTransaction = mDB.beginTransaction(CppSQLite3TransactionMode::immediate);
+        }
+
+        sqlite3_stmt* pVM = statementFor(nRows);
+        nRet = pVM != nullptr ? SQLITE_OK : SQLITE_ERROR;
+
+        // every execution binds all parameters and the values stay in the buffers until the statement has run,
+        // so sqlite needn't copy them
+        int nParam = 0;
+        for (auto it = mValues.begin(); it != mValues.end() && nRet == SQLITE_OK; ++it)
+        {
+            const char* pData = mData.data() + it->nOffset;
+            switch (it->type)
+            {
+            case SQLITE_INTEGER:
+                nRet = sqlite3_bind_int64(pVM, ++nParam, it->nValue);
+                break;
+            case SQLITE_FLOAT:
+                nRet = sqlite3_bind_double(pVM, ++nParam, it->fValue);
+                break;
+            case SQLITE_TEXT:
+                nRet = sqlite3_bind_text64(pVM, ++nParam, pData, it->nSize, SQLITE_STATIC, SQLITE_UTF8);
+                break;
+            case SQLITE_BLOB:
+                nRet = sqlite3_bind_blob64(pVM, ++nParam, it->nSize > 0 ? pData : "", it->nSize, SQLITE_STATIC);
+                break;
+            default:
+                nRet = sqlite3_bind_null(pVM, ++nParam);
+                break;
+            }
+        }
+        if (nRet != SQLITE_OK && pVM != nullptr)
+        {
+            std::string error = sqlite3_errmsg(mDB.mConfig.db);
+            mDB.mConfig.error(nRet, error, "when binding batch insert values");
+        }
+        else if (pVM != nullptr)
+        {
+            nRet = sqlite3_step(pVM);
+            if (nRet != SQLITE_DONE)
+            {
+                nRet = sqlite3_reset(pVM);
+                std::string error = sqlite3_errmsg(mDB.mConfig.db);
+                mDB.mConfig.error(nRet, error, "when executing batch insert");
+            }
+            else
+            {
+                nRet = sqlite3_reset(pVM);
+            }
+        }
+    }
+    catch (...)
+    {
+        nRet = SQLITE_ERROR;
+        discardRows();
+        throw;
+    }
+
+    if (nRet != SQLITE_OK)
+    {
+        // the error handler didn't throw
+        discardRows();
+        return;
+    }
+    mValues.clear();
+    mData.clear();
+    mnBufferedRows = 0;
+    mnRowsInserted += nRows;
+    mnRowsInTransaction += nRows;
+    if (mTransaction.isActive() && mOptions.commitInterval > 0 && mnRowsInTransaction >= mOptions.commitInterval)
+    {
+        mnRowsInTransaction = 0;
+        mTransaction.commit();
+    }
+}
+
+
+void CppSQLite3BatchInserter::discardRows()
+{
+    mValues.clear();
+    mData.clear();
+    mnBufferedRows = 0;
+    if (mTransaction.isActive())
+    {
+        mnRowsInTransaction = 0;
+        mTransaction.rollback();
+    }
+}
+
+
+sqlite3_stmt* CppSQLite3BatchInserter::statementFor(std::size_t nRows)
+{
+    bool bFull = nRows == mnRowsPerStatement;
+    sqlite3_stmt*& pVM = bFull ? mpBatchVM : mpPartialVM;
+    if (pVM != nullptr && (bFull || nRows == mnPartialRows))
+    {
+        return pVM;
+    }
+    sqlite3_finalize(pVM);
+    pVM = nullptr;
+
+    std::string row = "(?";
+    for (std::size_t nCol = 1; nCol < mColumns.size(); ++nCol)
+    {
+        row += ",?";
+    }
+    row += ')';
+
+    std::string sql = "INSERT INTO " + quoteIdentifier(mTable) + " (";
+    for (std::size_t nCol = 0; nCol < mColumns.size(); ++nCol)
+    {
+        sql += nCol > 0 ? ", " : "";
+        sql += quoteIdentifier(mColumns[nCol]);
+    }
+    sql += ") VALUES ";
+    sql.reserve(sql.size() + nRows * (row.size() + 1));
+    for (std::size_t nRow = 0; nRow < nRows; ++nRow)
+    {
+        sql += nRow > 0 ? "," : "";
+        sql += row;
+    }
+
+    int nRet = sqlite3_prepare_v3(mDB.mConfig.db, sql.c_str(), static_cast<int>(sql.size()),
+                                  bFull ? SQLITE_PREPARE_PERSISTENT : 0, &pVM, nullptr);
+    if (nRet != SQLITE_OK)
+    {
+        std::string error = sqlite3_errmsg(mDB.mConfig.db);
+        mDB.mConfig.error(nRet, error, "when compiling batch insert");
+        return nullptr;
+    }
+    if (!bFull)
+    {
+        mnPartialRows = nRows;
+    }
+    return pVM;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3Transaction CppSQLite3DB::beginTransaction(CppSQLite3TransactionMode mode /*=deferred*/)
+{
+    switch (mode)
+    {
+    case CppSQLite3TransactionMode::immediate:
+        execTransactionControl(TransactionControl::beginImmediate);
+        break;
+    case CppSQLite3TransactionMode::exclusive:
+        execTransactionControl(TransactionControl::beginExclusive);
+        break;
+    default:
+        execTransactionControl(TransactionControl::beginDeferred);
+        break;
+    }
+    return CppSQLite3Transaction(*this);
+}
+
+
+CppSQLite3Savepoint CppSQLite3DB::savepoint()
+{
+    execTransactionControl(TransactionControl::savepoint, mnSavepoints + 1);
+    return CppSQLite3Savepoint(*this, ++mnSavepoints);
+}
+
+
+void CppSQLite3DB::execTransactionControl(TransactionControl control, int nDepth /*=0*/)
+{
+    static constexpr const char* gszContexts[] = {"when beginning transaction", "when beginning transaction",
+                                                  "when beginning transaction", "when committing transaction",
+                                                  "when rolling back transaction", "when creating savepoint",
+                                                  "when releasing savepoint", "when rolling back to savepoint"};
+    checkDB();
+
+    const auto nControl = static_cast<std::size_t>(control);
+    sqlite3_stmt* pVM = nullptr;
+    int nRet = mpTransactionStatements->get(mConfig.db, nControl, nDepth, pVM);
+    if (nRet == SQLITE_OK)
+    {
+        mConfig.log(CppSQLite3LogLevel::verbose, sqlite3_sql(pVM));
+        sqlite3_step(pVM);
+        // sqlite3_reset repeats the error of the step
+        nRet = sqlite3_reset(pVM);
+    }
+    if (nRet != SQLITE_OK)
+    {
+        std::string error = sqlite3_errmsg(mConfig.db);
+        mConfig.error(nRet, error, gszContexts[nControl]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3Transaction::CppSQLite3Transaction(CppSQLite3Transaction&& rTransaction) : mpDB(rTransaction.mpDB)
+{
+    rTransaction.mpDB = nullptr;
+}
+
+
+CppSQLite3Transaction& CppSQLite3Transaction::operator=(CppSQLite3Transaction&& rTransaction)
+{
+    if (this != &rTransaction)
+    {
+        if (mpDB != nullptr)
+        {
+            rollback();
+        }
+        mpDB = rTransaction.mpDB;
+        rTransaction.mpDB = nullptr;
+    }
+    return *this;
+}
+
+
+CppSQLite3Transaction::~CppSQLite3Transaction()
+{
+    if (mpDB == nullptr)
+    {
+        return;
+    }
+    CppSQLite3DB& db = *mpDB;
+    try
+    {
+        rollback();
+    }
+    catch (const std::exception& e)
+    {
+        db.mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Transaction: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        db.mConfig.log(CppSQLite3LogLevel::error, "unknown error during ~CppSQLite3Transaction");
+    }
+}
+
+
+void CppSQLite3Transaction::commit()
+{
+    checkActive();
+    mpDB->execTransactionControl(CppSQLite3DB::TransactionControl::commit);
+    if (!sqlite3_get_autocommit(mpDB->mConfig.db))
+    {
+        // the COMMIT failed without throwing (e.g. SQLITE_BUSY) and left the transaction open, so the guard stays
+        // active for a retry or the rollback of the destructor
+        return;
+    }
+    // the savepoints are released with the transaction
+    mpDB->mnSavepoints = 0;
+    mpDB = nullptr;
+}
+
+
+void CppSQLite3Transaction::rollback()
+{
+    checkActive();
+    CppSQLite3DB* pDB = mpDB;
+    mpDB = nullptr;
+    pDB->mnSavepoints = 0;
+    // some errors (e.g. SQLITE_FULL) roll back the transaction by themselves
+    if (pDB->isOpened() && !sqlite3_get_autocommit(pDB->mConfig.db))
+    {
+        pDB->execTransactionControl(CppSQLite3DB::TransactionControl::rollback);
+    }
+}
+
+
+void CppSQLite3Transaction::checkActive() const
+{
+    if (mpDB == nullptr)
+    {
+        throw std::logic_error("Transaction is not active");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3Savepoint::CppSQLite3Savepoint(CppSQLite3Savepoint&& rSavepoint)
+    : mpDB(rSavepoint.mpDB), mnDepth(rSavepoint.mnDepth)
+{
+    rSavepoint.mpDB = nullptr;
+}
+
+
+CppSQLite3Savepoint& CppSQLite3Savepoint::operator=(CppSQLite3Savepoint&& rSavepoint)
+{
+    if (this != &rSavepoint)
+    {
+        if (mpDB != nullptr)
+        {
+            rollback();
+        }
+        mpDB = rSavepoint.mpDB;
+        mnDepth = rSavepoint.mnDepth;
+        rSavepoint.mpDB = nullptr;
+    }
+    return *this;
+}
+
+
+CppSQLite3Savepoint::~CppSQLite3Savepoint()
+{
+    if (mpDB == nullptr)
+    {
+        return;
+    }
+    CppSQLite3DB& db = *mpDB;
+    try
+    {
+        rollback();
+    }
+    catch (const std::exception& e)
+    {
+        db.mConfig.log(CppSQLite3LogLevel::error, fmt::format("error during ~CppSQLite3Savepoint: {}", e.what()));
+    }
+
+    catch (...)
+    {
+        db.mConfig.log(CppSQLite3LogLevel::error, "unknown error during ~CppSQLite3Savepoint");
+    }
+}
+
+
+void CppSQLite3Savepoint::release()
+{
+    finish(false);
+}
+
+
+void CppSQLite3Savepoint::rollback()
+{
+    finish(true);
+}
+
+
+void CppSQLite3Savepoint::finish(bool bRollback)
+{
+    checkActive();
+    CppSQLite3DB* pDB = mpDB;
+    mpDB = nullptr;
+    if (mnDepth > pDB->mnSavepoints)
+    {
+        // ended along with its transaction or an outer savepoint
+        return;
+    }
+    if (!pDB->isOpened() || sqlite3_get_autocommit(pDB->mConfig.db))
+    {
+        // an error rolled back the transaction the savepoint belonged to
+        pDB->mnSavepoints = 0;
+        return;
+    }
+
+    pDB->mnSavepoints = mnDepth - 1;
+    if (bRollback)
+    {
+        pDB->execTransactionControl(CppSQLite3DB::TransactionControl::rollbackTo, mnDepth);
+    }
+    pDB->execTransactionControl(CppSQLite3DB::TransactionControl::release, mnDepth);
+}
+
+
+void CppSQLite3Savepoint::checkActive() const
+{
+    if (mpDB == nullptr)
+    {
+        throw std::logic_error("Savepoint is not active");
+    }
+}
+
+
+CppSQLite3DeadlineScope::CppSQLite3DeadlineScope(CppSQLite3DeadlineScope&& rScope)
+    : mpDB(rScope.mpDB), mnId(rScope.mnId)
+{
+    rScope.mpDB = nullptr;
+}
+
+
+CppSQLite3DeadlineScope& CppSQLite3DeadlineScope::operator=(CppSQLite3DeadlineScope&& rScope)
+{
+    if (this != &rScope)
+    {
+        end();
+        mpDB = rScope.mpDB;
+        mnId = rScope.mnId;
+        rScope.mpDB = nullptr;
+    }
+    return *this;
+}
+
+
+CppSQLite3DeadlineScope::~CppSQLite3DeadlineScope()
+{
+    end();
+}
+
+
+void CppSQLite3DeadlineScope::end()
+{
+    if (mpDB != nullptr)
+    {
+        mpDB->mpLimits->remove(mpDB->mConfig.db, mnId);
+        mpDB->mConfig.pTracer->install(mpDB->mConfig.db);
+        mpDB = nullptr;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class CppSQLite3PoolState
+{
+public:
+    explicit CppSQLite3PoolState(const CppSQLite3ConnectionPoolOptions& options) : mOptions(options)
+    {
+    }
+
+    void open(CppSQLite3DB& db, CppSQLite3StringView fileName, int flags)
+    {
+        if (mOptions.errorHandler)
+        {
+            db.setErrorHandler(mOptions.errorHandler);
+        }
+        if (mOptions.logHandler)
+        {
+            db.setLogHandler(mOptions.logHandler);
+        }
+        // a connection is only used by the thread holding its lease
+        db.open(fileName, flags | SQLITE_OPEN_NOMUTEX);
+        if (mOptions.busyPolicy)
+        {
+            db.setBusyPolicy(*mOptions.busyPolicy);
+        }
+        else
+        {
+            db.setBusyTimeout(mOptions.busyTimeoutMs);
+        }
+        if (mOptions.profiler)
+        {
+            db.setProfiler(mOptions.profiler);
+        }
+        db.setStatementCacheSize(mOptions.statementCacheSize);
+    }
+
+    /**
+     * @brief reopen replaces the connection of db by a new one, closing it ends any transaction for sure
+     */
+    void reopen(CppSQLite3DB& db)
+    {
+        int flags = &db == &mWriter ? SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE : SQLITE_OPEN_READONLY;
+        db.close();
+        open(db, mFileName, flags);
+    }
+
+    CppSQLite3ConnectionPoolOptions mOptions;
+    std::string mFileName;
+    std::mutex mMutex;
+    std::condition_variable mWriterReleased;
+    std::condition_variable mReaderReleased;
+    CppSQLite3DB mWriter;
+    bool mbWriterInUse = false;
+    std::vector<std::unique_ptr<CppSQLite3DB>> mReaders;
+    std::vector<CppSQLite3DB*> mIdleReaders;
+};
+
+
+CppSQLite3ConnectionPool::CppSQLite3ConnectionPool(CppSQLite3StringView fileName,
+                                                   const CppSQLite3ConnectionPoolOptions& options)
+    : mpState(std::make_shared<CppSQLite3PoolState>(options))
+{
+    mpState->mFileName = fileName.c_str();
+    mpState->open(mpState->mWriter, fileName, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (options.enableWAL)
+    {
+        // readers can't change the journal mode, so it is switched before they connect
+        mpState->mWriter.execQuery("PRAGMA journal_mode=WAL");
+    }
+    for (std::size_t nReader = 0; nReader < options.readers; ++nReader)
+    {
+        auto pReader = std::make_unique<CppSQLite3DB>();
+        mpState->open(*pReader, fileName, SQLITE_OPEN_READONLY);
+        mpState->mIdleReaders.push_back(pReader.get());
+        mpState->mReaders.push_back(std::move(pReader));
+    }
+}
+
+
+CppSQLite3ConnectionPool::~CppSQLite3ConnectionPool() = default;
+
+
+CppSQLite3ConnectionLease CppSQLite3ConnectionPool::acquireWriter()
+{
+    return acquire(true, true);
+}
+
+
+CppSQLite3ConnectionLease CppSQLite3ConnectionPool::acquireReader()
+{
+    return acquire(false, true);
+}
+
+
+CppSQLite3ConnectionLease CppSQLite3ConnectionPool::tryAcquireWriter()
+{
+    return acquire(true, false);
+}
+
+
+CppSQLite3ConnectionLease CppSQLite3ConnectionPool::tryAcquireReader()
+{
+    return acquire(false, false);
+}
+
+
+std::size_t CppSQLite3ConnectionPool::numReaders() const
+{
+    return mpState->mReaders.size();
+}
+
+
+std::size_t CppSQLite3ConnectionPool::idleReaders() const
+{
+    std::lock_guard<std::mutex> lock(mpState->mMutex);
+    return mpState->mIdleReaders.size();
+}
+
+
+CppSQLite3ConnectionLease CppSQLite3ConnectionPool::acquire(bool bWriter, bool bWait)
+{
+    CppSQLite3PoolState& state = *mpState;
+    // without readers the writer serves reads as well
+    bWriter = bWriter || state.mReaders.empty();
+
+    std::unique_lock<std::mutex> lock(state.mMutex);
+    auto isAvailable = [&state, bWriter]() { return bWriter ? !state.mbWriterInUse : !state.mIdleReaders.empty(); };
+    if (!isAvailable())
+    {
+        if (!bWait)
+        {
+            return CppSQLite3ConnectionLease();
+        }
+        auto& released = bWriter ? state.mWriterReleased : state.mReaderReleased;
+        if (state.mOptions.acquireTimeoutMs < 0)
+        {
+            released.wait(lock, isAvailable);
+        }
+        else if (!released.wait_for(lock, std::chrono::milliseconds(state.mOptions.acquireTimeoutMs), isAvailable))
+        {
+            lock.unlock();
+            auto error = fmt::format("no {} connection available after {} ms", bWriter ? "write" : "read",
+                                     state.mOptions.acquireTimeoutMs);
+            state.mWriter.mConfig.error(SQLITE_BUSY, error, "when acquiring pooled connection");
+            return CppSQLite3ConnectionLease();
+        }
+    }
+
+    CppSQLite3DB* pDB = &state.mWriter;
+    if (bWriter)
+    {
+        state.mbWriterInUse = true;
+    }
+    else
+    {
+        pDB = state.mIdleReaders.back();
+        state.mIdleReaders.pop_back();
+    }
+    return CppSQLite3ConnectionLease(mpState, pDB);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CppSQLite3ConnectionLease::CppSQLite3ConnectionLease(CppSQLite3ConnectionLease&& rLease)
+    : mpState(std::move(rLease.mpState)), mpDB(rLease.mpDB)
+{
+    rLease.mpDB = nullptr;
+}
+
+
+CppSQLite3ConnectionLease& CppSQLite3ConnectionLease::operator=(CppSQLite3ConnectionLease&& rLease)
+{
+    if (this != &rLease)
+    {
+        release();
+        mpState = std::move(rLease.mpState);
+        mpDB = rLease.mpDB;
+        rLease.mpDB = nullptr;
+    }
+    return *this;
+}
+
+
+CppSQLite3ConnectionLease::~CppSQLite3ConnectionLease()
+{
+    release();
+}
+
+
+void CppSQLite3ConnectionLease::release()
+{
+    if (mpDB == nullptr)
+    {
+        return;
+    }
+    CppSQLite3DB* pDB = mpDB;
+    mpDB = nullptr;
+    auto pState = std::move(mpState);
+
+    if (pDB->isInTransaction())
+    {
+        // the next holder would inherit the transaction and its locks
+        pDB->mConfig.log(CppSQLite3LogLevel::warning, "pooled connection released with open transaction, rolling back");
+        try
+        {
+            // savepoints still held by the previous holder must not act on the transactions of the next one
+            pDB->mnSavepoints = 0;
+            pDB->execTransactionControl(CppSQLite3DB::TransactionControl::rollback);
+            if (pDB->isInTransaction())
+            {
+                pDB->mConfig.log(CppSQLite3LogLevel::warning, "rollback of pooled connection failed, reopening it");
+                pState->reopen(*pDB);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            pDB->mConfig.log(CppSQLite3LogLevel::error,
+                             fmt::format("error during CppSQLite3ConnectionLease::release: {}", e.what()));
+        }
+
+        catch (...)
+        {
+            pDB->mConfig.log(CppSQLite3LogLevel::error, "unknown error during CppSQLite3ConnectionLease::release");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(pState->mMutex);
+    if (pDB == &pState->mWriter)
+    {
+        pState->mbWriterInUse = false;
+        pState->mWriterReleased.notify_one();
+    }
+    else
+    {
+        pState->mIdleReaders.push_back(pDB);
+        pState->mReaderReleased.notify_one();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class CppSQLite3WriteQueueState
+{
+public:
+    using Job = CppSQLite3WriteQueue::Job;
+
+    CppSQLite3WriteQueueState(CppSQLite3DB& db, const CppSQLite3WriteQueueOptions& options)
+        : mDB(db), mOptions(options)
+    {
+        mOptions.maxJobsPerCommit = std::max<std::size_t>(mOptions.maxJobsPerCommit, 1);
+    }
+
+    void run()
+    {
+        std::vector<std::unique_ptr<Job>> jobs;
+        while (takeJobs(jobs))
+        {
+            runJobs(jobs);
+            jobs.clear();
+        }
+    }
+
+    /**
+     * @brief takeJobs waits for the next flush window and moves its jobs to jobs
+     * @return false once the queue is stopped and empty
+     */
+    bool takeJobs(std::vector<std::unique_ptr<Job>>& jobs)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJobQueued.wait(lock, [this]() { return !mJobs.empty() || mbStop; });
+        if (mJobs.empty())
+        {
+            return false;
+        }
+
+        // more jobs arriving within the window share the commit
+        auto windowEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(mOptions.maxDelayMs);
+        mJobQueued.wait_until(lock, windowEnd,
+                              [this]() { return mJobs.size() >= mOptions.maxJobsPerCommit || mbStop; });
+
+        std::size_t nJobs = std::min(mJobs.size(), mOptions.maxJobsPerCommit);
+        std::move(mJobs.begin(), mJobs.begin() + nJobs, std::back_inserter(jobs));
+        mJobs.erase(mJobs.begin(), mJobs.begin() + nJobs);
+        return true;
+    }
+
+    void runJobs(std::vector<std::unique_ptr<Job>>& jobs)
+    {
+        std::size_t nFailed = 0;
+        CppSQLite3Transaction transaction;
+        std::vector<Job*> succeeded;
+        for (auto it = jobs.begin(); it != jobs.end(); ++it)
+        {
+            if (!transaction.isActive())
+            {
+                try
+                {
+                    transaction = mDB.beginTransaction(mOptions.transactionMode);
+                }
+                catch (...)
+                {
+                    nFailed += jobs.end() - it;
+                    for (; it != jobs.end(); ++it)
+                    {
+                        (*it)->fail(std::current_exception());
+                    }
+                    break;
+                }
+            }
+
+            try
+            {
+                auto savepoint = mDB.savepoint();
+                (*it)->run(mDB);
+                savepoint.release();
+                succeeded.push_back(it->get());
+            }
+            catch (...)
+            {
+                // the savepoint rolled back the job's changes
+                (*it)->fail(std::current_exception());
+                ++nFailed;
+                if (!mDB.isInTransaction())
+                {
+                    // SQLITE_FULL, SQLITE_IOERR or an interrupt rolled back the whole transaction, the jobs before
+                    // lost their changes as well and the rest of the group starts over
+                    for (Job* pJob : succeeded)
+                    {
+                        pJob->fail(std::current_exception());
+                    }
+                    nFailed += succeeded.size();
+                    succeeded.clear();
+                    transaction.rollback();
+                }
+            }
+        }
+
+        if (!transaction.isActive())
+        {
+            addStats(jobs.size(), nFailed, 0);
+            return;
+        }
+
+        try
+        {
+            transaction.commit();
+        }
+        catch (...)
+        {
+            addStats(jobs.size(), nFailed + succeeded.size(), 0);
+            for (Job* pJob : succeeded)
+            {
+                pJob->fail(std::current_exception());
+            }
+            return;
+        }
+        addStats(jobs.size(), nFailed, 1);
+        for (Job* pJob : succeeded)
+        {
+            pJob->complete();
+        }
+    }
+
+    void addStats(std::size_t nJobs, std::size_t nFailed, std::size_t nCommits)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.jobs += nJobs;
+        mStats.failedJobs += nFailed;
+        mStats.commits += nCommits;
+    }
+
+    CppSQLite3DB& mDB;
+    CppSQLite3WriteQueueOptions mOptions;
+    std::mutex mMutex;
+    std::condition_variable mJobQueued;
+    std::deque<std::unique_ptr<Job>> mJobs;
+    bool mbStop = false;
+    CppSQLite3WriteQueueStats mStats;
+    std::thread mThread;
+};
+
+
+CppSQLite3WriteQueue::CppSQLite3WriteQueue(CppSQLite3DB& db, const CppSQLite3WriteQueueOptions& options)
+    : mpState(std::make_unique<CppSQLite3WriteQueueState>(db, options))
+{
+    db.checkDB();
+    mpState->mThread = std::thread([pState = mpState.get()]() { pState->run(); });
+}
+
+
+CppSQLite3WriteQueue::~CppSQLite3WriteQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mpState->mMutex);
+        mpState->mbStop = true;
+    }
+    mpState->mJobQueued.notify_one();
+    mpState->mThread.join();
+}
+
+
+void CppSQLite3WriteQueue::enqueue(std::unique_ptr<Job> pJob)
+{
+    {
+        std::lock_guard<std::mutex> lock(mpState->mMutex);
+        if (mpState->mbStop)
+        {
+            throw std::logic_error("Write queue is stopped");
+        }
+        mpState->mJobs.push_back(std::move(pJob));
+    }
+    mpState->mJobQueued.notify_one();
+}
+
+
+CppSQLite3WriteQueueStats CppSQLite3WriteQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock(mpState->mMutex);
+    return mpState->mStats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class CppSQLite3CheckpointState
+{
+public:
+    explicit CppSQLite3CheckpointState(const CppSQLite3CheckpointOptions& options) : mOptions(options)
+    {
+    }
+
+    static int walHook(void* pState, sqlite3* /*db*/, const char* szDbName, int nFrames)
+    {
+        // attached databases have WALs of their own
+        if (std::strcmp(szDbName, "main") == 0)
+        {
+            static_cast<CppSQLite3CheckpointState*>(pState)->committed(nFrames);
+        }
+        return SQLITE_OK;
+    }
+
+    /**
+     * @brief committed is called by the WAL hook on the thread that committed, it must not checkpoint itself
+     */
+    void committed(int nFrames)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            // a smaller WAL was reset and written from its start
+            mStats.framesWritten += nFrames >= mStats.walFrames ? nFrames - mStats.walFrames : nFrames;
+            mStats.walFrames = nFrames;
+            mnPendingFrames = nFrames;
+        }
+        if (nFrames >= mOptions.passiveFrames)
+        {
+            mWalGrown.notify_one();
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (waitForCheckpoint(lock))
+        {
+            auto now = std::chrono::steady_clock::now();
+            int mode = SQLITE_CHECKPOINT_PASSIVE;
+            if (now >= mEscalateAfter && mnPendingFrames >= mOptions.truncateFrames)
+            {
+                mode = SQLITE_CHECKPOINT_TRUNCATE;
+            }
+            else if (now >= mEscalateAfter && mnPendingFrames >= mOptions.restartFrames)
+            {
+                mode = SQLITE_CHECKPOINT_RESTART;
+            }
+            // the next commit reports whether the WAL still has to be checkpointed
+            mnPendingFrames = 0;
+
+            lock.unlock();
+            int nLogFrames = 0;
+            int nCheckpointedFrames = 0;
+            int nRet = SQLITE_OK;
+            std::string error;
+            // the error handler may not throw or throw anything, nothing may escape the thread
+            try
+            {
+                nRet = mConnection.performCheckpoint("main", mode, &nLogFrames, &nCheckpointedFrames);
+            }
+            catch (const CppSQLite3Exception& e)
+            {
+                nRet = e.errorCode();
+                error = e.what();
+            }
+            catch (const std::exception& e)
+            {
+                nRet = SQLITE_ERROR;
+                error = e.what();
+            }
+            catch (...)
+            {
+                nRet = SQLITE_ERROR;
+                error = "unknown error";
+            }
+            const bool bBusy = nRet == SQLITE_BUSY;
+            const bool bFailed = nRet != SQLITE_OK && !bBusy;
+            if (bFailed)
+            {
+                log(CppSQLite3LogLevel::error,
+                    fmt::format("WAL checkpoint failed: {}",
+                                error.empty() ? CppSQLite3Exception::errorCodeAsString(nRet) : error));
+            }
+            lock.lock();
+
+            now = std::chrono::steady_clock::now();
+            mNextCheckpoint = now + std::chrono::milliseconds(mOptions.minIntervalMs);
+            auto entry = record(mode, nLogFrames, nCheckpointedFrames, bBusy, bFailed, now);
+            if (entry)
+            {
+                // the log handler may take locks of its own or take a while
+                lock.unlock();
+                log(entry->level, entry->message);
+                lock.lock();
+            }
+        }
+    }
+
+    /**
+     * @brief waitForCheckpoint waits until the WAL has grown past passiveFrames and minIntervalMs have passed
+     * @return false once the scheduler is stopped
+     */
+    bool waitForCheckpoint(std::unique_lock<std::mutex>& lock)
+    {
+        mWalGrown.wait(lock, [this]() { return mnPendingFrames >= mOptions.passiveFrames || mbStop; });
+        // commits arriving meanwhile are covered by the same checkpoint
+        mWalGrown.wait_until(lock, mNextCheckpoint, [this]() { return mbStop; });
+        return !mbStop;
+    }
+
+    struct LogEntry
+    {
+        CppSQLite3LogLevel::Level level;
+        std::string message;
+    };
+
+    /**
+     * @brief record updates the stats and backoff with the result of a checkpoint, called with mMutex held
+     * @return the message to log once mMutex is released
+     */
+    std::optional<LogEntry> record(int mode, int nLogFrames, int nCheckpointedFrames, bool bBusy, bool bFailed,
+                                   std::chrono::steady_clock::time_point now)
+    {
+        const char* szMode = "PASSIVE";
+        if (mode == SQLITE_CHECKPOINT_TRUNCATE)
+        {
+            ++mStats.truncate;
+            szMode = "TRUNCATE";
+        }
+        else if (mode == SQLITE_CHECKPOINT_RESTART)
+        {
+            ++mStats.restart;
+            szMode = "RESTART";
+        }
+        else
+        {
+            ++mStats.passive;
+        }
+        if (bFailed)
+        {
+            ++mStats.failed;
+            return std::nullopt;
+        }
+        mStats.lastLogFrames = nLogFrames;
+        mStats.lastCheckpointedFrames = nCheckpointedFrames;
+        bool bIncomplete = bBusy || nCheckpointedFrames < nLogFrames;
+        if (bIncomplete)
+        {
+            ++mStats.incomplete;
+        }
+        if (mode == SQLITE_CHECKPOINT_PASSIVE)
+        {
+            return std::nullopt;
+        }
+
+        if (bIncomplete)
+        {
+            mnBackoffMs = mnBackoffMs == 0 ? mOptions.minBackoffMs : std::min(mnBackoffMs * 2, mOptions.maxBackoffMs);
+            mEscalateAfter = now + std::chrono::milliseconds(mnBackoffMs);
+            return LogEntry{
+                CppSQLite3LogLevel::warning,
+                fmt::format("WAL checkpoint ({}) incomplete, {} of {} frames checkpointed, retrying in {} ms", szMode,
+                            nCheckpointedFrames, nLogFrames, mnBackoffMs)};
+        }
+        mnBackoffMs = 0;
+        return LogEntry{CppSQLite3LogLevel::info,
+                        fmt::format("WAL checkpoint ({}) checkpointed {} frames", szMode, nCheckpointedFrames)};
+    }
+
+    void log(CppSQLite3LogLevel::Level level, CppSQLite3StringView message)
+    {
+        try
+        {
+            mLogHandler(CppSQLite3LogLevel(level), message);
+        }
+        catch (...)
+        {
+            // there is nobody to report a failing log handler to on this thread
+        }
+    }
+
+    CppSQLite3CheckpointOptions mOptions;
+    CppSQLite3LogHandler mLogHandler = nullptr;
+    CppSQLite3DB mConnection; // checkpoints run on their own connection, the watched one may be busy or NOMUTEX
+    std::mutex mMutex;
+    std::condition_variable mWalGrown;
+    int mnPendingFrames = 0; // WAL size of the latest commit, reset by each checkpoint
+    int mnBackoffMs = 0;
+    std::chrono::steady_clock::time_point mNextCheckpoint;
+    std::chrono::steady_clock::time_point mEscalateAfter;
+    bool mbStop = false;
+    CppSQLite3CheckpointStats mStats;
+    std::thread mThread;
+};
+
+
+CppSQLite3CheckpointScheduler::CppSQLite3CheckpointScheduler(CppSQLite3DB& db,
+                                                             const CppSQLite3CheckpointOptions& options)
+    : mDB(db), mpState(std::make_unique<CppSQLite3CheckpointState>(options))
+{
+    db.checkDB();
+    const char* szFile = sqlite3_db_filename(db.mConfig.db, "main");
+    if (szFile == nullptr || *szFile == '\0')
+    {
+        throw std::invalid_argument("Checkpoint scheduler needs a database file");
+    }
+    mpState->mLogHandler = db.mConfig.logHandler;
+    mpState->mConnection.setErrorHandler(db.mConfig.errorHandler);
+    mpState->mConnection.setLogHandler(db.mConfig.logHandler);
+    mpState->mConnection.open(szFile, SQLITE_OPEN_READWRITE);
+    mpState->mConnection.setBusyTimeout(options.busyTimeoutMs);
+    // the connection only knows the database is in WAL mode once it has read from it
+    mpState->mConnection.execScalar("SELECT COUNT(*) FROM sqlite_master");
+
+    // the hook replaces the automatic checkpoints, after which the pragma reads 0
+    mnAutoCheckpointFrames = db.execScalar("PRAGMA wal_autocheckpoint");
+    sqlite3_wal_hook(db.mConfig.db, &CppSQLite3CheckpointState::walHook, mpState.get());
+    mpState->mThread = std::thread([pState = mpState.get()]() { pState->run(); });
+}
+
+
+CppSQLite3CheckpointScheduler::~CppSQLite3CheckpointScheduler()
+{
+    if (mDB.mConfig.db != nullptr)
+    {
+        // sqlite3_wal_autocheckpoint replaces the hook
+        sqlite3_wal_autocheckpoint(mDB.mConfig.db, mnAutoCheckpointFrames);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mpState->mMutex);
+        mpState->mbStop = true;
+    }
+    mpState->mWalGrown.notify_one();
+    mpState->mThread.join();
+}
+
+
+CppSQLite3CheckpointStats CppSQLite3CheckpointScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(mpState->mMutex);
+    return mpState->mStats;
 }
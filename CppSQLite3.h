@@ -8,13 +8,33 @@
 #ifndef CppSQLite3_H
 #define CppSQLite3_H
 
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
 #include <sqlite3.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #define CPPSQLITE_ERROR 1000
+#define CPPSQLITE_DEADLINE_EXCEEDED 1001 // a statement ran past the deadline of a CppSQLite3DeadlineScope
+#define CPPSQLITE_CANCELLED 1002         // a statement was cancelled through a CppSQLite3CancellationToken
 
 /**
  * @brief CppSQLite3StringView defines a very basic string view and can be constructed from C-style strings and
@@ -63,6 +83,284 @@ inline bool operator<(CppSQLite3StringView lhs, CppSQLite3StringView rhs) noexce
     return std::string_view(lhs.c_str()) < std::string_view(rhs.c_str());
 }
 
+/**
+ * @brief CppSQLite3BlobView is a non-owning view of binary data, a stand-in for std::span<const unsigned char>.
+ */
+class CppSQLite3BlobView
+{
+public:
+    constexpr CppSQLite3BlobView() = default;
+
+    constexpr CppSQLite3BlobView(const unsigned char* data, std::size_t size) : data_(data), size_(size)
+    {
+    }
+
+    constexpr const unsigned char* data() const
+    {
+        return data_;
+    }
+
+    constexpr std::size_t size() const
+    {
+        return size_;
+    }
+
+    constexpr bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    constexpr const unsigned char* begin() const
+    {
+        return data_;
+    }
+
+    constexpr const unsigned char* end() const
+    {
+        return data_ + size_;
+    }
+
+    constexpr unsigned char operator[](std::size_t index) const
+    {
+        return data_[index];
+    }
+
+private:
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/**
+ * @brief CppSQLite3ValueTraits maps C++ types to sqlite values, see CppSQLite3Query::get.
+ *
+ * Specializations provide `static T column(sqlite3_stmt* pVM, int nCol)` which reads a value from a valid column of
+ * the current row, and `static int bind(sqlite3_stmt* pVM, int nParam, const T& value)` which binds a parameter and
+ * returns the sqlite result code (see CppSQLite3Statement::execute). Specialize it for your own types to make them
+ * usable with get<T> and execute / query.
+ * NULL values read as 0, 0.0 or empty strings / blobs, except for const char*, which becomes nullptr like the
+ * text of sqlite3_column_text, and std::optional<T>, which becomes std::nullopt.
+ */
+template <typename T, typename Enable = void>
+struct CppSQLite3ValueTraits;
+
+template <typename T>
+struct CppSQLite3ValueTraits<T, std::enable_if_t<std::is_integral_v<T>>>
+{
+    static T column(sqlite3_stmt* pVM, int nCol)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            return sqlite3_column_int64(pVM, nCol) != 0;
+        }
+        else if constexpr (sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed_v<T>))
+        {
+            return static_cast<T>(sqlite3_column_int(pVM, nCol));
+        }
+        else
+        {
+            return static_cast<T>(sqlite3_column_int64(pVM, nCol));
+        }
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, T value)
+    {
+        if constexpr (sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed_v<T>))
+        {
+            return sqlite3_bind_int(pVM, nParam, value);
+        }
+        else
+        {
+            return sqlite3_bind_int64(pVM, nParam, static_cast<sqlite3_int64>(value));
+        }
+    }
+};
+
+template <typename T>
+struct CppSQLite3ValueTraits<T, std::enable_if_t<std::is_floating_point_v<T>>>
+{
+    static T column(sqlite3_stmt* pVM, int nCol)
+    {
+        return static_cast<T>(sqlite3_column_double(pVM, nCol));
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, T value)
+    {
+        return sqlite3_bind_double(pVM, nParam, value);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<const char*>
+{
+    static const char* column(sqlite3_stmt* pVM, int nCol)
+    {
+        return reinterpret_cast<const char*>(sqlite3_column_text(pVM, nCol));
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, const char* value)
+    {
+        return sqlite3_bind_text(pVM, nParam, value, -1, SQLITE_TRANSIENT);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<CppSQLite3StringView>
+{
+    static int bind(sqlite3_stmt* pVM, int nParam, CppSQLite3StringView value)
+    {
+        return sqlite3_bind_text(pVM, nParam, value.c_str(), -1, SQLITE_TRANSIENT);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<std::string_view>
+{
+    static std::string_view column(sqlite3_stmt* pVM, int nCol)
+    {
+        // sqlite3_column_bytes has to be called after sqlite3_column_text, which may convert the value
+        const char* szText = reinterpret_cast<const char*>(sqlite3_column_text(pVM, nCol));
+        return szText == nullptr ? std::string_view() : std::string_view(szText, sqlite3_column_bytes(pVM, nCol));
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, std::string_view value)
+    {
+        // a default constructed view has no data pointer, bind it as empty string rather than NULL
+        const char* szData = value.data() == nullptr ? "" : value.data();
+        return sqlite3_bind_text64(pVM, nParam, szData, value.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<std::string>
+{
+    static std::string column(sqlite3_stmt* pVM, int nCol)
+    {
+        return std::string(CppSQLite3ValueTraits<std::string_view>::column(pVM, nCol));
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, const std::string& value)
+    {
+        return CppSQLite3ValueTraits<std::string_view>::bind(pVM, nParam, value);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<CppSQLite3BlobView>
+{
+    static CppSQLite3BlobView column(sqlite3_stmt* pVM, int nCol)
+    {
+        // sqlite3_column_bytes has to be called after sqlite3_column_blob, which may convert the value
+        auto pData = static_cast<const unsigned char*>(sqlite3_column_blob(pVM, nCol));
+        return pData == nullptr ? CppSQLite3BlobView() : CppSQLite3BlobView(pData, sqlite3_column_bytes(pVM, nCol));
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, CppSQLite3BlobView value)
+    {
+        // sqlite binds a nullptr as NULL, so empty blobs need a valid pointer
+        static const unsigned char empty = 0;
+        return sqlite3_bind_blob64(pVM, nParam, value.data() == nullptr ? &empty : value.data(), value.size(),
+                                   SQLITE_TRANSIENT);
+    }
+};
+
+template <>
+struct CppSQLite3ValueTraits<std::nullptr_t>
+{
+    static int bind(sqlite3_stmt* pVM, int nParam, std::nullptr_t)
+    {
+        return sqlite3_bind_null(pVM, nParam);
+    }
+};
+
+template <typename T>
+struct CppSQLite3ValueTraits<std::optional<T>>
+{
+    static std::optional<T> column(sqlite3_stmt* pVM, int nCol)
+    {
+        if (sqlite3_column_type(pVM, nCol) == SQLITE_NULL)
+        {
+            return std::nullopt;
+        }
+        return CppSQLite3ValueTraits<T>::column(pVM, nCol);
+    }
+
+    static int bind(sqlite3_stmt* pVM, int nParam, const std::optional<T>& value)
+    {
+        return value ? CppSQLite3ValueTraits<T>::bind(pVM, nParam, *value) : sqlite3_bind_null(pVM, nParam);
+    }
+};
+
+/**
+ * @brief CppSQLite3RowTraits maps a struct to the columns of a result row and to the parameters of a statement,
+ * see CppSQLite3Query::getRow and CppSQLite3Statement::bindRow.
+ *
+ * Specializations provide `fields`, a tuple of member pointers in column / parameter order:
+ *
+ *     template <>
+ *     struct CppSQLite3RowTraits<Person>
+ *     {
+ *         static constexpr auto fields = std::make_tuple(&Person::id, &Person::name, &Person::score);
+ *     };
+ *
+ * Every member type needs a CppSQLite3ValueTraits specialization.
+ */
+template <typename T>
+struct CppSQLite3RowTraits;
+
+namespace CppSQLite3Detail
+{
+
+template <typename T>
+struct RemoveOptional
+{
+    using type = T;
+};
+
+template <typename T>
+struct RemoveOptional<std::optional<T>>
+{
+    using type = T;
+};
+
+template <typename MemberPointer>
+struct MemberType;
+
+template <typename Class, typename Member>
+struct MemberType<Member Class::*>
+{
+    using type = Member;
+};
+
+template <typename T>
+constexpr bool isOptional = false;
+
+template <typename T>
+constexpr bool isOptional<std::optional<T>> = true;
+
+template <typename T>
+constexpr bool alwaysFalse = false;
+
+template <typename Row>
+using RowFields = std::decay_t<decltype(CppSQLite3RowTraits<Row>::fields)>;
+
+template <typename Row, std::size_t I>
+using RowFieldType = typename MemberType<std::tuple_element_t<I, RowFields<Row>>>::type;
+
+template <typename Row>
+constexpr std::size_t rowFieldCount()
+{
+    return std::tuple_size_v<RowFields<Row>>;
+}
+
+// marks the fields that may not be read from columns with TEXT affinity
+template <typename Row, std::size_t... I>
+constexpr std::array<bool, sizeof...(I)> numericRowFields(std::index_sequence<I...>)
+{
+    return {std::is_arithmetic_v<typename RemoveOptional<RowFieldType<Row, I>>::type>...};
+}
+
+} // namespace CppSQLite3Detail
+
 struct CppSQLite3LogLevel
 {
     enum Level
@@ -98,6 +396,13 @@ private:
     int mnErrCode;
 };
 
+// deadlines and cancellation tokens of a connection, enforced by its progress handler
+class CppSQLite3ExecutionLimits;
+
+// sqlite3_trace_v2 callback of a connection, feeds its CppSQLite3Profiler, finds slow queries and watches statement
+// status counters
+class CppSQLite3Tracer;
+
 struct CppSQLite3Config
 {
     CppSQLite3Config();
@@ -105,9 +410,300 @@ struct CppSQLite3Config
     CppSQLite3ErrorHandler errorHandler;
     CppSQLite3LogHandler logHandler;
     bool enableVerboseLogging = false;
+    CppSQLite3ExecutionLimits* pLimits = nullptr;
+    std::shared_ptr<CppSQLite3Tracer> pTracer; // shared, the trace callback may run after the connection is gone
     void log(CppSQLite3LogLevel::Level level, CppSQLite3StringView message);
+
+    /**
+     * @brief logTraceWarnings logs the slow queries and statement status warnings found since the last call
+     */
+    void logTraceWarnings();
+
+    /**
+     * @brief error calls errorHandler, reporting interrupts by a deadline or cancellation with their own error codes
+     */
+    void error(int nErrCode, std::string_view message, std::string_view context);
+};
+
+/**
+ * @brief CppSQLite3CancellationToken cancels the statements of a CppSQLite3DeadlineScope from any thread
+ *
+ * Copies share the same state, so one copy can be handed to the connection and another one kept for cancelling.
+ */
+class CppSQLite3CancellationToken
+{
+public:
+    CppSQLite3CancellationToken() : mpCancelled(std::make_shared<std::atomic<bool>>(false))
+    {
+    }
+
+    void cancel()
+    {
+        mpCancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool isCancelled() const
+    {
+        return mpCancelled->load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class CppSQLite3DB;
+
+    std::shared_ptr<std::atomic<bool>> mpCancelled;
+};
+
+/**
+ * @brief CppSQLite3StatementCacheStats reports the state of a connection's prepared statement cache
+ */
+struct CppSQLite3StatementCacheStats
+{
+    std::size_t hits = 0;      ///< statements that were handed out from the cache
+    std::size_t misses = 0;    ///< lookups that had to compile the statement
+    std::size_t evictions = 0; ///< least recently used statements that were finalized to make room
+    std::size_t size = 0;      ///< statements currently kept in the cache
+    std::size_t capacity = 0;  ///< maximum number of statements kept in the cache
+};
+
+/**
+ * @brief CppSQLite3StatementStatus holds the sqlite3_stmt_status counters of a statement
+ *
+ * Counters accumulate over all runs of the statement until they are reset, including runs before the statement was
+ * returned to (and handed out again by) the statement cache.
+ */
+struct CppSQLite3StatementStatus
+{
+    std::uint64_t fullscanSteps = 0; ///< SQLITE_STMTSTATUS_FULLSCAN_STEP, forward steps of full table scans
+    std::uint64_t sorts = 0;         ///< SQLITE_STMTSTATUS_SORT, sort operations
+    std::uint64_t autoindexRows = 0; ///< SQLITE_STMTSTATUS_AUTOINDEX, rows inserted into automatic indexes
+    std::uint64_t vmSteps = 0;       ///< SQLITE_STMTSTATUS_VM_STEP, virtual machine instructions run
+    std::uint64_t reprepares = 0;    ///< SQLITE_STMTSTATUS_REPREPARE, recompilations after schema changes
+    std::uint64_t runs = 0;          ///< SQLITE_STMTSTATUS_RUN, completed and reset runs
+    std::uint64_t memoryUsed = 0;    ///< SQLITE_STMTSTATUS_MEMUSED, bytes of heap used by the statement (no reset)
+};
+
+/**
+ * @brief CppSQLite3StatusMonitorOptions selects the statements the status monitor of a connection warns about
+ */
+struct CppSQLite3StatusMonitorOptions
+{
+    bool warnOnAutoindex = true;         ///< warn about runs that built an automatic index
+    std::uint64_t sortVmSteps = 100'000; ///< warn about runs that sorted and took at least this many VM steps, 0: off
+};
+
+/**
+ * @brief CppSQLite3BusyPolicy configures how a connection waits for locks held by other connections
+ *
+ * A wait first spins for spinUs, yielding the thread, then sleeps with exponential backoff from initialBackoffUs to
+ * maxBackoffUs. Every sleep is shortened by a random fraction of up to jitter, so connections that collided once
+ * don't retry in lockstep.
+ */
+struct CppSQLite3BusyPolicy
+{
+    int timeoutMs = 60'000;     ///< the statement fails with SQLITE_BUSY after waiting this long
+    int spinUs = 0;             ///< yield instead of sleeping during the first microseconds of a wait
+    int initialBackoffUs = 100; ///< first sleep after the spin phase
+    int maxBackoffUs = 100'000; ///< sleeps double up to this limit
+    double jitter = 0.5;        ///< 0: fixed sleeps, 1: sleeps are random between 0 and the backoff
+};
+
+/**
+ * @brief CppSQLite3BusyStats reports the lock contention of a connection with a CppSQLite3BusyPolicy
+ */
+struct CppSQLite3BusyStats
+{
+    std::size_t busyEvents = 0;   ///< lock conflicts the connection had to wait for
+    std::size_t timeouts = 0;     ///< conflicts that were given up after timeoutMs
+    std::int64_t totalWaitUs = 0; ///< time spent waiting for all conflicts
+    std::int64_t maxWaitUs = 0;   ///< longest wait for a single conflict
+};
+
+/**
+ * @brief CppSQLite3DBStats reports the memory and page cache usage of a connection (sqlite3_db_status) and of the
+ * process (sqlite3_status64)
+ *
+ * The cache counters count from the connection's open or their last reset, pages are looked up once per access.
+ */
+struct CppSQLite3DBStats
+{
+    std::int64_t cacheHits = 0;          ///< SQLITE_DBSTATUS_CACHE_HIT, page lookups served by the page cache
+    std::int64_t cacheMisses = 0;        ///< SQLITE_DBSTATUS_CACHE_MISS, page lookups that had to read the page
+    std::int64_t cacheWrites = 0;        ///< SQLITE_DBSTATUS_CACHE_WRITE, dirty pages written to the database file
+    std::int64_t cacheSpills = 0;        ///< SQLITE_DBSTATUS_CACHE_SPILL, dirty pages written before the commit
+    std::int64_t cacheUsed = 0;          ///< SQLITE_DBSTATUS_CACHE_USED, bytes of heap used by the page cache
+    std::int64_t lookasideUsed = 0;      ///< SQLITE_DBSTATUS_LOOKASIDE_USED, lookaside slots in use
+    std::int64_t lookasideHighwater = 0; ///< highest number of lookaside slots in use at once
+    std::int64_t lookasideHits = 0;      ///< SQLITE_DBSTATUS_LOOKASIDE_HIT, allocations served by lookaside
+    std::int64_t lookasideMissSize = 0;  ///< SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, allocations too large for a slot
+    std::int64_t lookasideMissFull = 0;  ///< SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, allocations with all slots in use
+    std::int64_t schemaUsed = 0;         ///< SQLITE_DBSTATUS_SCHEMA_USED, bytes of heap used by the schemas
+    std::int64_t statementsUsed = 0;     ///< SQLITE_DBSTATUS_STMT_USED, bytes of heap used by prepared statements
+    std::int64_t memoryUsed = 0;         ///< SQLITE_STATUS_MEMORY_USED, bytes allocated by SQLite in the process
+    std::int64_t memoryHighwater = 0;    ///< largest memoryUsed of the process so far
+    std::int64_t largestAllocation = 0;  ///< SQLITE_STATUS_MALLOC_SIZE, largest single allocation of the process
+    std::int64_t allocations = 0;        ///< SQLITE_STATUS_MALLOC_COUNT, allocations currently held by the process
+};
+
+// sqlite3_busy_handler implementing a CppSQLite3BusyPolicy, owned by CppSQLite3DB
+class CppSQLite3BusyHandler;
+
+// LRU cache of prepared statements, owned by CppSQLite3DB and shared with the statements it handed out
+class CppSQLite3StatementCache;
+
+// name to index lookup for the result columns of a prepared statement, shared by all queries running the statement
+class CppSQLite3ColumnMap;
+
+/**
+ * @brief CppSQLite3Column is a field index that was resolved by name once, see CppSQLite3Query::column
+ * It converts to int and can be passed to all CppSQLite3Query accessors taking a field index.
+ */
+class CppSQLite3Column
+{
+public:
+    CppSQLite3Column() = default;
+
+    constexpr int index() const
+    {
+        return mnIndex;
+    }
+
+    constexpr operator int() const
+    {
+        return mnIndex;
+    }
+
+private:
+    friend class CppSQLite3Query;
+    friend class CppSQLite3ResultSet;
+
+    constexpr explicit CppSQLite3Column(int nIndex) : mnIndex(nIndex)
+    {
+    }
+
+    int mnIndex = -1;
+};
+
+class CppSQLite3RowIterator;
+
+/**
+ * @brief CppSQLite3ColumnBatch holds a batch of result rows in columnar form, see CppSQLite3Query::fetchBatch
+ *
+ * Every column is decoded as one storage type: declared INTEGER, REAL, TEXT and BLOB columns use their type,
+ * other columns the type of their value in the first row. Values of other types are converted by sqlite.
+ * The buffers keep their capacity, so filling the same batch again doesn't allocate once it has grown to size.
+ */
+class CppSQLite3ColumnBatch
+{
+public:
+    struct Column
+    {
+        std::string name;
+        int type = SQLITE_NULL;             ///< SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_BLOB
+        std::vector<std::int64_t> integers; ///< values of SQLITE_INTEGER columns, 0 for NULL
+        std::vector<double> floats;         ///< values of SQLITE_FLOAT columns, 0.0 for NULL
+        std::vector<std::int64_t> offsets;  ///< SQLITE_TEXT / SQLITE_BLOB: value i is data[offsets[i], offsets[i + 1])
+        std::vector<char> data;             ///< SQLITE_TEXT / SQLITE_BLOB: concatenated values without terminators
+        std::vector<std::uint8_t> validity; ///< bit i % 8 of byte i / 8 is set if value i is not NULL
+        std::size_t nullCount = 0;
+
+        bool isNull(std::size_t nRow) const;
+        std::string_view text(std::size_t nRow) const;
+        CppSQLite3BlobView blob(std::size_t nRow) const;
+    };
+
+    std::size_t numRows() const
+    {
+        return mnRows;
+    }
+
+    int numColumns() const
+    {
+        return static_cast<int>(mColumns.size());
+    }
+
+    const Column& column(int nCol) const
+    {
+        return mColumns.at(nCol);
+    }
+
+private:
+    friend class CppSQLite3Query;
+
+    void reset(sqlite3_stmt* pVM, std::uint64_t nExecution, int nCols, std::size_t nMaxRows);
+    void appendRow(sqlite3_stmt* pVM);
+
+    std::vector<Column> mColumns;
+    std::size_t mnRows = 0;
+    std::uint64_t mnExecution = 0; // query execution the column types were derived from, 0: none
+};
+
+// Arrow C data interface, see https://arrow.apache.org/docs/format/CDataInterface.html
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C"
+{
+    struct ArrowSchema
+    {
+        const char* format;
+        const char* name;
+        const char* metadata;
+        int64_t flags;
+        int64_t n_children;
+        struct ArrowSchema** children;
+        struct ArrowSchema* dictionary;
+        void (*release)(struct ArrowSchema*);
+        void* private_data;
+    };
+
+    struct ArrowArray
+    {
+        int64_t length;
+        int64_t null_count;
+        int64_t offset;
+        int64_t n_buffers;
+        int64_t n_children;
+        const void** buffers;
+        struct ArrowArray** children;
+        struct ArrowArray* dictionary;
+        void (*release)(struct ArrowArray*);
+        void* private_data;
+    };
+}
+
+#endif // ARROW_C_DATA_INTERFACE
+
+class CppSQLite3ArrowPoolState;
+
+/**
+ * @brief CppSQLite3ArrowBufferPool recycles the batches behind exported Arrow arrays
+ *
+ * An exported array references the buffers of a CppSQLite3ColumnBatch. Once the consumer releases the array the
+ * batch goes back to the pool and is filled by the next export, so a scan allocates only for its first batches.
+ * Copies share the same pool. Arrays may be released on any thread and may outlive the pool.
+ */
+class CppSQLite3ArrowBufferPool
+{
+public:
+    explicit CppSQLite3ArrowBufferPool(std::size_t nMaxIdleBatches = 4);
+
+    /**
+     * @brief idleBatches returns the number of released batches waiting to be reused
+     */
+    std::size_t idleBatches() const;
+
+private:
+    friend class CppSQLite3Query;
+
+    std::shared_ptr<CppSQLite3ArrowPoolState> mpState;
 };
 
+class CppSQLite3ResultSet;
+
 class CppSQLite3Query
 {
 public:
@@ -115,7 +711,9 @@ public:
 
     CppSQLite3Query(CppSQLite3Query&& rQuery);
 
-    CppSQLite3Query(const CppSQLite3Config& config, sqlite3_stmt* pVM, bool bEof, bool bOwnVM = true);
+    CppSQLite3Query(const CppSQLite3Config& config, sqlite3_stmt* pVM, bool bEof, bool bOwnVM = true,
+                    std::shared_ptr<CppSQLite3StatementCache> pCache = nullptr,
+                    std::shared_ptr<CppSQLite3ColumnMap> pColumns = nullptr);
 
     CppSQLite3Query& operator=(CppSQLite3Query&& rQuery);
 
@@ -123,7 +721,18 @@ public:
 
     int numFields() const;
 
+    /**
+     * @brief fieldIndex looks up a field by name in a map that is built once per prepared statement
+     * @throws std::invalid_argument if there is no such field
+     */
     int fieldIndex(CppSQLite3StringView field) const;
+
+    /**
+     * @brief column resolves a field name once, the result can be used instead of the name for all rows
+     * @throws std::invalid_argument if there is no such field
+     */
+    CppSQLite3Column column(CppSQLite3StringView field) const;
+
     const char* fieldName(int nCol) const;
 
     const char* fieldDeclType(int nCol) const;
@@ -147,23 +756,501 @@ public:
     const unsigned char* getBlobField(int nField, int& nLen) const;
     const unsigned char* getBlobField(CppSQLite3StringView field, int& nLen) const;
 
+    /**
+     * @brief getStringView returns the text of a field sized with sqlite3_column_bytes, embedded NULs included
+     *
+     * The view points into memory owned by the statement and is valid until the next call to nextRow (or until the
+     * query is finalized). NULL reads as an empty view.
+     */
+    std::string_view getStringView(int nField) const;
+    std::string_view getStringView(CppSQLite3StringView field) const;
+
+    /**
+     * @brief getBlobView returns the binary data of a field, valid until the next call to nextRow like getStringView
+     */
+    CppSQLite3BlobView getBlobView(int nField) const;
+    CppSQLite3BlobView getBlobView(CppSQLite3StringView field) const;
+
     bool fieldIsNull(int nField) const;
     bool fieldIsNull(CppSQLite3StringView field) const;
 
-    bool eof() const;
+    /**
+     * @brief get reads a field of the current row as T, see CppSQLite3ValueTraits for the supported types
+     *
+     * Unlike the get*Field methods there is a single validity check and no type query per call (except for
+     * std::optional<T>, which checks for NULL). Views like std::string_view and CppSQLite3BlobView are valid until
+     * the next call to nextRow.
+     */
+    template <typename T>
+    T get(int nField) const
+    {
+        checkField(nField);
+        return CppSQLite3ValueTraits<T>::column(mpVM, nField);
+    }
+
+    template <typename T>
+    T get(CppSQLite3StringView field) const
+    {
+        int nField = fieldIndex(field);
+        return CppSQLite3ValueTraits<T>::column(mpVM, nField);
+    }
+
+    /**
+     * @brief getRow fills all fields of row from the current row, column i goes to field i of CppSQLite3RowTraits<T>
+     *
+     * The column count and declared column types are checked once per prepared statement, afterwards every call
+     * reads the values directly by index. std::string members reuse their buffers.
+     * @throws std::invalid_argument if the row type doesn't match the query's columns
+     */
+    template <typename T>
+    void getRow(T& row) const
+    {
+        constexpr std::size_t nFields = CppSQLite3Detail::rowFieldCount<T>();
+        constexpr auto numericFields = CppSQLite3Detail::numericRowFields<T>(std::make_index_sequence<nFields>());
+        checkRowLayout(typeid(T), numericFields.data(), static_cast<int>(nFields));
+        readRow(row, std::make_index_sequence<nFields>());
+    }
+
+    template <typename T>
+    T getRow() const
+    {
+        T row{};
+        getRow(row);
+        return row;
+    }
+
+    bool eof() const;
 
     void nextRow();
 
     void finalize();
 
+    /**
+     * @brief status reads the sqlite3_stmt_status counters of the query's statement
+     * @param bReset resets the counters afterwards (except memoryUsed)
+     */
+    CppSQLite3StatementStatus status(bool bReset = false) const;
+
+    /**
+     * @brief begin and end make the remaining rows of the query an input range of CppSQLite3Row views:
+     *
+     *     for (const auto& row : query)
+     *     {
+     *         auto [id, name] = row.as<int, std::string_view>();
+     *     }
+     *
+     * Iterating advances the query itself, so the rows can only be traversed once.
+     */
+    CppSQLite3RowIterator begin();
+    CppSQLite3RowIterator end();
+
+    /**
+     * @brief fetchBatch decodes the current and following rows into batch, up to nMaxRows
+     *
+     * Afterwards the query is positioned on the first row that wasn't decoded (or at eof), so
+     * `while (!query.eof()) query.fetchBatch(batch, n);` scans the whole result.
+     * @return the number of rows in the batch
+     */
+    std::size_t fetchBatch(CppSQLite3ColumnBatch& batch, std::size_t nMaxRows);
+
+    /**
+     * @brief exportArrowBatch fetches up to nMaxRows rows like fetchBatch and exports them through the Arrow C data
+     * interface
+     *
+     * pArray receives a struct array ("+s") with one nullable child per column: int64 ("l"), float64 ("g"),
+     * large utf8 ("U") or large binary ("Z"). The buffers are handed over without copying and belong to pool until
+     * the consumer calls pArray->release. pSchema (optional) receives the matching schema.
+     * @return the number of rows exported
+     */
+    std::size_t exportArrowBatch(ArrowSchema* pSchema, ArrowArray* pArray, std::size_t nMaxRows,
+                                 CppSQLite3ArrowBufferPool& pool);
+    std::size_t exportArrowBatch(ArrowSchema* pSchema, ArrowArray* pArray, std::size_t nMaxRows);
+
+    /**
+     * @brief materialize copies the current and all remaining rows into a CppSQLite3ResultSet and releases the
+     * statement right away
+     *
+     * The statement is finalized (or returned to the statement cache, or reset if it belongs to a
+     * CppSQLite3Statement), which ends its read transaction, so a slow consumer doesn't hold a WAL snapshot and
+     * block checkpoints. The query is finalized afterwards.
+     */
+    CppSQLite3ResultSet materialize();
+
 private:
+    friend class CppSQLite3Row;
+    friend class CppSQLite3RowIterator;
+
     void checkVM() const;
+    int releaseVM();
+    // returns false if stepping failed and the error handler didn't throw
+    bool stepRow();
+
+    void checkRowLayout(const std::type_info& rowType, const bool* pbNumericFields, int nFields) const;
+
+    template <typename T, std::size_t... I>
+    void readRow(T& row, std::index_sequence<I...>) const
+    {
+        (readField(row.*std::get<I>(CppSQLite3RowTraits<T>::fields), static_cast<int>(I)), ...);
+    }
+
+    template <typename Member>
+    void readField(Member& member, int nField) const
+    {
+        if constexpr (std::is_same_v<Member, std::string>)
+        {
+            member.assign(CppSQLite3ValueTraits<std::string_view>::column(mpVM, nField));
+        }
+        else
+        {
+            member = CppSQLite3ValueTraits<Member>::column(mpVM, nField);
+        }
+    }
+
+    void checkField(int nField) const
+    {
+        checkVM();
+        if (nField < 0 || nField > mnCols - 1)
+        {
+            throw std::invalid_argument("Invalid field index requested");
+        }
+    }
 
     CppSQLite3Config mConfig;
     sqlite3_stmt* mpVM;
     bool mbEof;
     int mnCols;
     bool mbOwnVM;
+    std::uint64_t mnExecution; // unique per execution, even if the statement is reused
+    std::shared_ptr<CppSQLite3StatementCache> mpCache; // set if mpVM is returned to the cache instead of finalized
+    mutable std::shared_ptr<CppSQLite3ColumnMap> mpColumns; // created on the first lookup by name
+};
+
+/**
+ * @brief CppSQLite3Row is a view of the current row of a CppSQLite3Query while iterating it
+ *
+ * The query is checked once when it advances to the row, field accesses only check the field index.
+ * Like the values it returns, a row view is only valid until the query moves on.
+ */
+class CppSQLite3Row
+{
+public:
+    CppSQLite3Row() = default;
+
+    explicit CppSQLite3Row(const CppSQLite3Query& query) : mpQuery(&query)
+    {
+    }
+
+    int numFields() const
+    {
+        return mpQuery->mnCols;
+    }
+
+    template <typename T>
+    T get(int nField) const
+    {
+        checkField(nField);
+        return CppSQLite3ValueTraits<T>::column(mpQuery->mpVM, nField);
+    }
+
+    template <typename T>
+    T get(CppSQLite3StringView field) const
+    {
+        return mpQuery->get<T>(field);
+    }
+
+    bool fieldIsNull(int nField) const
+    {
+        checkField(nField);
+        return sqlite3_column_type(mpQuery->mpVM, nField) == SQLITE_NULL;
+    }
+
+    /**
+     * @brief as reads the first sizeof...(T) fields as a tuple, e.g. for structured bindings
+     */
+    template <typename... T>
+    std::tuple<T...> as() const
+    {
+        checkField(static_cast<int>(sizeof...(T)) - 1);
+        return readFields<T...>(std::index_sequence_for<T...>());
+    }
+
+    template <typename T>
+    void getRow(T& row) const
+    {
+        mpQuery->getRow(row);
+    }
+
+    template <typename T>
+    T getRow() const
+    {
+        return mpQuery->getRow<T>();
+    }
+
+private:
+    void checkField(int nField) const
+    {
+        if (nField < 0 || nField > mpQuery->mnCols - 1)
+        {
+            throw std::invalid_argument("Invalid field index requested");
+        }
+    }
+
+    template <typename... T, std::size_t... I>
+    std::tuple<T...> readFields(std::index_sequence<I...>) const
+    {
+        return std::tuple<T...>(CppSQLite3ValueTraits<T>::column(mpQuery->mpVM, static_cast<int>(I))...);
+    }
+
+    const CppSQLite3Query* mpQuery = nullptr;
+};
+
+/**
+ * @brief CppSQLite3RowIterator is the input iterator returned by CppSQLite3Query::begin
+ */
+class CppSQLite3RowIterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = CppSQLite3Row;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const CppSQLite3Row*;
+    using reference = const CppSQLite3Row&;
+
+    // end iterator
+    CppSQLite3RowIterator() = default;
+
+    explicit CppSQLite3RowIterator(CppSQLite3Query& query) : mpQuery(&query), mRow(query)
+    {
+    }
+
+    reference operator*() const
+    {
+        return mRow;
+    }
+
+    pointer operator->() const
+    {
+        return &mRow;
+    }
+
+    CppSQLite3RowIterator& operator++();
+
+    CppSQLite3RowIterator operator++(int)
+    {
+        CppSQLite3RowIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const CppSQLite3RowIterator& rhs) const
+    {
+        return mpQuery == rhs.mpQuery;
+    }
+
+    bool operator!=(const CppSQLite3RowIterator& rhs) const
+    {
+        return mpQuery != rhs.mpQuery;
+    }
+
+private:
+    CppSQLite3Query* mpQuery = nullptr;
+    CppSQLite3Row mRow;
+};
+
+/**
+ * @brief CppSQLite3ResultSet holds result rows detached from their statement, see CppSQLite3Query::materialize
+ *
+ * It has the accessors of CppSQLite3Query. The cells are kept in one array in row order, text and blob values in a
+ * single arena referenced by offset. Strings, blobs and views stay valid as long as the result set, the text of
+ * numeric cells is converted on first access and kept as well.
+ * Besides iterating with nextRow, rows can be accessed in any order with setRow.
+ */
+class CppSQLite3ResultSet
+{
+public:
+    CppSQLite3ResultSet() = default;
+
+    int numFields() const;
+    int numRows() const;
+
+    /**
+     * @throws std::invalid_argument if there is no such field
+     */
+    int fieldIndex(CppSQLite3StringView field) const;
+    CppSQLite3Column column(CppSQLite3StringView field) const;
+
+    const char* fieldName(int nCol) const;
+
+    const char* fieldDeclType(int nCol) const;
+    int fieldDataType(int nCol) const;
+
+    const char* fieldValue(int nField) const;
+    const char* fieldValue(CppSQLite3StringView field) const;
+
+    int getIntField(int nField, int nNullValue = 0) const;
+    int getIntField(CppSQLite3StringView field, int nNullValue = 0) const;
+
+    long long getInt64Field(int nField, long long nNullValue = 0) const;
+    long long getInt64Field(CppSQLite3StringView field, long long nNullValue = 0) const;
+
+    double getFloatField(int nField, double fNullValue = 0.0) const;
+    double getFloatField(CppSQLite3StringView field, double fNullValue = 0.0) const;
+
+    const char* getStringField(int nField, const char* szNullValue = "") const;
+    const char* getStringField(CppSQLite3StringView field, const char* szNullValue = "") const;
+
+    const unsigned char* getBlobField(int nField, int& nLen) const;
+    const unsigned char* getBlobField(CppSQLite3StringView field, int& nLen) const;
+
+    std::string_view getStringView(int nField) const;
+    std::string_view getStringView(CppSQLite3StringView field) const;
+
+    CppSQLite3BlobView getBlobView(int nField) const;
+    CppSQLite3BlobView getBlobView(CppSQLite3StringView field) const;
+
+    bool fieldIsNull(int nField) const;
+    bool fieldIsNull(CppSQLite3StringView field) const;
+
+    /**
+     * @brief get reads a field of the current row as an arithmetic type, std::string, std::string_view,
+     * const char*, CppSQLite3BlobView or std::optional of these
+     *
+     * The values no longer come from a statement, so user specializations of CppSQLite3ValueTraits aren't supported.
+     */
+    template <typename T>
+    T get(int nField) const
+    {
+        if constexpr (CppSQLite3Detail::isOptional<T>)
+        {
+            return fieldIsNull(nField) ? T() : T(get<typename T::value_type>(nField));
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            return getInt64Field(nField) != 0;
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            return static_cast<T>(getInt64Field(nField));
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            return static_cast<T>(getFloatField(nField));
+        }
+        else if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            return getStringView(nField);
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+        {
+            return std::string(getStringView(nField));
+        }
+        else if constexpr (std::is_same_v<T, const char*>)
+        {
+            return fieldIsNull(nField) ? nullptr : getStringField(nField);
+        }
+        else if constexpr (std::is_same_v<T, CppSQLite3BlobView>)
+        {
+            return getBlobView(nField);
+        }
+        else
+        {
+            static_assert(CppSQLite3Detail::alwaysFalse<T>, "unsupported type for CppSQLite3ResultSet::get");
+        }
+    }
+
+    template <typename T>
+    T get(CppSQLite3StringView field) const
+    {
+        return get<T>(fieldIndex(field));
+    }
+
+    /**
+     * @brief getRow fills all fields of row from the current row like CppSQLite3Query::getRow
+     * @throws std::invalid_argument if the number of fields doesn't match the number of columns
+     */
+    template <typename T>
+    void getRow(T& row) const
+    {
+        constexpr std::size_t nFields = CppSQLite3Detail::rowFieldCount<T>();
+        checkRowLayout(static_cast<int>(nFields));
+        readRow(row, std::make_index_sequence<nFields>());
+    }
+
+    template <typename T>
+    T getRow() const
+    {
+        T row{};
+        getRow(row);
+        return row;
+    }
+
+    bool eof() const;
+
+    void nextRow();
+
+    /**
+     * @brief setRow moves to row nRow, 0 is the first row
+     * @throws std::invalid_argument if there is no such row
+     */
+    void setRow(int nRow);
+
+private:
+    friend class CppSQLite3Query;
+
+    struct Cell
+    {
+        int type;   // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+        int nBytes; // size of text and blob values
+        union
+        {
+            long long nValue;
+            double fValue;
+            std::size_t nOffset; // position of text and blob values in the arena
+        };
+    };
+
+    void appendRow(sqlite3_stmt* pVM);
+    const Cell& cell(int nField) const;
+    const std::string& numericText(const Cell& value) const;
+    void checkRowLayout(int nFields) const;
+
+    template <typename T, std::size_t... I>
+    void readRow(T& row, std::index_sequence<I...>) const
+    {
+        (readField(row.*std::get<I>(CppSQLite3RowTraits<T>::fields), static_cast<int>(I)), ...);
+    }
+
+    template <typename Member>
+    void readField(Member& member, int nField) const
+    {
+        if constexpr (std::is_same_v<Member, std::string>)
+        {
+            member.assign(getStringView(nField));
+        }
+        else
+        {
+            member = get<Member>(nField);
+        }
+    }
+
+    int mnCols = 0;
+    int mnRows = 0;
+    int mnRow = 0;
+    std::vector<std::string> mNames;
+    std::shared_ptr<const CppSQLite3ColumnMap> mpColumns; // index of mNames, shared by copies
+    std::vector<std::optional<std::string>> mDeclTypes;
+    std::vector<Cell> mCells;
+    std::vector<char> mArena;
+    mutable std::unordered_map<std::size_t, std::string> mNumericTexts; // text of numeric cells by cell index
+};
+
+/**
+ * @brief CppSQLite3BindMode selects whether sqlite copies bound text and blob values
+ */
+enum class CppSQLite3BindMode
+{
+    copy,  ///< SQLITE_TRANSIENT: sqlite copies the value, the buffer may be released right after binding
+    noCopy ///< SQLITE_STATIC: sqlite reads the caller's buffer, which has to stay valid until the statement is reset
 };
 
 class CppSQLite3Statement
@@ -173,7 +1260,9 @@ public:
 
     CppSQLite3Statement(CppSQLite3Statement&& rStatement);
 
-    CppSQLite3Statement(const CppSQLite3Config& config, sqlite3_stmt* pVM);
+    CppSQLite3Statement(const CppSQLite3Config& config, sqlite3_stmt* pVM,
+                        std::shared_ptr<CppSQLite3StatementCache> pCache = nullptr,
+                        std::shared_ptr<CppSQLite3ColumnMap> pColumns = nullptr);
 
     virtual ~CppSQLite3Statement();
 
@@ -190,65 +1279,375 @@ public:
     void bind(int nParam, const unsigned char* blobValue, int nLen);
     void bindNull(int nParam);
 
+    /**
+     * @brief bindText binds text of explicit length, so it needs neither null termination nor a strlen
+     *
+     * With CppSQLite3BindMode::noCopy the buffer has to stay valid and unchanged until the statement is reset
+     * (reset, execDML, execute, query) or the parameter is bound again. The wrapper rebinds such parameters
+     * to NULL on every reset, so a released buffer is never read.
+     */
+    void bindText(int nParam, std::string_view value, CppSQLite3BindMode mode = CppSQLite3BindMode::copy);
+
+    /**
+     * @brief bindBlob binds binary data, see bindText for the buffer lifetime with CppSQLite3BindMode::noCopy
+     */
+    void bindBlob(int nParam, CppSQLite3BlobView value, CppSQLite3BindMode mode = CppSQLite3BindMode::copy);
+
+    /**
+     * @brief execute binds all parameters in one go, runs the DML statement and resets it
+     *
+     * The arguments are bound through CppSQLite3ValueTraits in order, the number of arguments has to match
+     * sqlite3_bind_parameter_count.
+     * @return the number of rows changed
+     */
+    template <typename... Args>
+    int execute(const Args&... args)
+    {
+        bindAll(args...);
+        return execDML();
+    }
+
+    /**
+     * @brief bindRow binds all fields of row, field i to parameter i + 1, see CppSQLite3RowTraits
+     */
+    template <typename T>
+    void bindRow(const T& row)
+    {
+        std::apply([this, &row](auto... members) { bindAll(row.*members...); }, CppSQLite3RowTraits<T>::fields);
+    }
+
+    /**
+     * @brief query binds all parameters in one go, see execute, and runs the query
+     */
+    template <typename... Args>
+    CppSQLite3Query query(const Args&... args)
+    {
+        bindAll(args...);
+        return execQuery();
+    }
+
     void reset();
 
     void finalize();
 
+    /**
+     * @brief status reads the sqlite3_stmt_status counters of the statement
+     * @param bReset resets the counters afterwards (except memoryUsed)
+     */
+    CppSQLite3StatementStatus status(bool bReset = false) const;
+
 private:
     void checkDB() const;
     void checkVM() const;
     void checkReturnCode(int returnCode, const char* context);
+    void checkParameterCount(int nParams);
+    void trackBinding(int nParam, CppSQLite3BindMode mode);
+    void releaseStaticBindings();
+
+    template <typename... Args>
+    void bindAll(const Args&... args)
+    {
+        checkParameterCount(static_cast<int>(sizeof...(Args)));
+        // a query of the previous execution might still be stepping through the statement
+        sqlite3_reset(mpVM);
+        releaseStaticBindings();
+        int nParam = 0;
+        int nRes = SQLITE_OK;
+        // stops at the first failing bind
+        (void)(((nRes = CppSQLite3ValueTraits<std::decay_t<const Args>>::bind(mpVM, ++nParam, args)) == SQLITE_OK) &&
+               ...);
+        checkReturnCode(nRes, "when binding params");
+    }
 
     CppSQLite3Config mConfig;
     sqlite3_stmt* mpVM;
+    std::shared_ptr<CppSQLite3StatementCache> mpCache; // set if mpVM is returned to the cache instead of finalized
+    std::shared_ptr<CppSQLite3ColumnMap> mpColumns;    // handed to every query of this statement
+    std::vector<int> mStaticParams;                    // parameters bound with CppSQLite3BindMode::noCopy
 };
 
 
-class CppSQLite3DB
+/**
+ * @brief CppSQLite3TransactionMode selects how BEGIN acquires locks, see https://sqlite.org/lang_transaction.html
+ */
+enum class CppSQLite3TransactionMode
 {
-public:
-    CppSQLite3DB();
+    deferred,  ///< locks are acquired by the first read / write
+    immediate, ///< takes the write lock right away, so a writer can't run into SQLITE_BUSY halfway through
+    exclusive  ///< like immediate, in rollback journal mode readers are locked out as well
+};
 
-    CppSQLite3DB(const CppSQLite3DB& db) = delete;
-    CppSQLite3DB& operator=(const CppSQLite3DB& db) = delete;
+/**
+ * @brief CppSQLite3StatementProfile is the latency histogram of one normalized SQL text, see CppSQLite3Profiler
+ *
+ * Bucket i counts the runs that took less than bucketUpperBoundNs(i), the last bucket also counts all longer runs.
+ */
+struct CppSQLite3StatementProfile
+{
+    static constexpr std::size_t nBuckets = 32;
 
-    virtual ~CppSQLite3DB();
+    std::string sql;                               ///< SQL text with literals replaced by ?
+    std::uint64_t executions = 0;                  ///< completed runs
+    std::uint64_t rows = 0;                        ///< result rows stepped by all runs
+    std::uint64_t totalNs = 0;                     ///< summed latency of all runs
+    std::uint64_t maxNs = 0;                       ///< slowest run
+    std::array<std::uint64_t, nBuckets> buckets{}; ///< runs per latency bucket
 
     /**
-     * @brief open opens a database with the given filename
-     * @param szFile the filename of the database
-     * @param flags the SQLITE_OPEN_* flags that are passed on to the sqlite3_open_v2 call
+     * @brief bucketUpperBoundNs doubles from 1024 ns (bucket 0) to about 37 minutes (bucket 31)
      */
-    void open(CppSQLite3StringView fileName, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
-
-    void close();
+    static std::uint64_t bucketUpperBoundNs(std::size_t nBucket)
+    {
+        return std::uint64_t{1024} << nBucket;
+    }
 
     /**
-     * @brief enableVerboseLogging enables logging of all SQL statements & queries
+     * @brief percentileNs estimates a percentile (fraction 0..1) as the upper bound of the bucket it falls into
      */
-    void enableVerboseLogging(bool enable);
+    std::uint64_t percentileNs(double fraction) const;
+};
 
-    bool isOpened() const;
+// locked shards of statement profiles, threads are assigned to them round robin
+class CppSQLite3ProfilerShards;
 
-    bool tableExists(CppSQLite3StringView table);
+/**
+ * @brief CppSQLite3Profiler collects latency histograms of the statements run by one or more connections
+ *
+ *     auto pProfiler = std::make_shared<CppSQLite3Profiler>();
+ *     db.setProfiler(pProfiler);
+ *     ...
+ *     for (const auto& profile : pProfiler->snapshot(true)) { export profile.sql, profile.executions, ... }
+ *
+ * Runs are grouped by their SQL text with whitespace collapsed and literals replaced by ?, so statements binding
+ * parameters and statements with inlined values end up in the same histogram. Threads are assigned round robin to
+ * 16 shards, each guarded by its own mutex, so connections of a pool running on different threads share a profiler
+ * and rarely wait for each other; snapshot merges the shards.
+ */
+class CppSQLite3Profiler
+{
+public:
+    /**
+     * @param nMaxStatements distinct SQL texts kept per shard, further ones are counted as "(other statements)"
+     */
+    explicit CppSQLite3Profiler(std::size_t nMaxStatements = 1000);
 
-    int execDML(CppSQLite3StringView szSQL);
+    CppSQLite3Profiler(const CppSQLite3Profiler&) = delete;
+    CppSQLite3Profiler& operator=(const CppSQLite3Profiler&) = delete;
 
-    CppSQLite3Query execQuery(CppSQLite3StringView szSQL);
+    virtual ~CppSQLite3Profiler();
 
-    int execScalar(CppSQLite3StringView szSQL);
+    /**
+     * @brief record adds a run of sql, it is called by the trace callback of the connections using the profiler
+     */
+    void record(std::string_view sql, std::uint64_t nNanoseconds, std::uint64_t nRows);
 
-    CppSQLite3Statement compileStatement(CppSQLite3StringView szSQL);
+    /**
+     * @brief snapshot returns the profiles of all statements, ordered by total latency, and optionally resets them
+     */
+    std::vector<CppSQLite3StatementProfile> snapshot(bool bReset = false);
 
-    sqlite_int64 lastRowId() const;
+    void reset();
+
+private:
+    std::size_t mnMaxStatements;
+    std::unique_ptr<CppSQLite3ProfilerShards> mpShards;
+};
+
+/**
+ * @brief CppSQLite3OpenOptions are the open flags and PRAGMAs CppSQLite3DB::open applies to a new connection
+ *
+ * Unset PRAGMAs keep SQLite's defaults. The presets cover typical workloads and can be adjusted before opening:
+ *
+ *     auto options = CppSQLite3OpenOptions::oltpWAL();
+ *     options.cacheSize = -256 * 1024;
+ *     db.open("app.sqlite", options);
+ */
+struct CppSQLite3OpenOptions
+{
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE; ///< SQLITE_OPEN_* flags for sqlite3_open_v2
+    bool immutable = false;                                 ///< open with the URI parameter immutable=1
+    std::optional<int> pageSize;                            ///< bytes, only applies to a database without content
+    std::optional<std::string> journalMode;                 ///< delete, truncate, persist, memory, wal or off
+    std::optional<std::string> synchronous;                 ///< off, normal, full or extra
+    std::optional<int> cacheSize;                           ///< pages, negative values are KiB
+    std::optional<std::int64_t> mmapSize;                   ///< bytes of the database file that are memory mapped
+    std::optional<std::string> tempStore;                   ///< default, file or memory
+    std::optional<int> walAutocheckpoint;                   ///< WAL pages that trigger a checkpoint, 0: off
+    std::optional<bool> foreignKeys;                        ///< enforce foreign key constraints
+
+    /**
+     * @brief oltpWAL suits many small transactions with concurrent readers: WAL, synchronous=normal (durable up to the
+     * last checkpoint on power loss), 64 MiB cache, 256 MiB mmap, temporary tables in memory and foreign keys on
+     */
+    static CppSQLite3OpenOptions oltpWAL();
+
+    /**
+     * @brief bulkLoad suits imports into a new database: journal in memory, synchronous=off and 256 MiB cache
+     *
+     * A crash or power loss during the load can corrupt the database, so load into a file that is discarded then.
+     */
+    static CppSQLite3OpenOptions bulkLoad();
+
+    /**
+     * @brief readOnlyAnalytics suits large scans of an existing database: read-only, 256 MiB cache, 1 GiB mmap and
+     * temporary b-trees for sorting and grouping in memory
+     */
+    static CppSQLite3OpenOptions readOnlyAnalytics();
+
+    /**
+     * @brief inMemory suits ":memory:" and other ephemeral databases: journal in memory, synchronous=off,
+     * temporary tables in memory and foreign keys on
+     */
+    static CppSQLite3OpenOptions inMemory();
+
+    /**
+     * @brief immutableReadOnly suits reference databases that never change while they are open: the file is opened
+     * read-only with the URI parameter immutable=1, which turns off locking, change detection and the journal, and up
+     * to 2 GiB of it are memory mapped, so pages are read from the kernel's page cache without a copy
+     *
+     * SQLite doesn't notice if another process changes the file anyway, which can return wrong results or report
+     * corruption. The database must not be in WAL mode (or its WAL must be checkpointed and empty).
+     */
+    static CppSQLite3OpenOptions immutableReadOnly();
+};
+
+class CppSQLite3Transaction;
+class CppSQLite3Savepoint;
+class CppSQLite3DeadlineScope;
+
+// cached BEGIN / COMMIT / ROLLBACK / SAVEPOINT statements of a connection
+class CppSQLite3TransactionStatements;
+
+class CppSQLite3DB
+{
+public:
+    CppSQLite3DB();
+
+    CppSQLite3DB(const CppSQLite3DB& db) = delete;
+    CppSQLite3DB& operator=(const CppSQLite3DB& db) = delete;
+
+    virtual ~CppSQLite3DB();
+
+    /**
+     * @brief open opens a database with the given filename
+     * @param szFile the filename of the database
+     * @param flags the SQLITE_OPEN_* flags that are passed on to the sqlite3_open_v2 call
+     */
+    void open(CppSQLite3StringView fileName, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    /**
+     * @brief open opens a database and applies the PRAGMAs of options, page_size first and journal_mode next
+     *
+     * The settings are read back afterwards, a PRAGMA that didn't take effect (e.g. page_size of a database with
+     * content, journal_mode of a read-only or in-memory database) is logged as warning.
+     */
+    void open(CppSQLite3StringView fileName, const CppSQLite3OpenOptions& options);
+
+    /**
+     * @brief readSettings reads the PRAGMAs of CppSQLite3OpenOptions back from the connection
+     *
+     * flags is SQLITE_OPEN_READONLY for a read-only main database and SQLITE_OPEN_READWRITE otherwise, journalMode,
+     * synchronous and tempStore are reported by name in lower case.
+     */
+    CppSQLite3OpenOptions readSettings();
+
+    void close();
+
+    /**
+     * @brief enableVerboseLogging enables logging of all SQL statements & queries
+     */
+    void enableVerboseLogging(bool enable);
+
+    /**
+     * @brief enablePreparedExecDML makes execDML compile its SQL with sqlite3_prepare_v3 instead of running sqlite3_exec
+     *
+     * Scripts with multiple statements are compiled and executed one statement after another. With the statement
+     * cache enabled (see setStatementCacheSize) the compiled statements are kept and reused by the next execDML call
+     * with the same SQL text.
+     */
+    void enablePreparedExecDML(bool enable);
+
+    bool isOpened() const;
+
+    /**
+     * @brief isInTransaction tells whether a transaction is open, i.e. the connection is not in autocommit mode
+     */
+    bool isInTransaction() const;
+
+    bool tableExists(CppSQLite3StringView table);
+
+    int execDML(CppSQLite3StringView szSQL);
+
+    CppSQLite3Query execQuery(CppSQLite3StringView szSQL);
+
+    int execScalar(CppSQLite3StringView szSQL);
+
+    CppSQLite3Statement compileStatement(CppSQLite3StringView szSQL);
+
+    sqlite_int64 lastRowId() const;
 
     void interrupt()
     {
         sqlite3_interrupt(mConfig.db);
     }
 
+    /**
+     * @brief withDeadline aborts statements of this connection that are still running after timeout
+     *
+     *     auto deadline = db.withDeadline(std::chrono::milliseconds(200));
+     *     auto query = db.execQuery(...);
+     *
+     * Until the returned scope ends, a progress handler checks the deadline and the optional token while statements
+     * run. An aborted statement fails through the error handler with CPPSQLITE_DEADLINE_EXCEEDED or
+     * CPPSQLITE_CANCELLED instead of SQLITE_INTERRUPT. Like an interrupt, aborting a write in an explicit transaction
+     * rolls back the whole transaction. Scopes nest, every deadline and token of the open scopes applies.
+     */
+    CppSQLite3DeadlineScope withDeadline(std::chrono::milliseconds timeout);
+    CppSQLite3DeadlineScope withDeadline(std::chrono::milliseconds timeout, const CppSQLite3CancellationToken& token);
+    CppSQLite3DeadlineScope withDeadline(std::chrono::steady_clock::time_point deadline,
+                                         const CppSQLite3CancellationToken& token);
+
+    /**
+     * @brief withCancellation aborts statements of this connection once token is cancelled, see withDeadline
+     */
+    CppSQLite3DeadlineScope withCancellation(const CppSQLite3CancellationToken& token);
+
+    /**
+     * @brief setDeadlineCheckInterval sets how many virtual machine instructions run between two checks, 1000 by
+     * default. Smaller values abort sooner but slow down statements.
+     */
+    void setDeadlineCheckInterval(int nInstructions);
+
+    /**
+     * @brief setBusyTimeout installs SQLite's built-in busy handler, replacing a busy policy
+     */
     void setBusyTimeout(int nMillisecs);
 
+    /**
+     * @brief setBusyPolicy installs a busy handler with backoff, jitter and contention counters
+     *
+     * The policy replaces the busy timeout and stays in effect when the connection is reopened. Setting a policy
+     * starts new counters.
+     */
+    void setBusyPolicy(const CppSQLite3BusyPolicy& policy);
+
+    /**
+     * @brief busyStats returns the counters of the busy policy, all zero without one
+     *
+     * It may be called by other threads, e.g. for monitoring, while the connection is in use.
+     */
+    CppSQLite3BusyStats busyStats() const;
+
+    /**
+     * @brief stats reads the memory and page cache counters of the connection and the process
+     *
+     * Useful for sizing cache_size and mmap_size: a high share of cache misses asks for a larger cache, statementsUsed
+     * growing with the statement cache for a smaller one.
+     * @param bReset resets the cache and lookaside counters of the connection and the high-water marks, the process
+     * wide ones for all connections
+     */
+    CppSQLite3DBStats stats(bool bReset = false);
+
     void setErrorHandler(CppSQLite3ErrorHandler h);
 
     void setLogHandler(CppSQLite3LogHandler h);
@@ -262,15 +1661,745 @@ public:
      * @brief performCheckpoint wraps sqlite3_wal_checkpoint_v2
      * @param dbName name of the attached database (or empty)
      * @param mode SQLITE_CHECKPOINT_* value
+     * @param pnLogFrames if not null, receives the number of frames in the WAL
+     * @param pnCheckpointedFrames if not null, receives the number of WAL frames that are checkpointed
+     * @return the result code, e.g. SQLITE_BUSY, if the error handler didn't throw
      */
-    void performCheckpoint(CppSQLite3StringView dbName = "", int mode = SQLITE_CHECKPOINT_PASSIVE);
+    int performCheckpoint(CppSQLite3StringView dbName = "", int mode = SQLITE_CHECKPOINT_PASSIVE,
+                          int* pnLogFrames = nullptr, int* pnCheckpointedFrames = nullptr);
+
+    /**
+     * @brief setStatementCacheSize enables an LRU cache of prepared statements for execQuery and compileStatement
+     *
+     * Statements are looked up by their exact SQL text. A cached statement is handed out in reset state with all
+     * parameters cleared and goes back to the cache when the CppSQLite3Query or CppSQLite3Statement using it is
+     * finalized. Only single-statement SQL texts are cached.
+     * @param nStatements maximum number of idle statements kept per connection, 0 disables the cache (default)
+     */
+    void setStatementCacheSize(std::size_t nStatements);
+
+    CppSQLite3StatementCacheStats statementCacheStats() const;
+
+    /**
+     * @brief setProfiler records the latency and rows of every statement run by this connection into pProfiler
+     *
+     * The profiler can be shared by several connections and stays in effect when the connection is reopened,
+     * nullptr stops profiling.
+     */
+    void setProfiler(std::shared_ptr<CppSQLite3Profiler> pProfiler);
+
+    /**
+     * @brief setSlowQueryThreshold logs statements running longer than threshold through the log handler
+     *
+     * A slow statement is logged as warning with its expanded SQL, duration, rows stepped and the output of EXPLAIN
+     * QUERY PLAN, which is explained once per distinct SQL text. Statements are timed from their first step to their
+     * reset, so queries are logged when they are finalized, statements when they are executed or reset. Zero turns
+     * the log off (default).
+     */
+    void setSlowQueryThreshold(std::chrono::microseconds threshold);
+
+    /**
+     * @brief enableStatementStatusMonitor sums up the sqlite3_stmt_status counters of every statement run by this
+     * connection and warns about statements that need an index
+     *
+     * Runs that built an automatic index or sorted in a large statement (see CppSQLite3StatusMonitorOptions) are
+     * logged as warning with the output of EXPLAIN QUERY PLAN, once per distinct SQL text. Like slow queries, they are
+     * logged when the statement is reset or finalized. The monitor only reads the counters, so status() of the
+     * statements themselves is unaffected.
+     */
+    void enableStatementStatusMonitor(bool bEnable, const CppSQLite3StatusMonitorOptions& options = {});
+
+    /**
+     * @brief statementStatus returns the counters summed up by the statement status monitor
+     *
+     * memoryUsed is the largest heap usage of a single statement seen by the monitor.
+     * @param bReset restarts the sums afterwards
+     */
+    CppSQLite3StatementStatus statementStatus(bool bReset = false);
+
+    /**
+     * @brief beginTransaction begins a transaction that is rolled back unless it is committed
+     *
+     *     auto transaction = db.beginTransaction(CppSQLite3TransactionMode::immediate);
+     *     db.execDML(...);
+     *     transaction.commit();
+     *
+     * The BEGIN, COMMIT and ROLLBACK statements are compiled once per connection.
+     */
+    CppSQLite3Transaction beginTransaction(CppSQLite3TransactionMode mode = CppSQLite3TransactionMode::deferred);
+
+    /**
+     * @brief savepoint opens a savepoint that is rolled back unless it is released
+     *
+     * Savepoints nest, inside a transaction or on their own, and have to be released or rolled back in reverse order
+     * of creation, which scopes do naturally.
+     */
+    CppSQLite3Savepoint savepoint();
 
 private:
-    sqlite3_stmt* compile(CppSQLite3StringView szSQL);
+    sqlite3_stmt* compile(CppSQLite3StringView szSQL, std::shared_ptr<CppSQLite3StatementCache>& pCache,
+                          std::shared_ptr<CppSQLite3ColumnMap>& pColumns);
+
+    int execPreparedDML(CppSQLite3StringView szSQL);
+
+    friend class CppSQLite3BatchInserter;
+    friend class CppSQLite3CheckpointScheduler;
+    friend class CppSQLite3ConnectionLease;
+    friend class CppSQLite3ConnectionPool;
+    friend class CppSQLite3DeadlineScope;
+    friend class CppSQLite3Transaction;
+    friend class CppSQLite3Savepoint;
+    friend class CppSQLite3WriteQueue;
+
+    enum class TransactionControl
+    {
+        beginDeferred,
+        beginImmediate,
+        beginExclusive,
+        commit,
+        rollback,
+        savepoint,
+        release,
+        rollbackTo
+    };
+
+    /**
+     * @brief execTransactionControl runs a cached transaction statement, nDepth selects the savepoint
+     */
+    void execTransactionControl(TransactionControl control, int nDepth = 0);
 
     void checkDB() const;
     CppSQLite3Config mConfig;
     int mnBusyTimeoutMs;
+    bool mbPreparedExecDML;
+    std::shared_ptr<CppSQLite3StatementCache> mpStatementCache;
+    std::unique_ptr<CppSQLite3TransactionStatements> mpTransactionStatements;
+    int mnSavepoints = 0; // open savepoints
+    std::unique_ptr<CppSQLite3BusyHandler> mpBusyHandler; // never replaced, busyStats may read it on other threads
+    bool mbBusyPolicy = false;                            // mpBusyHandler is installed instead of the busy timeout
+    std::unique_ptr<CppSQLite3ExecutionLimits> mpLimits;
+};
+
+/**
+ * @brief CppSQLite3Transaction is the scope guard returned by CppSQLite3DB::beginTransaction
+ *
+ * The destructor rolls back the transaction unless it was committed or rolled back before, errors are logged.
+ */
+class CppSQLite3Transaction
+{
+public:
+    CppSQLite3Transaction() = default;
+
+    CppSQLite3Transaction(CppSQLite3Transaction&& rTransaction);
+    CppSQLite3Transaction& operator=(CppSQLite3Transaction&& rTransaction);
+
+    virtual ~CppSQLite3Transaction();
+
+    void commit();
+    void rollback();
+
+    bool isActive() const
+    {
+        return mpDB != nullptr;
+    }
+
+private:
+    friend class CppSQLite3DB;
+
+    explicit CppSQLite3Transaction(CppSQLite3DB& db) : mpDB(&db)
+    {
+    }
+
+    void checkActive() const;
+
+    CppSQLite3DB* mpDB = nullptr;
+};
+
+/**
+ * @brief CppSQLite3Savepoint is the scope guard returned by CppSQLite3DB::savepoint
+ *
+ * The destructor rolls back to the savepoint and releases it unless it was released or rolled back before.
+ */
+class CppSQLite3Savepoint
+{
+public:
+    CppSQLite3Savepoint() = default;
+
+    CppSQLite3Savepoint(CppSQLite3Savepoint&& rSavepoint);
+    CppSQLite3Savepoint& operator=(CppSQLite3Savepoint&& rSavepoint);
+
+    virtual ~CppSQLite3Savepoint();
+
+    /**
+     * @brief release keeps the changes since the savepoint (RELEASE), they are committed with the transaction
+     */
+    void release();
+
+    /**
+     * @brief rollback undoes the changes since the savepoint (ROLLBACK TO) and releases it
+     */
+    void rollback();
+
+    bool isActive() const
+    {
+        return mpDB != nullptr;
+    }
+
+private:
+    friend class CppSQLite3DB;
+
+    CppSQLite3Savepoint(CppSQLite3DB& db, int nDepth) : mpDB(&db), mnDepth(nDepth)
+    {
+    }
+
+    void checkActive() const;
+    void finish(bool bRollback);
+
+    CppSQLite3DB* mpDB = nullptr;
+    int mnDepth = 0;
+};
+
+/**
+ * @brief CppSQLite3DeadlineScope is the scope guard returned by CppSQLite3DB::withDeadline and withCancellation
+ *
+ * The deadline and token apply to the connection until the scope ends.
+ */
+class CppSQLite3DeadlineScope
+{
+public:
+    CppSQLite3DeadlineScope() = default;
+
+    CppSQLite3DeadlineScope(CppSQLite3DeadlineScope&& rScope);
+    CppSQLite3DeadlineScope& operator=(CppSQLite3DeadlineScope&& rScope);
+
+    virtual ~CppSQLite3DeadlineScope();
+
+    /**
+     * @brief end removes the deadline and token before the scope is destroyed
+     */
+    void end();
+
+    bool isActive() const
+    {
+        return mpDB != nullptr;
+    }
+
+private:
+    friend class CppSQLite3DB;
+
+    CppSQLite3DeadlineScope(CppSQLite3DB& db, std::uint64_t nId) : mpDB(&db), mnId(nId)
+    {
+    }
+
+    CppSQLite3DB* mpDB = nullptr;
+    std::uint64_t mnId = 0;
+};
+
+/**
+ * @brief CppSQLite3BatchInsertOptions configures a CppSQLite3BatchInserter
+ */
+struct CppSQLite3BatchInsertOptions
+{
+    /// rows per INSERT, capped by SQLITE_LIMIT_VARIABLE_NUMBER. 0 uses the cap, but very long statements are slower
+    std::size_t maxRowsPerStatement = 256;
+    std::size_t commitInterval = 0; ///< commit after this many rows, 0: commit on flush only
+    bool useTransaction = true;     ///< wrap the inserts in a transaction unless one is already open
+};
+
+/**
+ * @brief CppSQLite3BatchInserter buffers rows and writes them with multi-row INSERT statements
+ *
+ *     CppSQLite3BatchInserter inserter(db, "measurements", {"time", "sensor", "value"});
+ *     for (const auto& m : measurements)
+ *     {
+ *         inserter.insert(m.time, m.sensor, m.value);
+ *     }
+ *     inserter.flush();
+ *
+ * Each full batch runs one `INSERT INTO table (columns) VALUES (?, ...), (?, ...), ...` statement, which is
+ * compiled once and reused. Rows left over on flush are written with a statement sized to them. Unless a
+ * transaction is already open, the inserter begins one with the first batch and commits it every commitInterval
+ * rows and on flush. If a batch fails the buffered rows are dropped and the inserter's transaction is rolled back.
+ * The destructor flushes, errors are logged. If it runs while an exception unwinds the stack, it drops the buffered
+ * rows and rolls back instead.
+ */
+class CppSQLite3BatchInserter
+{
+public:
+    CppSQLite3BatchInserter(CppSQLite3DB& db, std::string_view table, const std::vector<std::string>& columns,
+                            const CppSQLite3BatchInsertOptions& options = CppSQLite3BatchInsertOptions());
+
+    CppSQLite3BatchInserter(const CppSQLite3BatchInserter&) = delete;
+    CppSQLite3BatchInserter& operator=(const CppSQLite3BatchInserter&) = delete;
+
+    virtual ~CppSQLite3BatchInserter();
+
+    /**
+     * @brief insert buffers one row, values in column order
+     *
+     * Supported are arithmetic types, strings (const char*, std::string, std::string_view, CppSQLite3StringView),
+     * CppSQLite3BlobView, nullptr and std::optional of these. The values are copied, so they may be released after
+     * the call.
+     * @throws std::invalid_argument if the number of values doesn't match the number of columns
+     */
+    template <typename... Args>
+    void insert(const Args&... args)
+    {
+        checkRowSize(sizeof...(Args));
+        (append(args), ...);
+        rowAppended();
+    }
+
+    /**
+     * @brief insertRow buffers all fields of row in the order of CppSQLite3RowTraits<T>
+     */
+    template <typename T>
+    void insertRow(const T& row)
+    {
+        std::apply([this, &row](auto... members) { insert(row.*members...); }, CppSQLite3RowTraits<T>::fields);
+    }
+
+    /**
+     * @brief flush writes all buffered rows and commits the inserter's transaction
+     */
+    void flush();
+
+    std::size_t rowsPerStatement() const
+    {
+        return mnRowsPerStatement;
+    }
+
+    std::size_t rowsInserted() const
+    {
+        return mnRowsInserted;
+    }
+
+private:
+    struct Value
+    {
+        int type; // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+        union
+        {
+            long long nValue;
+            double fValue;
+            std::size_t nOffset; // position of text and blob values in mData
+        };
+        std::size_t nSize;
+    };
+
+    template <typename T>
+    void append(const T& value)
+    {
+        if constexpr (CppSQLite3Detail::isOptional<T>)
+        {
+            if (value)
+            {
+                append(*value);
+            }
+            else
+            {
+                appendValue(SQLITE_NULL);
+            }
+        }
+        else if constexpr (std::is_same_v<T, std::nullptr_t>)
+        {
+            appendValue(SQLITE_NULL);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            appendValue(SQLITE_INTEGER).nValue = static_cast<long long>(value);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            appendValue(SQLITE_FLOAT).fValue = static_cast<double>(value);
+        }
+        else if constexpr (std::is_array_v<T> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<T>>, char>)
+        {
+            // string literals and char buffers, which are never null
+            appendBytes(SQLITE_TEXT, value, std::strlen(value));
+        }
+        else if constexpr (std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>)
+        {
+            if (value)
+            {
+                appendBytes(SQLITE_TEXT, value, std::strlen(value));
+            }
+            else
+            {
+                appendValue(SQLITE_NULL);
+            }
+        }
+        else if constexpr (std::is_same_v<T, CppSQLite3StringView>)
+        {
+            append(value.c_str());
+        }
+        else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+        {
+            std::string_view text = value;
+            appendBytes(SQLITE_TEXT, text.data(), text.size());
+        }
+        else if constexpr (std::is_same_v<T, CppSQLite3BlobView>)
+        {
+            appendBytes(SQLITE_BLOB, value.data(), value.size());
+        }
+        else
+        {
+            static_assert(CppSQLite3Detail::alwaysFalse<T>, "unsupported type for CppSQLite3BatchInserter::insert");
+        }
+    }
+
+    Value& appendValue(int nType);
+    void appendBytes(int nType, const void* pData, std::size_t nSize);
+    void checkRowSize(std::size_t nValues) const;
+    void rowAppended();
+    void writeRows(std::size_t nRows);
+    void discardRows();
+    sqlite3_stmt* statementFor(std::size_t nRows);
+
+    CppSQLite3DB& mDB;
+    std::string mTable;
+    std::vector<std::string> mColumns;
+    CppSQLite3BatchInsertOptions mOptions;
+    std::size_t mnRowsPerStatement;
+    sqlite3_stmt* mpBatchVM = nullptr;   // mnRowsPerStatement rows
+    sqlite3_stmt* mpPartialVM = nullptr; // mnPartialRows rows, for flushing the rest
+    std::size_t mnPartialRows = 0;
+    std::vector<Value> mValues;
+    std::vector<char> mData;
+    std::size_t mnBufferedRows = 0;
+    std::size_t mnRowsInTransaction = 0;
+    std::size_t mnRowsInserted = 0;
+    CppSQLite3Transaction mTransaction; // active if the inserter began the transaction
+    int mnUncaughtExceptions;           // std::uncaught_exceptions() at construction
+};
+
+/**
+ * @brief CppSQLite3ConnectionPoolOptions configures a CppSQLite3ConnectionPool, the settings apply to all connections
+ */
+struct CppSQLite3ConnectionPoolOptions
+{
+    std::size_t readers = 4;                        ///< read-only connections, with 0 readers lease the writer
+    int busyTimeoutMs = 60'000;                     ///< see CppSQLite3DB::setBusyTimeout
+    std::optional<CppSQLite3BusyPolicy> busyPolicy; ///< replaces busyTimeoutMs, see CppSQLite3DB::setBusyPolicy
+    int acquireTimeoutMs = -1;                      ///< how long acquire waits for a free connection, -1: no limit
+    std::size_t statementCacheSize = 0;             ///< see CppSQLite3DB::setStatementCacheSize
+    bool enableWAL = true;                          ///< switch to WAL, so readers and the writer don't block each other
+    CppSQLite3ErrorHandler errorHandler = nullptr;  ///< nullptr keeps the default
+    CppSQLite3LogHandler logHandler = nullptr;      ///< nullptr keeps the default
+    std::shared_ptr<CppSQLite3Profiler> profiler;   ///< see CppSQLite3DB::setProfiler
+};
+
+class CppSQLite3PoolState;
+
+/**
+ * @brief CppSQLite3ConnectionLease gives exclusive use of a pooled connection until it is destroyed or released
+ */
+class CppSQLite3ConnectionLease
+{
+public:
+    CppSQLite3ConnectionLease() = default;
+
+    CppSQLite3ConnectionLease(CppSQLite3ConnectionLease&& rLease);
+    CppSQLite3ConnectionLease& operator=(CppSQLite3ConnectionLease&& rLease);
+
+    virtual ~CppSQLite3ConnectionLease();
+
+    /**
+     * @brief release hands the connection back to the pool, an open transaction is rolled back
+     *
+     * Savepoints of the holder end with the transaction. If the rollback fails, the connection is reopened.
+     */
+    void release();
+
+    explicit operator bool() const
+    {
+        return mpDB != nullptr;
+    }
+
+    CppSQLite3DB& operator*() const
+    {
+        return *mpDB;
+    }
+
+    CppSQLite3DB* operator->() const
+    {
+        return mpDB;
+    }
+
+private:
+    friend class CppSQLite3ConnectionPool;
+
+    CppSQLite3ConnectionLease(std::shared_ptr<CppSQLite3PoolState> pState, CppSQLite3DB* pDB)
+        : mpState(std::move(pState)), mpDB(pDB)
+    {
+    }
+
+    std::shared_ptr<CppSQLite3PoolState> mpState;
+    CppSQLite3DB* mpDB = nullptr;
+};
+
+/**
+ * @brief CppSQLite3ConnectionPool shares one database file between threads: one write connection and a set of
+ * read-only connections, each leased to one thread at a time
+ *
+ *     CppSQLite3ConnectionPool pool("app.sqlite");
+ *     auto reader = pool.acquireReader();
+ *     auto query = reader->execQuery("SELECT ...");
+ *
+ * In WAL mode the readers run in parallel with each other and the writer. The connections are opened with
+ * SQLITE_OPEN_NOMUTEX, since a lease is only used by one thread. Leases keep the pool's connections alive, but
+ * they must be released before their thread is done with the pool.
+ */
+class CppSQLite3ConnectionPool
+{
+public:
+    explicit CppSQLite3ConnectionPool(
+        CppSQLite3StringView fileName,
+        const CppSQLite3ConnectionPoolOptions& options = CppSQLite3ConnectionPoolOptions());
+
+    CppSQLite3ConnectionPool(const CppSQLite3ConnectionPool&) = delete;
+    CppSQLite3ConnectionPool& operator=(const CppSQLite3ConnectionPool&) = delete;
+
+    virtual ~CppSQLite3ConnectionPool();
+
+    /**
+     * @brief acquireWriter waits until the write connection is free
+     *
+     * If acquireTimeoutMs passes first, the error handler is called with SQLITE_BUSY (by default this throws) and
+     * an empty lease is returned if it doesn't throw.
+     */
+    CppSQLite3ConnectionLease acquireWriter();
+
+    /**
+     * @brief acquireReader waits for a free read-only connection, see acquireWriter
+     */
+    CppSQLite3ConnectionLease acquireReader();
+
+    /**
+     * @brief tryAcquireWriter returns an empty lease right away if the write connection is in use
+     */
+    CppSQLite3ConnectionLease tryAcquireWriter();
+
+    /**
+     * @brief tryAcquireReader returns an empty lease right away if all read-only connections are in use
+     */
+    CppSQLite3ConnectionLease tryAcquireReader();
+
+    std::size_t numReaders() const;
+    std::size_t idleReaders() const;
+
+private:
+    CppSQLite3ConnectionLease acquire(bool bWriter, bool bWait);
+
+    std::shared_ptr<CppSQLite3PoolState> mpState;
+};
+
+/**
+ * @brief CppSQLite3WriteQueueOptions configures the flush window of a CppSQLite3WriteQueue
+ */
+struct CppSQLite3WriteQueueOptions
+{
+    std::size_t maxJobsPerCommit = 1000; ///< a commit happens at the latest after this many jobs
+    int maxDelayMs = 2;                  ///< how long the writer waits for more jobs after the first one of a window
+    CppSQLite3TransactionMode transactionMode = CppSQLite3TransactionMode::immediate;
+};
+
+/**
+ * @brief CppSQLite3WriteQueueStats counts the work of a CppSQLite3WriteQueue
+ */
+struct CppSQLite3WriteQueueStats
+{
+    std::size_t jobs = 0;       ///< jobs that were run
+    std::size_t failedJobs = 0; ///< jobs that threw or whose commit failed
+    std::size_t commits = 0;    ///< committed transactions
+};
+
+class CppSQLite3WriteQueueState;
+
+/**
+ * @brief CppSQLite3WriteQueue runs write jobs of many threads on one connection and commits them in groups
+ *
+ *     CppSQLite3WriteQueue queue(db);
+ *     auto changes = queue.submit("INSERT INTO log (time, message) VALUES (?, ?)", time, message);
+ *     auto rowId = queue.submit([](CppSQLite3DB& db) { db.execDML(...); return db.lastRowId(); });
+ *
+ * A dedicated thread collects the jobs that arrive within maxDelayMs (up to maxJobsPerCommit) and runs them in one
+ * transaction, so the cost of locking and syncing the database is shared by all of them. Each job runs in a
+ * savepoint: a job that throws is rolled back alone and its future receives the exception. The futures of the
+ * other jobs are fulfilled once the transaction is committed, or receive the exception if the commit fails. If a
+ * failing job ends the whole transaction (e.g. SQLITE_FULL or an interrupt), the jobs before it in the transaction
+ * fail with its exception and the remaining jobs run in a new one.
+ *
+ * The connection must not be used by other threads while the queue exists. The destructor runs the queued jobs and
+ * joins the thread.
+ */
+class CppSQLite3WriteQueue
+{
+public:
+    explicit CppSQLite3WriteQueue(CppSQLite3DB& db,
+                                  const CppSQLite3WriteQueueOptions& options = CppSQLite3WriteQueueOptions());
+
+    CppSQLite3WriteQueue(const CppSQLite3WriteQueue&) = delete;
+    CppSQLite3WriteQueue& operator=(const CppSQLite3WriteQueue&) = delete;
+
+    virtual ~CppSQLite3WriteQueue();
+
+    /**
+     * @brief submit queues a job, job(db) is called on the writer thread inside the group's transaction
+     * @return the future result of the job, available after the commit
+     */
+    template <typename F>
+    auto submit(F job) -> std::future<std::invoke_result_t<F&, CppSQLite3DB&>>
+    {
+        auto pJob = std::make_unique<TypedJob<F>>(std::move(job));
+        auto result = pJob->mPromise.get_future();
+        enqueue(std::move(pJob));
+        return result;
+    }
+
+    /**
+     * @brief submit queues a statement with its parameters, bound like CppSQLite3Statement::execute
+     *
+     * The parameters are copied, so views and pointers have to stay valid until the future is ready. With the
+     * statement cache enabled (CppSQLite3DB::setStatementCacheSize) the statement is compiled once.
+     * @return the future number of changed rows
+     */
+    template <typename... Args>
+    std::future<int> submit(std::string sql, const Args&... args)
+    {
+        return submit([sql = std::move(sql), args...](CppSQLite3DB& db)
+                      { return db.compileStatement(sql.c_str()).execute(args...); });
+    }
+
+    CppSQLite3WriteQueueStats stats() const;
+
+private:
+    class Job
+    {
+    public:
+        virtual ~Job() = default;
+        virtual void run(CppSQLite3DB& db) = 0;
+        virtual void complete() = 0;
+        virtual void fail(std::exception_ptr pError) = 0;
+    };
+
+    template <typename F>
+    class TypedJob : public Job
+    {
+    public:
+        using Result = std::invoke_result_t<F&, CppSQLite3DB&>;
+
+        explicit TypedJob(F job) : mJob(std::move(job))
+        {
+        }
+
+        void run(CppSQLite3DB& db) override
+        {
+            if constexpr (std::is_void_v<Result>)
+            {
+                mJob(db);
+            }
+            else
+            {
+                mResult.emplace(mJob(db));
+            }
+        }
+
+        void complete() override
+        {
+            if constexpr (std::is_void_v<Result>)
+            {
+                mPromise.set_value();
+            }
+            else
+            {
+                mPromise.set_value(std::move(*mResult));
+            }
+        }
+
+        void fail(std::exception_ptr pError) override
+        {
+            mPromise.set_exception(pError);
+        }
+
+        F mJob;
+        std::promise<Result> mPromise;
+        std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> mResult;
+    };
+
+    friend class CppSQLite3WriteQueueState;
+
+    void enqueue(std::unique_ptr<Job> pJob);
+
+    std::unique_ptr<CppSQLite3WriteQueueState> mpState;
+};
+
+
+/**
+ * @brief CppSQLite3CheckpointOptions configures the WAL size thresholds of a CppSQLite3CheckpointScheduler
+ */
+struct CppSQLite3CheckpointOptions
+{
+    int passiveFrames = 1000;   ///< a PASSIVE checkpoint runs once a commit leaves this many frames in the WAL
+    int restartFrames = 10000;  ///< from this WAL size on RESTART checkpoints wait for readers to leave the WAL
+    int truncateFrames = 50000; ///< from this WAL size on TRUNCATE checkpoints also shrink the WAL file
+    int minIntervalMs = 100;    ///< minimum time between two checkpoints
+    int busyTimeoutMs = 100;    ///< how long a RESTART or TRUNCATE checkpoint waits for readers and writers
+    int minBackoffMs = 100;     ///< pause before the next RESTART or TRUNCATE after one could not complete
+    int maxBackoffMs = 10000;   ///< the pause doubles with every incomplete checkpoint up to this limit
+};
+
+/**
+ * @brief CppSQLite3CheckpointStats reports the work of a CppSQLite3CheckpointScheduler
+ */
+struct CppSQLite3CheckpointStats
+{
+    std::size_t passive = 0;        ///< PASSIVE checkpoints run
+    std::size_t restart = 0;        ///< RESTART checkpoints run
+    std::size_t truncate = 0;       ///< TRUNCATE checkpoints run
+    std::size_t incomplete = 0;     ///< checkpoints that left frames behind because of readers or writers
+    std::size_t failed = 0;         ///< checkpoints that ended with an error other than SQLITE_BUSY
+    std::int64_t framesWritten = 0; ///< frames appended to the WAL by commits of the connection
+    int walFrames = 0;              ///< frames in the WAL after the latest commit of the connection
+    int lastLogFrames = 0;          ///< frames in the WAL when the latest checkpoint finished
+    int lastCheckpointedFrames = 0; ///< frames of the WAL that the latest checkpoint left checkpointed
+};
+
+class CppSQLite3CheckpointState;
+
+/**
+ * @brief CppSQLite3CheckpointScheduler checkpoints the WAL of a connection on a background thread
+ *
+ *     CppSQLite3CheckpointScheduler checkpoints(db);
+ *
+ * The scheduler replaces the automatic checkpoints of the connection with a WAL hook that only records the WAL size
+ * of each commit, so committing never waits for a checkpoint. A dedicated thread with its own connection to the
+ * same file runs PASSIVE checkpoints, which never block. Readers pinning old snapshots can keep them from resetting
+ * the WAL, so once it grows past restartFrames or truncateFrames the thread escalates to RESTART or TRUNCATE. When
+ * these can't complete within busyTimeoutMs, they are retried after an exponential backoff and PASSIVE
+ * checkpoints run in the meantime. Escalations and errors are reported through the log handler of the connection,
+ * whose error handler the thread's connection uses as well.
+ *
+ * The connection has to be in WAL mode. Create and destroy the scheduler on the thread using the connection; the
+ * destructor joins the thread and restores the automatic checkpoints with their previous interval.
+ */
+class CppSQLite3CheckpointScheduler
+{
+public:
+    explicit CppSQLite3CheckpointScheduler(CppSQLite3DB& db,
+                                           const CppSQLite3CheckpointOptions& options = CppSQLite3CheckpointOptions());
+
+    CppSQLite3CheckpointScheduler(const CppSQLite3CheckpointScheduler&) = delete;
+    CppSQLite3CheckpointScheduler& operator=(const CppSQLite3CheckpointScheduler&) = delete;
+
+    virtual ~CppSQLite3CheckpointScheduler();
+
+    CppSQLite3CheckpointStats stats() const;
+
+private:
+    CppSQLite3DB& mDB;
+    std::unique_ptr<CppSQLite3CheckpointState> mpState;
+    int mnAutoCheckpointFrames = 0; // wal_autocheckpoint of the connection before the scheduler
 };
 
 #endif
@@ -0,0 +1,305 @@
+#include "CppSQLite3.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+
+/**
+ * @brief measure runs the benchmark body nIterations times and prints the throughput
+ */
+void measure(std::string_view name, int nIterations, const std::function<void(int)>& body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        body(i);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fmt::print("{:<50} {:>10.0f} ops/s ({:.3f} s)\n", name, nIterations / elapsed.count(), elapsed.count());
+}
+
+void benchmarkExecDML(bool bPrepared, int nRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(16);
+    db.enablePreparedExecDML(bPrepared);
+    db.execDML("CREATE TABLE `bench` (`ID` INTEGER PRIMARY KEY, `VALUE` INT, `INFO` TEXT);");
+    db.execDML("BEGIN");
+
+    auto name = fmt::format("execDML single statement ({})", bPrepared ? "prepared" : "sqlite3_exec");
+    measure(name, nRows,
+            [&db](int)
+            { db.execDML("INSERT INTO `bench` (`VALUE`, `INFO`) VALUES(42, 'some text to insert into the table')"); });
+
+    name = fmt::format("execDML three statement script ({})", bPrepared ? "prepared" : "sqlite3_exec");
+    measure(name, nRows / 3,
+            [&db](int)
+            {
+                db.execDML("UPDATE `bench` SET `VALUE` = `VALUE` + 1 WHERE `ID` = 1;"
+                           "UPDATE `bench` SET `VALUE` = `VALUE` + 1 WHERE `ID` = 2;"
+                           "DELETE FROM `bench` WHERE `ID` = -1;");
+            });
+    db.execDML("COMMIT");
+}
+
+void benchmarkBind(int nRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `bench` (`A` INT, `B` INT, `C` INT, `D` INT, `E` REAL, `F` REAL, `G` REAL, `H` REAL,"
+               "`I` TEXT, `J` TEXT, `K` TEXT, `L` TEXT);");
+    db.execDML("BEGIN");
+    auto stmt = db.compileStatement("INSERT INTO `bench` VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+
+    measure("12 column insert (bind per parameter)", nRows,
+            [&stmt](int i)
+            {
+                stmt.bind(1, i);
+                stmt.bind(2, i + 1);
+                stmt.bind(3, i + 2);
+                stmt.bind(4, i + 3);
+                stmt.bind(5, i * 0.5);
+                stmt.bind(6, i * 1.5);
+                stmt.bind(7, i * 2.5);
+                stmt.bind(8, i * 3.5);
+                stmt.bind(9, "first");
+                stmt.bind(10, "second");
+                stmt.bind(11, "third");
+                stmt.bind(12, "fourth");
+                stmt.execDML();
+            });
+
+    measure("12 column insert (execute)", nRows,
+            [&stmt](int i)
+            {
+                stmt.execute(i, i + 1, i + 2, i + 3, i * 0.5, i * 1.5, i * 2.5, i * 3.5, "first", "second", "third",
+                             "fourth");
+            });
+    db.execDML("COMMIT");
+}
+
+void benchmarkBatchInsert(int nRows)
+{
+    const char* szCreate = "CREATE TABLE `bench` (`ID` INTEGER, `VALUE` REAL, `INFO` TEXT);";
+    {
+        CppSQLite3DB db;
+        db.open(":memory:");
+        db.execDML(szCreate);
+        db.execDML("BEGIN");
+        auto stmt = db.compileStatement("INSERT INTO `bench` (`ID`, `VALUE`, `INFO`) VALUES(?, ?, ?)");
+        measure("3 column insert (execute per row)", nRows,
+                [&stmt](int i) { stmt.execute(i, i * 0.5, "some text"); });
+        db.execDML("COMMIT");
+    }
+
+    for (std::size_t nMaxRows : {16, 256, 0})
+    {
+        CppSQLite3DB db;
+        db.open(":memory:");
+        db.execDML(szCreate);
+        CppSQLite3BatchInsertOptions options;
+        options.maxRowsPerStatement = nMaxRows;
+        CppSQLite3BatchInserter inserter(db, "bench", {"ID", "VALUE", "INFO"}, options);
+        auto name = fmt::format("3 column insert (batches of {} rows)", inserter.rowsPerStatement());
+        measure(name, nRows, [&inserter](int i) { inserter.insert(i, i * 0.5, "some text"); });
+        inserter.flush();
+    }
+}
+
+void benchmarkProfiler(int nRows)
+{
+    for (bool bProfiled : {false, true})
+    {
+        CppSQLite3DB db;
+        db.open(":memory:");
+        if (bProfiled)
+        {
+            db.setProfiler(std::make_shared<CppSQLite3Profiler>());
+        }
+        db.execDML("CREATE TABLE `bench` (`ID` INTEGER, `VALUE` REAL, `INFO` TEXT);");
+        db.execDML("BEGIN");
+        auto stmt = db.compileStatement("INSERT INTO `bench` (`ID`, `VALUE`, `INFO`) VALUES(?, ?, ?)");
+        auto name = fmt::format("3 column insert ({})", bProfiled ? "profiled" : "not profiled");
+        measure(name, nRows, [&stmt](int i) { stmt.execute(i, i * 0.5, "some text"); });
+        db.execDML("COMMIT");
+    }
+}
+
+/**
+ * @brief runThreads runs body(nThread) on nThreads threads and prints the throughput of nOperations in total
+ */
+void runThreads(std::string_view name, int nThreads, int nOperations, const std::function<void(int)>& body)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int nThread = 0; nThread < nThreads; ++nThread)
+    {
+        threads.emplace_back(body, nThread);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    fmt::print("{:<50} {:>10.0f} ops/s ({:.3f} s)\n", name, nOperations / elapsed.count(), elapsed.count());
+}
+
+void benchmarkWriteQueue(int nWrites)
+{
+    const char* szFile = "benchmark.sqlite";
+    const char* szInsert = "INSERT INTO `bench` (`VALUE`) VALUES(?)";
+    const int nThreads = 4;
+    const int nWritesPerThread = nWrites / nThreads;
+
+    std::remove(szFile);
+    CppSQLite3DB db;
+    db.open(szFile);
+    db.execQuery("PRAGMA journal_mode=WAL");
+    db.execDML("CREATE TABLE `bench` (`ID` INTEGER PRIMARY KEY, `VALUE` INT);");
+
+    runThreads("4 threads writing (autocommit per row)", nThreads, nWritesPerThread * nThreads,
+               [&](int nThread)
+               {
+                   CppSQLite3DB own;
+                   own.open(szFile);
+                   auto stmt = own.compileStatement(szInsert);
+                   for (int i = 0; i < nWritesPerThread; ++i)
+                   {
+                       stmt.execute(nThread);
+                   }
+               });
+
+    db.setStatementCacheSize(4);
+    {
+        CppSQLite3WriteQueue queue(db);
+        runThreads("4 threads writing (write queue)", nThreads, nWritesPerThread * nThreads,
+                   [&](int nThread)
+                   {
+                       std::vector<std::future<int>> results;
+                       for (int i = 0; i < nWritesPerThread; ++i)
+                       {
+                           results.push_back(queue.submit(szInsert, nThread));
+                       }
+                       for (auto& result : results)
+                       {
+                           result.get();
+                       }
+                   });
+    }
+    db.close();
+    std::remove(szFile);
+}
+
+void benchmarkScan(int nRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `bench` (`ID` INTEGER PRIMARY KEY, `VALUE` REAL, `INFO` TEXT);");
+    db.execDML("BEGIN");
+    auto stmt = db.compileStatement("INSERT INTO `bench` (`VALUE`, `INFO`) VALUES(?, ?)");
+    for (int i = 0; i < nRows; ++i)
+    {
+        stmt.execute(i * 0.5, "some text");
+    }
+    db.execDML("COMMIT");
+
+    const int nScans = 20;
+    std::size_t nTotal = 0;
+    measure("full scan (field getters)", nScans,
+            [&](int)
+            {
+                for (auto query = db.execQuery("SELECT * FROM `bench`"); !query.eof(); query.nextRow())
+                {
+                    nTotal += query.getInt64Field(0) + static_cast<std::size_t>(query.getFloatField(1)) +
+                              query.getStringView(2).size();
+                }
+            });
+
+    CppSQLite3ColumnBatch batch;
+    measure("full scan (fetchBatch of 1024 rows)", nScans,
+            [&](int)
+            {
+                auto query = db.execQuery("SELECT * FROM `bench`");
+                while (!query.eof())
+                {
+                    query.fetchBatch(batch, 1024);
+                    const auto& ids = batch.column(0).integers;
+                    const auto& values = batch.column(1).floats;
+                    const auto& infos = batch.column(2);
+                    for (std::size_t nRow = 0; nRow < batch.numRows(); ++nRow)
+                    {
+                        nTotal += ids[nRow] + static_cast<std::size_t>(values[nRow]) + infos.text(nRow).size();
+                    }
+                }
+            });
+    fmt::print("{:<50} {:>10}\n", "(checksum)", nTotal);
+}
+
+void benchmarkReferenceLookups(int nRows)
+{
+    const char* szFile = "reference.sqlite";
+    std::remove(szFile);
+    {
+        CppSQLite3DB db;
+        db.open(szFile, CppSQLite3OpenOptions::bulkLoad());
+        db.execDML("CREATE TABLE `bench` (`ID` INTEGER PRIMARY KEY, `VALUE` REAL, `INFO` TEXT);");
+        CppSQLite3BatchInserter inserter(db, "bench", {"ID", "VALUE", "INFO"});
+        for (int i = 0; i < nRows; ++i)
+        {
+            inserter.insert(i, i * 0.5, "some reference text of moderate length");
+        }
+        inserter.flush();
+    }
+
+    std::size_t nTotal = 0;
+    for (bool bImmutable : {false, true})
+    {
+        CppSQLite3DB db;
+        if (bImmutable)
+        {
+            db.open(szFile, CppSQLite3OpenOptions::immutableReadOnly());
+        }
+        else
+        {
+            db.open(szFile, SQLITE_OPEN_READONLY);
+        }
+        auto stmt = db.compileStatement("SELECT `VALUE`, `INFO` FROM `bench` WHERE `ID` = ?");
+        auto name = fmt::format("point lookup ({})", bImmutable ? "immutable, memory mapped" : "default read-only");
+        measure(name, nRows,
+                [&](int i)
+                {
+                    // spread the lookups over the whole table
+                    stmt.bind(1, static_cast<int>((i * 7919LL) % nRows));
+                    auto query = stmt.execQuery();
+                    nTotal += static_cast<std::size_t>(query.getFloatField(0)) + query.getStringView(1).size();
+                    stmt.reset();
+                });
+    }
+    fmt::print("{:<50} {:>10}\n", "(checksum)", nTotal);
+    std::remove(szFile);
+}
+
+} // namespace
+
+int main()
+{
+    const int nRows = 200'000;
+    benchmarkExecDML(false, nRows);
+    benchmarkExecDML(true, nRows);
+    benchmarkBind(nRows);
+    benchmarkBatchInsert(nRows);
+    benchmarkProfiler(nRows);
+    benchmarkWriteQueue(nRows / 50);
+    benchmarkScan(nRows);
+    benchmarkReferenceLookups(nRows * 2);
+    return 0;
+}
@@ -1,7 +1,13 @@
 #include "CppSQLite3.h"
 #include "testhelper.h"
 
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <thread>
 #include <type_traits>
 
 #include <gtest/gtest.h>
@@ -22,8 +28,40 @@ void removeIfExists(const std::filesystem::path& path)
     std::filesystem::remove(path, ec);
 }
 
+struct Point
+{
+    int x = 0;
+    int y = 0;
+};
+
+struct Person
+{
+    int id = 0;
+    std::string name;
+    std::optional<double> score;
+    std::string_view nickname;
+};
+
 } // namespace
 
+template <>
+struct CppSQLite3RowTraits<Person>
+{
+    static constexpr auto fields = std::make_tuple(&Person::id, &Person::name, &Person::score, &Person::nickname);
+};
+
+// reads "x,y" text columns as Point
+template <>
+struct CppSQLite3ValueTraits<Point>
+{
+    static Point column(sqlite3_stmt* pVM, int nCol)
+    {
+        Point p;
+        std::sscanf(reinterpret_cast<const char*>(sqlite3_column_text(pVM, nCol)), "%d,%d", &p.x, &p.y);
+        return p;
+    }
+};
+
 TEST(ExecQueryTest, throwsOnSyntaxError)
 {
     CppSQLite3DB db;
@@ -205,6 +243,12 @@ TEST(CppSQLite3DBTest, runCheckpoint)
     db.execDML("CREATE TABLE `myTable` (`INFO` TEXT);");
     ASSERT_GT(std::filesystem::file_size("checkpointTest.sqlite-wal"), 0);
 
+    int nLogFrames = 0;
+    int nCheckpointedFrames = 0;
+    db.performCheckpoint("", SQLITE_CHECKPOINT_PASSIVE, &nLogFrames, &nCheckpointedFrames);
+    EXPECT_GT(nLogFrames, 0);
+    EXPECT_EQ(nLogFrames, nCheckpointedFrames);
+
     ASSERT_NO_THROW(db.performCheckpoint("", SQLITE_CHECKPOINT_TRUNCATE));
     ASSERT_EQ(std::filesystem::file_size("checkpointTest.sqlite-wal"), 0);
 }
@@ -256,6 +300,2089 @@ TEST(CppSQLite3DBTest, verboseLoggingWithCustomHandler)
 }
 
 
+TEST(StatementCacheTest, disabledByDefault)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execQuery("SELECT 1");
+    db.execQuery("SELECT 1");
+    auto stats = db.statementCacheStats();
+    EXPECT_EQ(0u, stats.capacity);
+    EXPECT_EQ(0u, stats.size);
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(0u, stats.misses);
+}
+
+TEST(StatementCacheTest, reusesStatementsAfterQueryIsFinalized)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(4);
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'one')");
+    db.execDML("INSERT INTO `myTable` VALUES(2, 'two')");
+    for (int i = 0; i < 3; ++i)
+    {
+        auto query = db.execQuery("SELECT INFO FROM `myTable` ORDER BY ID");
+        EXPECT_STREQ("one", query.getStringField(0));
+        query.nextRow();
+        EXPECT_STREQ("two", query.getStringField(0));
+    }
+    auto stats = db.statementCacheStats();
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(1u, stats.size);
+}
+
+TEST(StatementCacheTest, cachedStatementHasNoBindings)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(4);
+    {
+        auto stmt = db.compileStatement("SELECT ?");
+        stmt.bind(1, 42);
+        EXPECT_EQ(42, stmt.execQuery().getIntField(0));
+    }
+    auto stmt = db.compileStatement("SELECT ?");
+    EXPECT_TRUE(stmt.execQuery().fieldIsNull(0));
+    EXPECT_EQ(1u, db.statementCacheStats().hits);
+}
+
+TEST(StatementCacheTest, overlappingQueriesOfSameSQL)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(4);
+    {
+        auto query1 = db.execQuery("SELECT 1");
+        auto query2 = db.execQuery("SELECT 1");
+        EXPECT_EQ(1, query1.getIntField(0));
+        EXPECT_EQ(1, query2.getIntField(0));
+    }
+    auto stats = db.statementCacheStats();
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(1u, stats.size);
+}
+
+TEST(StatementCacheTest, evictsLeastRecentlyUsed)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(2);
+    db.execQuery("SELECT 1");
+    db.execQuery("SELECT 2");
+    db.execQuery("SELECT 1");
+    db.execQuery("SELECT 3"); // evicts SELECT 2
+    db.execQuery("SELECT 1");
+    db.execQuery("SELECT 2");
+    auto stats = db.statementCacheStats();
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(4u, stats.misses);
+    EXPECT_EQ(2u, stats.evictions);
+    EXPECT_EQ(2u, stats.size);
+
+    db.setStatementCacheSize(0);
+    EXPECT_EQ(0u, db.statementCacheStats().size);
+}
+
+TEST(StatementCacheTest, multiStatementTextIsNotCached)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(2);
+    db.execQuery("SELECT 1; SELECT 2");
+    EXPECT_EQ(0u, db.statementCacheStats().size);
+}
+
+TEST(StatementCacheTest, closeFinalizesCachedStatements)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(2);
+    db.execQuery("SELECT 1");
+    EXPECT_EQ(1u, db.statementCacheStats().size);
+    EXPECT_NO_THROW(db.close());
+    EXPECT_FALSE(db.isOpened());
+}
+
+TEST(StatementCacheTest, errorsAreReportedForCachedStatements)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(2);
+    db.execDML("CREATE TABLE `myTable` (`ID` INT NOT NULL UNIQUE);");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(1)");
+    stmt.execDML();
+    EXPECT_THROW_WITH_MSG(stmt.execDML(), CppSQLite3Exception,
+                          "SQLITE_CONSTRAINT[19]: UNIQUE constraint failed: myTable.ID");
+}
+
+
+TEST(PreparedExecDMLTest, executesScriptsStatementByStatement)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.enablePreparedExecDML(true);
+    int nChanged = db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);"
+                              "INSERT INTO `myTable` VALUES(1, 'one'); -- first row\n"
+                              "INSERT INTO `myTable` VALUES(2, 'two'), (3, 'three');  ");
+    EXPECT_EQ(2, nChanged);
+    EXPECT_EQ(3, db.execScalar("SELECT count(*) FROM `myTable`"));
+    EXPECT_NO_THROW(db.execDML("SELECT * FROM `myTable`"));
+    EXPECT_NO_THROW(db.execDML(""));
+}
+
+TEST(PreparedExecDMLTest, reusesCompiledScripts)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setStatementCacheSize(4);
+    db.enablePreparedExecDML(true);
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    const char* script = "INSERT INTO `myTable` VALUES(1); INSERT INTO `myTable` VALUES(2);";
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(1, db.execDML(script));
+    }
+    auto stats = db.statementCacheStats();
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(2u, stats.size);
+    EXPECT_EQ(6, db.execScalar("SELECT count(*) FROM `myTable`"));
+}
+
+TEST(PreparedExecDMLTest, reportsErrorsLikeSqliteExec)
+{
+    CppSQLite3DB db;
+    db.setErrorHandler(CustomExceptions::throwException);
+    db.open(":memory:");
+    db.setStatementCacheSize(4);
+    db.enablePreparedExecDML(true);
+    EXPECT_THROW_WITH_MSG(db.execDML("CRETE TABLE `myTable` (`ID` INT);"), CustomExceptions::InvalidQuery,
+                          "near \"CRETE\": syntax error when executing DML query");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT NOT NULL UNIQUE);");
+    const char* script = "INSERT INTO `myTable` VALUES(1); INSERT INTO `myTable` VALUES(1);";
+    EXPECT_THROW_WITH_MSG(db.execDML(script), CustomExceptions::SQLiteError,
+                          "UNIQUE constraint failed: myTable.ID when executing DML query (Code 19)");
+    EXPECT_EQ(1, db.execScalar("SELECT count(*) FROM `myTable`"));
+    EXPECT_NO_THROW(db.close());
+}
+
+
+TEST(CppSQLite3QueryTest, fieldIndexReturnsFirstOfDuplicateNames)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto query = db.execQuery("SELECT 1 AS a, 2 AS b, 3 AS a");
+    EXPECT_EQ(0, query.fieldIndex("a"));
+    EXPECT_EQ(1, query.fieldIndex("b"));
+    EXPECT_EQ(1, query.getIntField("a"));
+    EXPECT_THROW_WITH_MSG(query.fieldIndex("c"), std::invalid_argument, "Invalid field name requested");
+    EXPECT_THROW_WITH_MSG(query.fieldIndex(nullptr), std::invalid_argument, "Invalid field name requested");
+}
+
+TEST(CppSQLite3QueryTest, resolvedColumnIsUsableForAllRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'one'), (2, 'two');");
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY ID");
+    const CppSQLite3Column id = query.column("ID");
+    const CppSQLite3Column info = query.column("INFO");
+    EXPECT_EQ(0, id.index());
+    EXPECT_EQ(1, info.index());
+    std::vector<std::string> rows;
+    for (; !query.eof(); query.nextRow())
+    {
+        rows.push_back(std::to_string(query.getIntField(id)) + query.getStringField(info));
+    }
+    EXPECT_EQ((std::vector<std::string>{"1one", "2two"}), rows);
+}
+
+TEST(CppSQLite3StatementTest, fieldNamesFollowSchemaChanges)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1);");
+    auto stmt = db.compileStatement("SELECT * FROM `myTable`");
+    EXPECT_EQ(1, stmt.execQuery().getIntField("ID"));
+    stmt.reset();
+    db.execDML("ALTER TABLE `myTable` ADD COLUMN `INFO` TEXT DEFAULT 'info';");
+    auto query = stmt.execQuery();
+    EXPECT_EQ(1, query.getIntField("ID"));
+    EXPECT_STREQ("info", query.getStringField("INFO"));
+}
+
+
+TEST(CppSQLite3QueryTest, typedGet)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto query =
+        db.execQuery("SELECT 42 AS i, 5000000000 AS big, 2.5 AS f, 'some text' AS t, x'00ff10' AS b, NULL AS n");
+    EXPECT_EQ(42, query.get<int>(0));
+    EXPECT_EQ(42u, query.get<unsigned char>(0));
+    EXPECT_TRUE(query.get<bool>("i"));
+    EXPECT_EQ(5000000000LL, query.get<long long>("big"));
+    EXPECT_EQ(5000000000ULL, query.get<std::uint64_t>(1));
+    EXPECT_DOUBLE_EQ(2.5, query.get<double>("f"));
+    EXPECT_FLOAT_EQ(2.5f, query.get<float>("f"));
+    EXPECT_EQ("some text", query.get<std::string_view>("t"));
+    EXPECT_EQ("some text", query.get<std::string>(3));
+    EXPECT_STREQ("some text", query.get<const char*>(3));
+    auto blob = query.get<CppSQLite3BlobView>("b");
+    EXPECT_EQ((std::vector<unsigned char>{0x00, 0xff, 0x10}), std::vector<unsigned char>(blob.begin(), blob.end()));
+    EXPECT_EQ(0, query.get<int>("n"));
+    EXPECT_TRUE(query.get<std::string_view>("n").empty());
+    EXPECT_EQ(nullptr, query.get<const char*>("n"));
+    EXPECT_TRUE(query.get<CppSQLite3BlobView>("n").empty());
+    EXPECT_EQ(std::nullopt, query.get<std::optional<int>>("n"));
+    EXPECT_EQ(std::optional<int>(42), query.get<std::optional<int>>(query.column("i")));
+    EXPECT_THROW_WITH_MSG(query.get<int>(6), std::invalid_argument, "Invalid field index requested");
+    EXPECT_THROW_WITH_MSG(query.get<int>(-1), std::invalid_argument, "Invalid field index requested");
+}
+
+TEST(CppSQLite3QueryTest, typedGetWithUserTraits)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto query = db.execQuery("SELECT '3,4', NULL");
+    auto p = query.get<Point>(0);
+    EXPECT_EQ(3, p.x);
+    EXPECT_EQ(4, p.y);
+    EXPECT_FALSE(query.get<std::optional<Point>>(1).has_value());
+}
+
+
+TEST(CppSQLite3StatementTest, executeBindsAllParameters)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `BIG` INT, `F` REAL, `T` TEXT, `S` TEXT, `B` BLOB, `N` INT);");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(?, ?, ?, ?, ?, ?, ?)");
+    const unsigned char blob[] = {1, 2, 3};
+    std::string text = "std::string";
+    EXPECT_EQ(1, stmt.execute(1, 5000000000LL, 2.5, "literal", text, CppSQLite3BlobView(blob, sizeof(blob)),
+                              std::optional<int>()));
+    EXPECT_EQ(1, stmt.execute(2, std::uint64_t(7), 1.0f, std::string_view("view"), CppSQLite3StringView(nullptr),
+                              nullptr, std::optional<int>(3)));
+
+    auto select = db.compileStatement("SELECT * FROM `myTable` WHERE `ID` = ?");
+    auto query = select.query(1);
+    EXPECT_EQ(5000000000LL, query.get<long long>("BIG"));
+    EXPECT_DOUBLE_EQ(2.5, query.get<double>("F"));
+    EXPECT_EQ("literal", query.get<std::string_view>("T"));
+    EXPECT_EQ("std::string", query.get<std::string_view>("S"));
+    EXPECT_EQ(3u, query.get<CppSQLite3BlobView>("B").size());
+    EXPECT_TRUE(query.fieldIsNull("N"));
+
+    query = select.query(2);
+    EXPECT_EQ(7, query.get<int>("BIG"));
+    EXPECT_EQ("view", query.get<std::string_view>("T"));
+    EXPECT_TRUE(query.fieldIsNull("S"));
+    EXPECT_TRUE(query.fieldIsNull("B"));
+    EXPECT_EQ(3, query.get<int>("N"));
+}
+
+TEST(CppSQLite3StatementTest, executeChecksParameterCount)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(?, ?)");
+    EXPECT_THROW_WITH_MSG(stmt.execute(1), std::invalid_argument,
+                          "Invalid number of parameters: statement expects 2 but got 1");
+    EXPECT_THROW_WITH_MSG(stmt.execute(1, "a", "b"), std::invalid_argument,
+                          "Invalid number of parameters: statement expects 2 but got 3");
+    EXPECT_EQ(0, db.execScalar("SELECT count(*) FROM `myTable`"));
+}
+
+TEST(CppSQLite3StatementTest, queryResetsPreviousExecution)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    auto insert = db.compileStatement("INSERT INTO `myTable` VALUES(?)");
+    for (int i = 0; i < 5; ++i)
+    {
+        insert.execute(i);
+    }
+    auto select = db.compileStatement("SELECT `ID` FROM `myTable` WHERE `ID` >= ? ORDER BY `ID`");
+    auto query = select.query(1);
+    EXPECT_EQ(1, query.get<int>(0));
+    query = select.query(3);
+    EXPECT_EQ(3, query.get<int>(0));
+    query.nextRow();
+    EXPECT_EQ(4, query.get<int>(0));
+    query.nextRow();
+    EXPECT_TRUE(query.eof());
+    EXPECT_TRUE(select.query(5).eof());
+}
+
+
+TEST(CppSQLite3StatementTest, bindTextWithExplicitLength)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto stmt = db.compileStatement("SELECT length(CAST(? AS BLOB)), ?, typeof(?)");
+    std::string withNul("a\0b", 3);
+    stmt.bindText(1, withNul);
+    stmt.bindText(2, std::string_view("some text").substr(5));
+    stmt.bindText(3, std::string_view());
+    auto query = stmt.execQuery();
+    EXPECT_EQ(3, query.getIntField(0));
+    EXPECT_EQ("text", query.get<std::string_view>(1));
+    EXPECT_STREQ("text", query.getStringField(2));
+}
+
+TEST(CppSQLite3StatementTest, noCopyBindingsAreReleasedOnReset)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT, `DATA` BLOB);");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(?, ?, ?)");
+    {
+        std::string info = "json payload";
+        std::vector<unsigned char> data = {1, 2, 3};
+        stmt.bind(1, 1);
+        stmt.bindText(2, info, CppSQLite3BindMode::noCopy);
+        stmt.bindBlob(3, CppSQLite3BlobView(data.data(), data.size()), CppSQLite3BindMode::noCopy);
+        stmt.execDML();
+    }
+    // the buffers are gone, the parameters must not refer to them any longer
+    stmt.execDML();
+
+    std::string info = "copied";
+    stmt.bind(1, 3);
+    stmt.bindText(2, info, CppSQLite3BindMode::noCopy);
+    stmt.bindText(2, info, CppSQLite3BindMode::copy);
+    stmt.bindBlob(3, CppSQLite3BlobView());
+    stmt.execDML();
+    info = "changed";
+    stmt.execDML();
+
+    auto query = db.execQuery("SELECT `ID`, `INFO`, typeof(`DATA`), length(`DATA`) FROM `myTable`");
+    EXPECT_EQ(1, query.getIntField(0));
+    EXPECT_STREQ("json payload", query.getStringField(1));
+    EXPECT_EQ(3, query.getIntField(3));
+    query.nextRow();
+    EXPECT_EQ(1, query.getIntField(0));
+    EXPECT_TRUE(query.fieldIsNull(1));
+    EXPECT_STREQ("null", query.getStringField(2));
+    for (int i = 0; i < 2; ++i)
+    {
+        query.nextRow();
+        EXPECT_EQ(3, query.getIntField(0));
+        EXPECT_STREQ("copied", query.getStringField(1));
+        EXPECT_STREQ("blob", query.getStringField(2));
+        EXPECT_EQ(0, query.getIntField(3));
+    }
+}
+
+
+TEST(CppSQLite3QueryTest, stringAndBlobViews)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`INFO` TEXT, `DATA` BLOB);");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(?, ?)");
+    std::string withNul("a\0b", 3);
+    const unsigned char data[] = {0, 1, 0, 2};
+    stmt.execute(withNul, CppSQLite3BlobView(data, sizeof(data)));
+    stmt.execute(nullptr, nullptr);
+
+    auto query = db.execQuery("SELECT * FROM `myTable`");
+    EXPECT_EQ(withNul, query.getStringView("INFO"));
+    auto blob = query.getBlobView(1);
+    EXPECT_EQ(sizeof(data), blob.size());
+    EXPECT_EQ(0, std::memcmp(data, blob.data(), blob.size()));
+    EXPECT_EQ(2, blob[3]);
+    query.nextRow();
+    EXPECT_TRUE(query.getStringView(0).empty());
+    EXPECT_TRUE(query.getBlobView("DATA").empty());
+    EXPECT_THROW_WITH_MSG(query.getStringView(2), std::invalid_argument, "Invalid field index requested");
+}
+
+
+TEST(RowMappingTest, bindAndReadRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `people` (`ID` INTEGER, `NAME` TEXT, `SCORE` REAL, `NICK` VARCHAR(20));");
+    auto insert = db.compileStatement("INSERT INTO `people` VALUES(?, ?, ?, ?)");
+    insert.bindRow(Person{1, "Ada", 9.5, "ada"});
+    insert.execDML();
+    insert.bindRow(Person{2, "Bob", std::nullopt, "bobby"});
+    insert.execDML();
+
+    auto query = db.execQuery("SELECT * FROM `people` ORDER BY `ID`");
+    Person person;
+    query.getRow(person);
+    EXPECT_EQ(1, person.id);
+    EXPECT_EQ("Ada", person.name);
+    EXPECT_EQ(std::optional<double>(9.5), person.score);
+    EXPECT_EQ("ada", person.nickname);
+    query.nextRow();
+    query.getRow(person);
+    EXPECT_EQ(2, person.id);
+    EXPECT_EQ("Bob", person.name);
+    EXPECT_EQ(std::nullopt, person.score);
+    EXPECT_EQ("bobby", query.getRow<Person>().nickname);
+}
+
+TEST(RowMappingTest, checksRowLayout)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `people` (`ID` TEXT, `NAME` TEXT, `SCORE` REAL, `NICK` TEXT);");
+    db.execDML("INSERT INTO `people` VALUES('1', 'Ada', 9.5, 'ada');");
+    EXPECT_THROW_WITH_MSG(db.execQuery("SELECT `ID`, `NAME` FROM `people`").getRow<Person>(), std::invalid_argument,
+                          "Invalid row type: 4 fields for 2 columns in \"SELECT `ID`, `NAME` FROM `people`\"");
+    EXPECT_THROW_WITH_MSG(db.execQuery("SELECT * FROM `people`").getRow<Person>(), std::invalid_argument,
+                          "Invalid row type: numeric field 0 for column ID of type TEXT");
+    // expressions have no declared type
+    EXPECT_EQ(1, db.execQuery("SELECT CAST(`ID` AS INT), `NAME`, `SCORE`, `NICK` FROM `people`").getRow<Person>().id);
+
+    auto insert = db.compileStatement("INSERT INTO `people` (`ID`, `NAME`, `SCORE`) VALUES(?, ?, ?)");
+    EXPECT_THROW_WITH_MSG(insert.bindRow(Person{}), std::invalid_argument,
+                          "Invalid number of parameters: statement expects 3 but got 4");
+}
+
+
+TEST(RowIteratorTest, rangeForWithStructuredBindings)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'one'), (2, 'two'), (3, NULL);");
+    std::vector<std::string> rows;
+    for (const auto& row : db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`"))
+    {
+        auto [id, info] = row.as<int, std::optional<std::string_view>>();
+        rows.push_back(std::to_string(id) + std::string(info.value_or("-")));
+        EXPECT_EQ(id, row.get<int>("ID"));
+        EXPECT_EQ(!info, row.fieldIsNull(1));
+    }
+    EXPECT_EQ((std::vector<std::string>{"1one", "2two", "3-"}), rows);
+}
+
+TEST(RowIteratorTest, composesWithAlgorithms)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1), (2), (3), (4);");
+
+    auto query = db.execQuery("SELECT `ID` FROM `myTable` ORDER BY `ID`");
+    auto isOdd = [](const CppSQLite3Row& row) { return row.get<int>(0) % 2 == 1; };
+    EXPECT_EQ(2, std::count_if(query.begin(), query.end(), isOdd));
+    EXPECT_TRUE(query.eof());
+    EXPECT_EQ(query.begin(), query.end());
+
+    query = db.execQuery("SELECT `ID` FROM `myTable` ORDER BY `ID`");
+    query.nextRow();
+    std::vector<long long> ids;
+    std::transform(query.begin(), query.end(), std::back_inserter(ids),
+                   [](const CppSQLite3Row& row) { return row.get<long long>(0); });
+    EXPECT_EQ((std::vector<long long>{2, 3, 4}), ids);
+
+    query = db.execQuery("SELECT `ID` FROM `myTable` WHERE `ID` > 10");
+    EXPECT_EQ(0, std::distance(query.begin(), query.end()));
+}
+
+TEST(RowIteratorTest, endsOnErrorWithoutThrowingHandler)
+{
+    CppSQLite3DB db;
+    db.setErrorHandler([](int, std::string_view message, std::string_view) { getRecords().emplace_back(message); });
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1), (2), (3);");
+
+    // the statement keeps its VM after the failed step, stepping it again would rerun it from the first row
+    std::vector<int> ids;
+    {
+        auto stmt = db.compileStatement(
+            "SELECT CASE WHEN `ID` = 2 THEN abs(-9223372036854775808) ELSE `ID` END FROM `myTable`");
+        for (const auto& row : stmt.execQuery())
+        {
+            ids.push_back(row.get<int>(0));
+            ASSERT_LT(ids.size(), 3u);
+        }
+    }
+    EXPECT_EQ(std::vector<int>{1}, ids);
+    EXPECT_FALSE(getRecords().empty());
+    for (const auto& record : getRecords())
+    {
+        EXPECT_EQ("integer overflow", record);
+    }
+    getRecords().clear();
+}
+
+TEST(RowIteratorTest, rowViewChecksFieldIndex)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto query = db.execQuery("SELECT 1, 2");
+    auto it = query.begin();
+    const CppSQLite3Row& row = *it;
+    EXPECT_EQ(2, row.numFields());
+    EXPECT_THROW_WITH_MSG(row.get<int>(2), std::invalid_argument, "Invalid field index requested");
+    EXPECT_THROW_WITH_MSG((row.as<int, int, int>()), std::invalid_argument, "Invalid field index requested");
+}
+
+
+TEST(ColumnBatchTest, decodesTypedColumns)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER, `VALUE` REAL, `NAME` TEXT, `DATA` BLOB, `DAY` DATE);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 1.5, 'one', x'0102', '2024-01-01'), "
+               "(2, NULL, NULL, x'', '2024-01-02'), (3, 3.5, 'three', NULL, NULL);");
+
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`");
+    CppSQLite3ColumnBatch batch;
+    EXPECT_EQ(3u, query.fetchBatch(batch, 10));
+    EXPECT_TRUE(query.eof());
+    ASSERT_EQ(5, batch.numColumns());
+    EXPECT_EQ(3u, batch.numRows());
+
+    const auto& id = batch.column(0);
+    EXPECT_EQ("ID", id.name);
+    EXPECT_EQ(SQLITE_INTEGER, id.type);
+    EXPECT_EQ((std::vector<std::int64_t>{1, 2, 3}), id.integers);
+    EXPECT_EQ(0u, id.nullCount);
+
+    const auto& value = batch.column(1);
+    EXPECT_EQ(SQLITE_FLOAT, value.type);
+    EXPECT_EQ((std::vector<double>{1.5, 0.0, 3.5}), value.floats);
+    EXPECT_EQ(1u, value.nullCount);
+    EXPECT_TRUE(value.isNull(1));
+    EXPECT_EQ((std::vector<std::uint8_t>{0b101}), value.validity);
+
+    const auto& name = batch.column(2);
+    EXPECT_EQ(SQLITE_TEXT, name.type);
+    EXPECT_EQ((std::vector<std::int64_t>{0, 3, 3, 8}), name.offsets);
+    EXPECT_EQ("one", name.text(0));
+    EXPECT_TRUE(name.isNull(1));
+    EXPECT_EQ("three", name.text(2));
+
+    const auto& data = batch.column(3);
+    EXPECT_EQ(SQLITE_BLOB, data.type);
+    ASSERT_EQ(2u, data.blob(0).size());
+    EXPECT_EQ(2, data.blob(0)[1]);
+    EXPECT_TRUE(data.blob(1).empty());
+    EXPECT_FALSE(data.isNull(1));
+    EXPECT_TRUE(data.isNull(2));
+
+    // NUMERIC affinity: decoded as the type of the first row
+    const auto& day = batch.column(4);
+    EXPECT_EQ(SQLITE_TEXT, day.type);
+    EXPECT_EQ("2024-01-02", day.text(1));
+
+    EXPECT_EQ(0u, query.fetchBatch(batch, 10));
+    EXPECT_EQ(0u, batch.numRows());
+}
+
+TEST(ColumnBatchTest, derivesTypesPerExecution)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto stmt = db.compileStatement("SELECT ?");
+    CppSQLite3ColumnBatch batch;
+
+    // the same statement at the same address yields another type once it is bound differently
+    stmt.bind(1, 42);
+    auto query = stmt.execQuery();
+    EXPECT_EQ(1u, query.fetchBatch(batch, 10));
+    EXPECT_EQ(SQLITE_INTEGER, batch.column(0).type);
+    EXPECT_EQ(42, batch.column(0).integers[0]);
+    stmt.reset();
+
+    stmt.bind(1, "some text");
+    query = stmt.execQuery();
+    EXPECT_EQ(1u, query.fetchBatch(batch, 10));
+    EXPECT_EQ(SQLITE_TEXT, batch.column(0).type);
+    EXPECT_EQ("some text", batch.column(0).text(0));
+}
+
+TEST(ColumnBatchTest, fetchesInBatches)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'a'), (2, 'bb'), (3, 'ccc'), (4, 'dddd'), (5, 'eeeee');");
+
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`");
+    query.nextRow();
+    CppSQLite3ColumnBatch batch;
+    std::vector<std::size_t> sizes;
+    std::vector<std::int64_t> ids;
+    std::string infos;
+    while (!query.eof())
+    {
+        sizes.push_back(query.fetchBatch(batch, 2));
+        const auto& id = batch.column(0);
+        ids.insert(ids.end(), id.integers.begin(), id.integers.end());
+        for (std::size_t nRow = 0; nRow < batch.numRows(); ++nRow)
+        {
+            infos += batch.column(1).text(nRow);
+        }
+    }
+    EXPECT_EQ((std::vector<std::size_t>{2, 2}), sizes);
+    EXPECT_EQ((std::vector<std::int64_t>{2, 3, 4, 5}), ids);
+    EXPECT_EQ("bbcccddddeeeee", infos);
+    EXPECT_EQ(0u, query.fetchBatch(batch, 2));
+
+    query.finalize();
+    EXPECT_THROW_WITH_MSG(query.fetchBatch(batch, 2), std::logic_error, "Null Virtual Machine pointer");
+}
+
+TEST(ArrowExportTest, exportsStructArray)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER, `VALUE` REAL, `NAME` TEXT, `DATA` BLOB);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 1.5, 'one', x'01'), (2, NULL, 'two', NULL), (3, 3.5, NULL, x'0203');");
+
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`");
+    ArrowSchema schema;
+    ArrowArray array;
+    EXPECT_EQ(3u, query.exportArrowBatch(&schema, &array, 10));
+
+    EXPECT_STREQ("+s", schema.format);
+    ASSERT_EQ(4, schema.n_children);
+    EXPECT_STREQ("ID", schema.children[0]->name);
+    EXPECT_STREQ("l", schema.children[0]->format);
+    EXPECT_STREQ("g", schema.children[1]->format);
+    EXPECT_STREQ("U", schema.children[2]->format);
+    EXPECT_STREQ("Z", schema.children[3]->format);
+    EXPECT_EQ(ARROW_FLAG_NULLABLE, schema.children[2]->flags);
+
+    EXPECT_EQ(3, array.length);
+    ASSERT_EQ(4, array.n_children);
+    const ArrowArray* ids = array.children[0];
+    EXPECT_EQ(0, ids->null_count);
+    EXPECT_EQ(nullptr, ids->buffers[0]);
+    EXPECT_EQ(3, static_cast<const std::int64_t*>(ids->buffers[1])[2]);
+
+    const ArrowArray* values = array.children[1];
+    EXPECT_EQ(1, values->null_count);
+    EXPECT_EQ(0b101, *static_cast<const std::uint8_t*>(values->buffers[0]));
+    EXPECT_EQ(3.5, static_cast<const double*>(values->buffers[1])[2]);
+
+    const ArrowArray* names = array.children[2];
+    ASSERT_EQ(3, names->n_buffers);
+    auto offsets = static_cast<const std::int64_t*>(names->buffers[1]);
+    auto data = static_cast<const char*>(names->buffers[2]);
+    EXPECT_EQ("two", std::string(data + offsets[1], offsets[2] - offsets[1]));
+    EXPECT_EQ(offsets[2], offsets[3]);
+
+    schema.release(&schema);
+    EXPECT_EQ(nullptr, schema.release);
+    array.release(&array);
+    EXPECT_EQ(nullptr, array.release);
+}
+
+TEST(ArrowExportTest, reusesPooledBuffers)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'a'), (2, 'bb'), (3, 'ccc'), (4, 'dddd'), (5, 'eeeee');");
+
+    CppSQLite3ArrowBufferPool pool;
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`");
+    ArrowArray first;
+    EXPECT_EQ(2u, query.exportArrowBatch(nullptr, &first, 2, pool));
+    const void* pIds = first.children[0]->buffers[1];
+
+    // a moved out child keeps the batch alive after its parent is released
+    ArrowArray info = *first.children[1];
+    first.children[1]->release = nullptr;
+    first.release(&first);
+    EXPECT_EQ(0u, pool.idleBatches());
+    EXPECT_EQ('a', static_cast<const char*>(info.buffers[2])[0]);
+    info.release(&info);
+    EXPECT_EQ(1u, pool.idleBatches());
+
+    ArrowArray second;
+    EXPECT_EQ(2u, query.exportArrowBatch(nullptr, &second, 2, pool));
+    EXPECT_EQ(0u, pool.idleBatches());
+    EXPECT_EQ(pIds, second.children[0]->buffers[1]);
+    EXPECT_EQ(3, static_cast<const std::int64_t*>(second.children[0]->buffers[1])[0]);
+    second.release(&second);
+    EXPECT_EQ(1u, pool.idleBatches());
+}
+
+TEST(ResultSetTest, materializeDetachesRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER, `VALUE` REAL, `NAME` TEXT, `DATA` BLOB);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 1.5, 'one', x'0102'), (2, NULL, '22', NULL), (3, 3.25, NULL, x'');");
+
+    auto query = db.execQuery("SELECT * FROM `myTable` ORDER BY `ID`");
+    query.nextRow();
+    CppSQLite3ResultSet result = query.materialize();
+    EXPECT_THROW_WITH_MSG(query.eof(), std::logic_error, "Null Virtual Machine pointer");
+
+    ASSERT_EQ(4, result.numFields());
+    EXPECT_EQ(2, result.numRows());
+    EXPECT_STREQ("NAME", result.fieldName(2));
+    EXPECT_STREQ("REAL", result.fieldDeclType(1));
+    EXPECT_EQ(3, result.fieldIndex("DATA"));
+
+    EXPECT_FALSE(result.eof());
+    EXPECT_EQ(2, result.getIntField("ID"));
+    EXPECT_TRUE(result.fieldIsNull(1));
+    EXPECT_EQ(-1.0, result.getFloatField(1, -1.0));
+    EXPECT_EQ(22, result.getIntField("NAME"));
+    EXPECT_STREQ("22", result.getStringField(2));
+    EXPECT_STREQ("2", result.fieldValue(0));
+    EXPECT_EQ(std::nullopt, result.get<std::optional<double>>(1));
+
+    result.nextRow();
+    EXPECT_EQ(SQLITE_FLOAT, result.fieldDataType(1));
+    EXPECT_STREQ("3.25", result.fieldValue("VALUE"));
+    EXPECT_STREQ("null", result.getStringField(2, "null"));
+    int nLen = -1;
+    EXPECT_NE(nullptr, result.getBlobField(3, nLen));
+    EXPECT_EQ(0, nLen);
+
+    result.nextRow();
+    EXPECT_TRUE(result.eof());
+    EXPECT_THROW_WITH_MSG(result.getIntField(0), std::logic_error, "No current row");
+
+    result.setRow(0);
+    EXPECT_EQ(2, result.get<int>(0));
+    EXPECT_THROW_WITH_MSG(result.setRow(2), std::invalid_argument, "Invalid row index requested");
+    EXPECT_THROW_WITH_MSG(result.getIntField(4), std::invalid_argument, "Invalid field index requested");
+    EXPECT_THROW_WITH_MSG(result.getIntField("missing"), std::invalid_argument, "Invalid field name requested");
+}
+
+TEST(ResultSetTest, numericTextOutlivesIteration)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER, `VALUE` REAL, `NAME` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 1.5, 'a'), (22, 2.25, 'b'), (333, 3.125, 'c');");
+
+    auto query = db.execQuery("SELECT `ID`, `VALUE`, `NAME` AS `ID` FROM `myTable` ORDER BY 1");
+    CppSQLite3ResultSet result = query.materialize();
+    std::vector<std::string_view> ids;
+    std::vector<std::string_view> values;
+    const char* szFirst = result.fieldValue(0);
+    for (; !result.eof(); result.nextRow())
+    {
+        ids.push_back(result.getStringView(0));
+        values.push_back(result.get<std::string_view>("VALUE"));
+        EXPECT_EQ(ids.back().data(), result.fieldValue(0));
+    }
+
+    EXPECT_EQ((std::vector<std::string_view>{"1", "22", "333"}), ids);
+    EXPECT_EQ((std::vector<std::string_view>{"1.5", "2.25", "3.125"}), values);
+    EXPECT_STREQ("1", szFirst);
+
+    // duplicate names resolve to the first column like for queries
+    result.setRow(1);
+    EXPECT_EQ(0, result.fieldIndex("ID"));
+    EXPECT_EQ(22, result.getIntField("ID"));
+    EXPECT_THROW_WITH_MSG(result.fieldIndex("id"), std::invalid_argument, "Invalid field name requested");
+
+    CppSQLite3ResultSet copy = result;
+    EXPECT_EQ(1, copy.fieldIndex("VALUE"));
+}
+
+TEST(ResultSetTest, sameAccessorsAsQuery)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `NAME` TEXT, `SCORE` REAL, `NICKNAME` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'Ann', 0.5, 'A'), (2, 'Bob', NULL, 'B');");
+
+    const char* szSQL = "SELECT * FROM `myTable` ORDER BY `ID`";
+    auto query = db.execQuery(szSQL);
+    auto result = db.execQuery(szSQL).materialize();
+    for (; !query.eof(); query.nextRow(), result.nextRow())
+    {
+        for (int nField = 0; nField < query.numFields(); ++nField)
+        {
+            EXPECT_EQ(query.fieldDataType(nField), result.fieldDataType(nField));
+            EXPECT_EQ(query.getInt64Field(nField), result.getInt64Field(nField));
+            EXPECT_EQ(query.getFloatField(nField), result.getFloatField(nField));
+            EXPECT_STREQ(query.getStringField(nField), result.getStringField(nField));
+            EXPECT_EQ(query.getStringView(nField), result.getStringView(nField));
+        }
+        Person expected = query.getRow<Person>();
+        Person actual = result.getRow<Person>();
+        EXPECT_EQ(expected.name, actual.name);
+        EXPECT_EQ(expected.score, actual.score);
+        EXPECT_EQ(expected.nickname, actual.nickname);
+    }
+    EXPECT_TRUE(result.eof());
+}
+
+TEST(ResultSetTest, materializeReleasesReadSnapshot)
+{
+    removeIfExists("materializeTest.sqlite");
+    CppSQLite3DB writer;
+    writer.open("materializeTest.sqlite");
+    writer.execQuery("PRAGMA journal_mode=wal");
+    writer.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    writer.execDML("INSERT INTO `myTable` VALUES(1), (2), (3);");
+
+    CppSQLite3DB reader;
+    reader.open("materializeTest.sqlite");
+    auto stmt = reader.compileStatement("SELECT `ID` FROM `myTable` WHERE `ID` > ?");
+    auto result = stmt.query(1).materialize();
+    EXPECT_EQ(2, result.numRows());
+
+    writer.execDML("INSERT INTO `myTable` VALUES(4);");
+    ASSERT_NO_THROW(writer.performCheckpoint("", SQLITE_CHECKPOINT_TRUNCATE));
+    EXPECT_EQ(0u, std::filesystem::file_size("materializeTest.sqlite-wal"));
+    EXPECT_EQ(3, stmt.query(1).materialize().numRows());
+}
+
+TEST(BatchInserterTest, writesFullAndPartialBatches)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `NAME` TEXT, `SCORE` REAL, `DATA` BLOB);");
+
+    CppSQLite3BatchInsertOptions options;
+    options.maxRowsPerStatement = 4;
+    CppSQLite3BatchInserter inserter(db, "myTable", {"ID", "NAME", "SCORE", "DATA"}, options);
+    EXPECT_EQ(4u, inserter.rowsPerStatement());
+
+    const unsigned char data[] = {1, 2, 3};
+    for (int i = 0; i < 10; ++i)
+    {
+        std::string name = "name" + std::to_string(i);
+        std::optional<double> score = i % 2 ? std::optional<double>(i * 0.5) : std::nullopt;
+        inserter.insert(i, name, score, CppSQLite3BlobView(data, i % 4));
+    }
+    EXPECT_EQ(8u, inserter.rowsInserted());
+    inserter.flush();
+    EXPECT_EQ(10u, inserter.rowsInserted());
+    inserter.insert(10, "literal", nullptr, CppSQLite3BlobView());
+    inserter.flush();
+
+    EXPECT_EQ(11, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    EXPECT_EQ(6, db.execScalar("SELECT COUNT(*) FROM `myTable` WHERE `SCORE` IS NULL"));
+    auto query = db.execQuery("SELECT * FROM `myTable` WHERE `ID` = 7");
+    EXPECT_STREQ("name7", query.getStringField(1));
+    EXPECT_EQ(3.5, query.getFloatField(2));
+    EXPECT_EQ(3u, query.getBlobView(3).size());
+    query = db.execQuery("SELECT * FROM `myTable` WHERE `ID` = 10");
+    EXPECT_STREQ("literal", query.getStringField(1));
+
+    EXPECT_THROW_WITH_MSG(inserter.insert(1, "too few"), std::invalid_argument,
+                          "Invalid number of values: batch insert expects 4 but got 2");
+}
+
+TEST(BatchInserterTest, insertsMappedRows)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `people` (`ID` INT, `NAME` TEXT, `SCORE` REAL, `NICKNAME` TEXT);");
+    {
+        CppSQLite3BatchInserter inserter(db, "people", {"ID", "NAME", "SCORE", "NICKNAME"});
+        inserter.insertRow(Person{1, "Ann", 1.5, "A"});
+        inserter.insertRow(Person{2, "Bob", std::nullopt, "B"});
+    }
+    auto query = db.execQuery("SELECT * FROM `people` ORDER BY `ID`");
+    std::vector<std::string> names;
+    for (const auto& row : query)
+    {
+        names.push_back(row.getRow<Person>().name);
+    }
+    EXPECT_EQ((std::vector<std::string>{"Ann", "Bob"}), names);
+}
+
+TEST(BatchInserterTest, commitsEveryInterval)
+{
+    removeIfExists("batchInsertTest.sqlite");
+    CppSQLite3DB db;
+    db.open("batchInsertTest.sqlite");
+    db.execQuery("PRAGMA journal_mode=wal");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    CppSQLite3DB reader;
+    reader.open("batchInsertTest.sqlite");
+
+    CppSQLite3BatchInsertOptions options;
+    options.maxRowsPerStatement = 2;
+    options.commitInterval = 4;
+    CppSQLite3BatchInserter inserter(db, "myTable", {"ID"}, options);
+    for (int i = 0; i < 6; ++i)
+    {
+        inserter.insert(i);
+    }
+    EXPECT_EQ(6u, inserter.rowsInserted());
+    EXPECT_EQ(4, reader.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    inserter.insert(6);
+    inserter.flush();
+    EXPECT_EQ(7, reader.execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+TEST(BatchInserterTest, rollsBackOnError)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT PRIMARY KEY);");
+
+    CppSQLite3BatchInsertOptions options;
+    options.maxRowsPerStatement = 2;
+    CppSQLite3BatchInserter inserter(db, "myTable", {"ID"}, options);
+    inserter.insert(1);
+    inserter.insert(2);
+    inserter.insert(1);
+    EXPECT_THROW(inserter.insert(3), CppSQLite3Exception);
+    EXPECT_EQ(0, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    inserter.insert(3);
+    inserter.flush();
+    EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    // a transaction opened by the caller is left to the caller
+    db.execDML("BEGIN");
+    inserter.insert(4);
+    inserter.flush();
+    db.execDML("ROLLBACK");
+    EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+TEST(BatchInserterTest, destructorRollsBackDuringUnwinding)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `NAME` TEXT);");
+
+    CppSQLite3BatchInsertOptions options;
+    options.maxRowsPerStatement = 2;
+    try
+    {
+        CppSQLite3BatchInserter inserter(db, "myTable", {"ID", "NAME"}, options);
+        char szName[] = "buffer";
+        inserter.insert(1, "literal");
+        inserter.insert(2, szName);
+        inserter.insert(3, "buffered");
+        throw std::runtime_error("failed halfway");
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    EXPECT_EQ(0, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    EXPECT_FALSE(db.isInTransaction());
+
+    {
+        CppSQLite3BatchInserter inserter(db, "myTable", {"ID", "NAME"}, options);
+        inserter.insert(1, "literal");
+        inserter.insert(2, "buffered");
+        inserter.insert(3, static_cast<const char*>(nullptr));
+    }
+    EXPECT_EQ(3, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    EXPECT_EQ(2, db.execScalar("SELECT COUNT(*) FROM `myTable` WHERE `NAME` IN ('literal', 'buffered')"));
+}
+
+TEST(TransactionTest, commitAndRollback)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+
+    auto transaction = db.beginTransaction();
+    EXPECT_TRUE(transaction.isActive());
+    db.execDML("INSERT INTO `myTable` VALUES(1);");
+    transaction.commit();
+    EXPECT_FALSE(transaction.isActive());
+    EXPECT_THROW_WITH_MSG(transaction.commit(), std::logic_error, "Transaction is not active");
+
+    {
+        auto rolledBack = db.beginTransaction(CppSQLite3TransactionMode::exclusive);
+        db.execDML("INSERT INTO `myTable` VALUES(2);");
+    }
+    try
+    {
+        auto failed = db.beginTransaction(CppSQLite3TransactionMode::immediate);
+        db.execDML("INSERT INTO `myTable` VALUES(3);");
+        db.execDML("INSERT INTO `missingTable` VALUES(4);");
+        failed.commit();
+    }
+    catch (const CppSQLite3Exception&)
+    {
+    }
+    EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    // the connection is usable again, nothing was left open
+    auto next = db.beginTransaction();
+    next.rollback();
+    EXPECT_THROW(db.execDML("COMMIT"), CppSQLite3Exception);
+}
+
+TEST(TransactionTest, immediateTakesWriteLock)
+{
+    removeIfExists("transactionTest.sqlite");
+    CppSQLite3DB db;
+    db.open("transactionTest.sqlite");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    CppSQLite3DB other;
+    other.open("transactionTest.sqlite");
+    other.setBusyTimeout(0);
+
+    auto deferred = other.beginTransaction();
+    auto transaction = db.beginTransaction(CppSQLite3TransactionMode::immediate);
+    try
+    {
+        other.beginTransaction(CppSQLite3TransactionMode::immediate);
+        FAIL() << "BEGIN IMMEDIATE should be busy";
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        EXPECT_EQ(SQLITE_BUSY, e.errorCode());
+    }
+    deferred.rollback();
+    transaction.commit();
+    EXPECT_NO_THROW(other.beginTransaction(CppSQLite3TransactionMode::immediate).commit());
+}
+
+TEST(TransactionTest, busyCommitKeepsTransactionActive)
+{
+    removeIfExists("transactionTest.sqlite");
+    CppSQLite3DB db;
+    db.setErrorHandler([](int, std::string_view message, std::string_view) { getRecords().emplace_back(message); });
+    db.open("transactionTest.sqlite");
+    db.setBusyTimeout(0);
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1);");
+    CppSQLite3DB reader;
+    reader.open("transactionTest.sqlite");
+
+    // the shared lock of the unfinished query keeps the writer from committing
+    auto query = reader.execQuery("SELECT * FROM `myTable`");
+    auto transaction = db.beginTransaction();
+    db.execDML("INSERT INTO `myTable` VALUES(2);");
+    transaction.commit();
+    ASSERT_EQ(1u, getRecords().size());
+    getRecords().clear();
+    EXPECT_TRUE(transaction.isActive());
+    EXPECT_TRUE(db.isInTransaction());
+
+    query.finalize();
+    transaction.commit();
+    EXPECT_TRUE(getRecords().empty());
+    EXPECT_FALSE(transaction.isActive());
+    EXPECT_EQ(2, reader.execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+TEST(TransactionTest, nestedSavepoints)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT);");
+
+    auto transaction = db.beginTransaction();
+    db.execDML("INSERT INTO `myTable` VALUES(1);");
+    {
+        auto outer = db.savepoint();
+        db.execDML("INSERT INTO `myTable` VALUES(2);");
+        {
+            auto inner = db.savepoint();
+            db.execDML("INSERT INTO `myTable` VALUES(3);");
+        }
+        EXPECT_EQ(2, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+        {
+            auto inner = db.savepoint();
+            db.execDML("INSERT INTO `myTable` VALUES(4);");
+            inner.release();
+            EXPECT_THROW_WITH_MSG(inner.rollback(), std::logic_error, "Savepoint is not active");
+        }
+        outer.release();
+    }
+    EXPECT_EQ(3, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    {
+        auto outer = db.savepoint();
+        auto inner = db.savepoint();
+        db.execDML("INSERT INTO `myTable` VALUES(5);");
+        // rolling back the outer savepoint ends the inner one as well
+        outer.rollback();
+    }
+    transaction.commit();
+    EXPECT_EQ(3, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    // a savepoint outside of a transaction starts one
+    {
+        auto savepoint = db.savepoint();
+        db.execDML("INSERT INTO `myTable` VALUES(6);");
+        savepoint.release();
+    }
+    EXPECT_EQ(4, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+TEST(ConnectionPoolTest, leasesWriterAndReaders)
+{
+    removeIfExists("poolTest.sqlite");
+    CppSQLite3ConnectionPoolOptions options;
+    options.readers = 2;
+    options.acquireTimeoutMs = 10;
+    CppSQLite3ConnectionPool pool("poolTest.sqlite", options);
+    EXPECT_EQ(2u, pool.numReaders());
+
+    {
+        auto writer = pool.acquireWriter();
+        ASSERT_TRUE(writer);
+        writer->execDML("CREATE TABLE `myTable` (`ID` INT);");
+        writer->execDML("INSERT INTO `myTable` VALUES(1), (2);");
+        EXPECT_FALSE(pool.tryAcquireWriter());
+        EXPECT_STREQ("wal", writer->execQuery("PRAGMA journal_mode").getStringField(0));
+    }
+
+    auto first = pool.acquireReader();
+    auto second = pool.acquireReader();
+    EXPECT_EQ(0u, pool.idleReaders());
+    EXPECT_EQ(2, first->execScalar("SELECT COUNT(*) FROM `myTable`"));
+    EXPECT_THROW(second->execDML("INSERT INTO `myTable` VALUES(3);"), CppSQLite3Exception);
+
+    EXPECT_FALSE(pool.tryAcquireReader());
+    try
+    {
+        pool.acquireReader();
+        FAIL() << "acquireReader should time out";
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        EXPECT_EQ(SQLITE_BUSY, e.errorCode());
+    }
+
+    second.release();
+    EXPECT_FALSE(second);
+    EXPECT_EQ(1u, pool.idleReaders());
+    EXPECT_TRUE(pool.tryAcquireReader());
+    EXPECT_EQ(1u, pool.idleReaders());
+}
+
+TEST(ConnectionPoolTest, blocksUntilConnectionIsReleased)
+{
+    removeIfExists("poolTest.sqlite");
+    CppSQLite3ConnectionPoolOptions options;
+    options.readers = 0;
+    CppSQLite3ConnectionPool pool("poolTest.sqlite", options);
+    pool.acquireWriter()->execDML("CREATE TABLE `myTable` (`ID` INT);");
+
+    auto writer = pool.acquireWriter();
+    writer->execDML("BEGIN");
+    writer->execDML("INSERT INTO `myTable` VALUES(1);");
+    std::thread holder(
+        [&writer]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            // the open transaction is rolled back when the lease ends
+            writer.release();
+        });
+    // without readers, reads are served by the writer
+    auto reader = pool.acquireReader();
+    holder.join();
+    EXPECT_FALSE(reader->isInTransaction());
+    EXPECT_EQ(0, reader->execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+TEST(ConnectionPoolTest, releaseEndsSavepointsOfHolder)
+{
+    removeIfExists("poolTest.sqlite");
+    CppSQLite3ConnectionPoolOptions options;
+    options.readers = 0;
+    CppSQLite3ConnectionPool pool("poolTest.sqlite", options);
+    pool.acquireWriter()->execDML("CREATE TABLE `myTable` (`ID` INT);");
+
+    auto writer = pool.acquireWriter();
+    auto savepoint = writer->savepoint();
+    writer->execDML("INSERT INTO `myTable` VALUES(1);");
+    writer.release();
+
+    // the savepoint left over by the previous holder doesn't touch the transaction of the next one
+    auto next = pool.acquireWriter();
+    auto transaction = next->beginTransaction();
+    next->execDML("INSERT INTO `myTable` VALUES(2);");
+    EXPECT_NO_THROW(savepoint.rollback());
+    transaction.commit();
+    EXPECT_EQ(2, next->execScalar("SELECT SUM(`ID`) FROM `myTable`"));
+}
+
+TEST(ConnectionPoolTest, readersRunInParallelWithWriter)
+{
+    removeIfExists("poolTest.sqlite");
+    CppSQLite3ConnectionPool pool("poolTest.sqlite");
+    pool.acquireWriter()->execDML("CREATE TABLE `myTable` (`ID` INT);");
+
+    std::vector<std::thread> threads;
+    std::atomic<int> nReads{0};
+    for (int nThread = 0; nThread < 4; ++nThread)
+    {
+        threads.emplace_back(
+            [&pool, &nReads]()
+            {
+                for (int i = 0; i < 50; ++i)
+                {
+                    auto reader = pool.acquireReader();
+                    reader->execScalar("SELECT COUNT(*) FROM `myTable`");
+                    ++nReads;
+                }
+            });
+    }
+    {
+        auto writer = pool.acquireWriter();
+        for (int i = 0; i < 50; ++i)
+        {
+            writer->execDML("INSERT INTO `myTable` VALUES(1);");
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(200, nReads);
+    EXPECT_EQ(4u, pool.idleReaders());
+    EXPECT_EQ(50, pool.acquireReader()->execScalar("SELECT COUNT(*) FROM `myTable`"));
+}
+
+namespace
+{
+int errorCodeOf(const std::function<void()>& run)
+{
+    try
+    {
+        run();
+    }
+    catch (const CppSQLite3Exception& e)
+    {
+        return e.errorCode();
+    }
+    return SQLITE_OK;
+}
+} // namespace
+
+TEST(WriteQueueTest, groupsJobsIntoCommits)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.setStatementCacheSize(4);
+
+    CppSQLite3WriteQueueOptions options;
+    options.maxDelayMs = 20;
+    CppSQLite3WriteQueue queue(db, options);
+
+    std::vector<std::thread> producers;
+    std::atomic<int> nChanges{0};
+    for (int nThread = 0; nThread < 4; ++nThread)
+    {
+        producers.emplace_back(
+            [&queue, &nChanges, nThread]()
+            {
+                std::vector<std::future<int>> results;
+                for (int i = 0; i < 25; ++i)
+                {
+                    results.push_back(queue.submit("INSERT INTO `myTable` VALUES(?, ?)", nThread * 100 + i,
+                                                   std::string("thread") + std::to_string(nThread)));
+                }
+                for (auto& result : results)
+                {
+                    nChanges += result.get();
+                }
+            });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    EXPECT_EQ(100, nChanges);
+
+    auto count = queue.submit([](CppSQLite3DB& db) { return db.execScalar("SELECT COUNT(*) FROM `myTable`"); });
+    EXPECT_EQ(100, count.get());
+    auto stats = queue.stats();
+    EXPECT_EQ(101u, stats.jobs);
+    EXPECT_EQ(0u, stats.failedJobs);
+    EXPECT_LT(stats.commits, 50u);
+}
+
+TEST(WriteQueueTest, failingJobIsRolledBackAlone)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY);");
+
+    CppSQLite3WriteQueueOptions options;
+    options.maxDelayMs = 50;
+    std::future<int> duplicate;
+    std::future<void> failing;
+    std::future<long long> rowId;
+    {
+        CppSQLite3WriteQueue queue(db, options);
+        queue.submit("INSERT INTO `myTable` VALUES(1)");
+        duplicate = queue.submit("INSERT INTO `myTable` VALUES(?)", 1);
+        failing = queue.submit(
+            [](CppSQLite3DB& db)
+            {
+                db.execDML("INSERT INTO `myTable` VALUES(2)");
+                throw std::runtime_error("job failed");
+            });
+        rowId = queue.submit(
+            [](CppSQLite3DB& db)
+            {
+                db.execDML("INSERT INTO `myTable` VALUES(3)");
+                return db.lastRowId();
+            });
+        // the destructor runs the remaining jobs
+    }
+    EXPECT_THROW(duplicate.get(), CppSQLite3Exception);
+    EXPECT_THROW_WITH_MSG(failing.get(), std::runtime_error, "job failed");
+    EXPECT_EQ(3, rowId.get());
+    EXPECT_EQ(2, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    EXPECT_FALSE(db.isInTransaction());
+}
+
+TEST(WriteQueueTest, cancelledJobFailsItsGroupSoFar)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER);");
+
+    CppSQLite3WriteQueueOptions options;
+    options.maxDelayMs = 1000;
+    options.maxJobsPerCommit = 3;
+    std::future<int> first;
+    std::future<int> cancelled;
+    std::future<int> last;
+    {
+        CppSQLite3WriteQueue queue(db, options);
+        first = queue.submit("INSERT INTO `myTable` VALUES(1)");
+        cancelled = queue.submit(
+            [](CppSQLite3DB& db)
+            {
+                // interrupting a write rolls back the whole transaction, not only the job's savepoint
+                CppSQLite3CancellationToken token;
+                token.cancel();
+                auto scope = db.withCancellation(token);
+                return db.execDML("INSERT INTO `myTable` WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL "
+                                  "SELECT `x` + 1 FROM `c` LIMIT 100000) SELECT `x` FROM `c`");
+            });
+        last = queue.submit("INSERT INTO `myTable` VALUES(3)");
+        // the destructor runs the remaining jobs
+    }
+    EXPECT_EQ(CPPSQLITE_CANCELLED, errorCodeOf([&first]() { first.get(); }));
+    EXPECT_EQ(CPPSQLITE_CANCELLED, errorCodeOf([&cancelled]() { cancelled.get(); }));
+    EXPECT_EQ(1, last.get());
+    EXPECT_EQ(3, db.execScalar("SELECT SUM(`ID`) FROM `myTable`"));
+    EXPECT_FALSE(db.isInTransaction());
+}
+
+namespace
+{
+
+/**
+ * @brief eventually polls isDone for up to five seconds, for results of background threads
+ */
+template <typename Predicate>
+bool eventually(Predicate isDone)
+{
+    for (int i = 0; i < 500 && !isDone(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return isDone();
+}
+
+std::atomic<int> nCheckpointWarnings{0};
+std::atomic<int> nCheckpointErrors{0};
+
+} // namespace
+
+TEST(CheckpointSchedulerTest, checkpointsGrowingWal)
+{
+    removeIfExists("checkpoint.sqlite");
+    CppSQLite3DB db;
+    db.open("checkpoint.sqlite");
+    db.execQuery("PRAGMA journal_mode=WAL");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+
+    CppSQLite3CheckpointOptions options;
+    options.passiveFrames = 10;
+    options.minIntervalMs = 0;
+    CppSQLite3CheckpointScheduler scheduler(db, options);
+    for (int i = 0; i < 50; ++i)
+    {
+        db.execDML("INSERT INTO `myTable` (`INFO`) VALUES('some text')");
+    }
+
+    EXPECT_TRUE(eventually([&scheduler]() { return scheduler.stats().passive > 0; }));
+    auto stats = scheduler.stats();
+    EXPECT_GE(stats.framesWritten, 50);
+    EXPECT_GT(stats.lastCheckpointedFrames, 0);
+    EXPECT_EQ(0u, stats.restart);
+    EXPECT_EQ(0u, stats.failed);
+}
+
+TEST(CheckpointSchedulerTest, restoresAutoCheckpointInterval)
+{
+    removeIfExists("checkpoint.sqlite");
+    CppSQLite3DB db;
+    db.open("checkpoint.sqlite");
+    db.execQuery("PRAGMA journal_mode=WAL");
+    db.execDML("PRAGMA wal_autocheckpoint=250");
+    {
+        CppSQLite3CheckpointScheduler scheduler(db);
+        EXPECT_EQ(0, db.execScalar("PRAGMA wal_autocheckpoint"));
+    }
+    EXPECT_EQ(250, db.execScalar("PRAGMA wal_autocheckpoint"));
+}
+
+TEST(CheckpointSchedulerTest, escalatesWhenReadersPinTheWal)
+{
+    removeIfExists("checkpoint.sqlite");
+    CppSQLite3DB db;
+    db.setLogHandler(
+        [](CppSQLite3LogLevel level, std::string_view)
+        {
+            if (level.code == CppSQLite3LogLevel::warning)
+            {
+                ++nCheckpointWarnings;
+            }
+        });
+    db.open("checkpoint.sqlite");
+    db.execQuery("PRAGMA journal_mode=WAL");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+
+    CppSQLite3DB reader;
+    reader.open("checkpoint.sqlite");
+    reader.execDML("BEGIN");
+    EXPECT_EQ(0, reader.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    CppSQLite3CheckpointOptions options;
+    options.passiveFrames = 2;
+    options.restartFrames = 5;
+    options.truncateFrames = 5;
+    options.minIntervalMs = 0;
+    options.busyTimeoutMs = 10;
+    options.minBackoffMs = 10;
+    options.maxBackoffMs = 50;
+    CppSQLite3CheckpointScheduler scheduler(db, options);
+
+    auto insert = [&db]() { db.execDML("INSERT INTO `myTable` (`INFO`) VALUES('some text')"); };
+    // the reader's snapshot keeps the checkpoint from completing
+    EXPECT_TRUE(eventually(
+        [&]()
+        {
+            insert();
+            return scheduler.stats().truncate > 0;
+        }));
+    EXPECT_GT(scheduler.stats().incomplete, 0u);
+    EXPECT_GT(nCheckpointWarnings, 0);
+
+    // without readers a passive checkpoint completes and the next commit starts the WAL over
+    reader.execDML("COMMIT");
+    EXPECT_TRUE(eventually(
+        [&]()
+        {
+            insert();
+            auto stats = scheduler.stats();
+            return stats.lastCheckpointedFrames == stats.lastLogFrames && stats.walFrames < options.restartFrames;
+        }));
+    EXPECT_EQ(0u, scheduler.stats().failed);
+}
+
+TEST(CheckpointSchedulerTest, countsBusyCheckpointsWithoutThrowingHandler)
+{
+    removeIfExists("checkpoint.sqlite");
+    CppSQLite3DB db;
+    db.setErrorHandler(
+        [](int nErrCode, std::string_view, std::string_view) { nCheckpointErrors += nErrCode == SQLITE_BUSY ? 1 : 0; });
+    db.open("checkpoint.sqlite");
+    db.execQuery("PRAGMA journal_mode=WAL");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+
+    CppSQLite3DB reader;
+    reader.open("checkpoint.sqlite");
+    reader.execDML("BEGIN");
+    EXPECT_EQ(0, reader.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    CppSQLite3CheckpointOptions options;
+    options.passiveFrames = 2;
+    options.restartFrames = 5;
+    options.truncateFrames = 5;
+    options.minIntervalMs = 0;
+    options.busyTimeoutMs = 10;
+    options.minBackoffMs = 10;
+    options.maxBackoffMs = 50;
+    CppSQLite3CheckpointScheduler scheduler(db, options);
+
+    // the busy TRUNCATE returns instead of throwing, it still counts as incomplete
+    EXPECT_TRUE(eventually(
+        [&]()
+        {
+            db.execDML("INSERT INTO `myTable` (`INFO`) VALUES('some text')");
+            return nCheckpointErrors > 0;
+        }));
+    EXPECT_TRUE(eventually([&scheduler]() { return scheduler.stats().incomplete > 0; }));
+    EXPECT_EQ(0u, scheduler.stats().failed);
+    reader.execDML("COMMIT");
+}
+
+TEST(CheckpointSchedulerTest, requiresDatabaseFile)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    EXPECT_THROW_WITH_MSG(CppSQLite3CheckpointScheduler scheduler(db), std::invalid_argument,
+                          "Checkpoint scheduler needs a database file");
+}
+
+TEST(BusyPolicyTest, givesUpAfterTimeout)
+{
+    removeIfExists("busyTest.sqlite");
+    CppSQLite3DB holder;
+    holder.open("busyTest.sqlite");
+    holder.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    holder.execDML("BEGIN IMMEDIATE");
+
+    CppSQLite3DB waiter;
+    CppSQLite3BusyPolicy policy;
+    policy.timeoutMs = 50;
+    policy.spinUs = 100;
+    waiter.setBusyPolicy(policy);
+    waiter.open("busyTest.sqlite");
+    EXPECT_THROW(waiter.execDML("INSERT INTO `myTable` VALUES(1)"), CppSQLite3Exception);
+
+    auto stats = waiter.busyStats();
+    EXPECT_EQ(1u, stats.busyEvents);
+    EXPECT_EQ(1u, stats.timeouts);
+    EXPECT_GE(stats.maxWaitUs, 40'000);
+    EXPECT_GE(stats.totalWaitUs, stats.maxWaitUs);
+    holder.execDML("ROLLBACK");
+}
+
+TEST(BusyPolicyTest, waitsUntilLockIsReleased)
+{
+    removeIfExists("busyTest.sqlite");
+    CppSQLite3DB holder;
+    holder.open("busyTest.sqlite");
+    holder.execDML("CREATE TABLE `myTable` (`ID` INT);");
+    holder.execDML("BEGIN IMMEDIATE");
+    holder.execDML("INSERT INTO `myTable` VALUES(1)");
+
+    CppSQLite3DB waiter;
+    waiter.open("busyTest.sqlite");
+    CppSQLite3BusyPolicy policy;
+    policy.initialBackoffUs = 1000;
+    policy.maxBackoffUs = 5000;
+    waiter.setBusyPolicy(policy);
+
+    std::thread committer(
+        [&holder]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            holder.execDML("COMMIT");
+        });
+    EXPECT_EQ(1, waiter.execDML("INSERT INTO `myTable` VALUES(2)"));
+    committer.join();
+
+    auto stats = waiter.busyStats();
+    EXPECT_EQ(1u, stats.busyEvents);
+    EXPECT_EQ(0u, stats.timeouts);
+    EXPECT_GE(stats.maxWaitUs, 20'000);
+    EXPECT_EQ(2, waiter.execScalar("SELECT COUNT(*) FROM `myTable`"));
+
+    // the built-in handler has no counters
+    waiter.setBusyTimeout(1000);
+    EXPECT_EQ(0u, waiter.busyStats().busyEvents);
+}
+
+TEST(BusyPolicyTest, statsReadableWhilePolicyChanges)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+
+    std::atomic<bool> bDone{false};
+    std::thread monitor(
+        [&db, &bDone]()
+        {
+            while (!bDone)
+            {
+                EXPECT_EQ(0u, db.busyStats().timeouts);
+            }
+        });
+    for (int i = 0; i < 1000; ++i)
+    {
+        db.setBusyPolicy(CppSQLite3BusyPolicy());
+        db.setBusyTimeout(100);
+    }
+    bDone = true;
+    monitor.join();
+    EXPECT_EQ(0u, db.busyStats().busyEvents);
+}
+
+namespace
+{
+const char* gszEndlessQuery = "WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c`) "
+                              "SELECT COUNT(*) FROM `c`";
+} // namespace
+
+TEST(DeadlineTest, abortsStatementAfterDeadline)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto deadline = db.withDeadline(std::chrono::milliseconds(20));
+        EXPECT_EQ(CPPSQLITE_DEADLINE_EXCEEDED, errorCodeOf([&db]() { db.execScalar(gszEndlessQuery); }));
+        EXPECT_THROW_WITH_MSG(db.execQuery(gszEndlessQuery), CppSQLite3Exception,
+                              "CPPSQLITE_DEADLINE_EXCEEDED[1001]: deadline exceeded");
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+    // without a scope statements run unlimited
+    EXPECT_EQ(100000, db.execScalar("WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c` "
+                                    "LIMIT 100000) SELECT COUNT(*) FROM `c`"));
+}
+
+TEST(DeadlineTest, cancelsFromOtherThread)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.setDeadlineCheckInterval(100);
+    CppSQLite3CancellationToken token;
+    auto scope = db.withCancellation(token);
+
+    std::thread canceller(
+        [token]() mutable
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            token.cancel();
+        });
+    EXPECT_EQ(CPPSQLITE_CANCELLED, errorCodeOf([&db]() { db.execScalar(gszEndlessQuery); }));
+    canceller.join();
+    EXPECT_TRUE(token.isCancelled());
+
+    // the cancelled token keeps aborting until its scope ends
+    EXPECT_EQ(CPPSQLITE_CANCELLED, errorCodeOf([&db]() { db.execScalar(gszEndlessQuery); }));
+    scope.end();
+    EXPECT_FALSE(scope.isActive());
+    EXPECT_EQ(1, db.execScalar("SELECT 1"));
+}
+
+TEST(DeadlineTest, nestedScopes)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    CppSQLite3CancellationToken token;
+    auto outer = db.withDeadline(std::chrono::milliseconds(20), token);
+    {
+        auto inner = db.withDeadline(std::chrono::hours(1));
+        EXPECT_EQ(CPPSQLITE_DEADLINE_EXCEEDED, errorCodeOf([&db]() { db.execScalar(gszEndlessQuery); }));
+    }
+    token.cancel();
+    auto createTable = std::string("CREATE TABLE `t` AS ") + gszEndlessQuery;
+    EXPECT_EQ(CPPSQLITE_CANCELLED, errorCodeOf([&]() { db.execDML(createTable); }));
+
+    // an explicit interrupt is still reported as such
+    outer.end();
+    auto inner = db.withDeadline(std::chrono::hours(1));
+    std::thread interrupter(
+        [&db]()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            db.interrupt();
+        });
+    EXPECT_EQ(SQLITE_INTERRUPT, errorCodeOf([&db]() { db.execScalar(gszEndlessQuery); }));
+    interrupter.join();
+}
+
+namespace
+{
+const CppSQLite3StatementProfile* findProfile(const std::vector<CppSQLite3StatementProfile>& profiles,
+                                               std::string_view sql)
+{
+    auto it = std::find_if(profiles.begin(), profiles.end(),
+                           [sql](const CppSQLite3StatementProfile& profile) { return profile.sql == sql; });
+    return it == profiles.end() ? nullptr : &*it;
+}
+} // namespace
+
+TEST(ProfilerTest, normalizesLiterals)
+{
+    CppSQLite3Profiler profiler;
+    profiler.record("SELECT 'it''s', x'00ff', 1.5e-3, 0x1F /* comment */ FROM `t 1`   WHERE\n id=-42 -- tail", 10, 1);
+    profiler.record("SELECT 'other', X'01', 7, 8 FROM `t 1` WHERE id=-1", 3000, 2);
+    profiler.record("SELECT col2 FROM [my table]", 10, 0);
+    profiler.record("UPDATE t SET a=?1, b=?12 WHERE c=? AND d=5", 5, 0);
+
+    auto profiles = profiler.snapshot();
+    ASSERT_EQ(3u, profiles.size());
+    EXPECT_EQ("SELECT ?, ?, ?, ? FROM `t 1` WHERE id=-?", profiles[0].sql);
+    EXPECT_EQ(2u, profiles[0].executions);
+    EXPECT_EQ(3u, profiles[0].rows);
+    EXPECT_EQ(3010u, profiles[0].totalNs);
+    EXPECT_EQ(3000u, profiles[0].maxNs);
+    EXPECT_EQ(1u, profiles[0].buckets[0]);
+    EXPECT_EQ(1u, profiles[0].buckets[2]);
+    EXPECT_EQ(1024u, profiles[0].percentileNs(0.5));
+    EXPECT_EQ(4096u, profiles[0].percentileNs(0.99));
+    EXPECT_EQ("SELECT col2 FROM [my table]", profiles[1].sql);
+    EXPECT_EQ("UPDATE t SET a=?1, b=?12 WHERE c=? AND d=?", profiles[2].sql);
+}
+
+TEST(ProfilerTest, profilesStatementsOfConnections)
+{
+    auto pProfiler = std::make_shared<CppSQLite3Profiler>();
+    CppSQLite3DB db;
+    db.setProfiler(pProfiler);
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` VALUES(1, 'one');");
+    db.execDML("INSERT INTO `myTable` VALUES(2, 'two');");
+    auto stmt = db.compileStatement("INSERT INTO `myTable` VALUES(?, ?);");
+    stmt.execute(3, "three");
+
+    std::thread other(
+        [pProfiler]()
+        {
+            CppSQLite3DB otherDB;
+            otherDB.open(":memory:");
+            otherDB.setProfiler(pProfiler);
+            EXPECT_EQ(1000, otherDB.execScalar("WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 "
+                                               "FROM `c` LIMIT 1000) SELECT COUNT(*) FROM `c`"));
+        });
+    other.join();
+    for (auto query = db.execQuery("SELECT * FROM `myTable`"); !query.eof(); query.nextRow())
+    {
+    }
+
+    auto profiles = pProfiler->snapshot(true);
+    const auto* pInsert = findProfile(profiles, "INSERT INTO `myTable` VALUES(?, ?);");
+    ASSERT_NE(nullptr, pInsert);
+    EXPECT_EQ(3u, pInsert->executions);
+    EXPECT_EQ(0u, pInsert->rows);
+
+    const auto* pSelect = findProfile(profiles, "SELECT * FROM `myTable`");
+    ASSERT_NE(nullptr, pSelect);
+    EXPECT_EQ(1u, pSelect->executions);
+    EXPECT_EQ(3u, pSelect->rows);
+
+    const auto* pCount = findProfile(profiles, "WITH RECURSIVE `c`(`x`) AS (SELECT ? UNION ALL SELECT `x` + ? FROM `c` "
+                                               "LIMIT ?) SELECT COUNT(*) FROM `c`");
+    ASSERT_NE(nullptr, pCount);
+    EXPECT_EQ(1u, pCount->rows);
+    EXPECT_GT(pCount->totalNs, 0u);
+    EXPECT_EQ(1u, std::accumulate(pCount->buckets.begin(), pCount->buckets.end(), std::uint64_t{0}));
+
+    // reset by the snapshot
+    EXPECT_TRUE(pProfiler->snapshot().empty());
+    db.setProfiler(nullptr);
+    db.execDML("DELETE FROM `myTable`");
+    EXPECT_TRUE(pProfiler->snapshot().empty());
+}
+
+TEST(ProfilerTest, limitsDistinctStatements)
+{
+    CppSQLite3Profiler profiler(2);
+    profiler.record("SELECT a FROM t", 1, 0);
+    profiler.record("SELECT b FROM t", 1, 0);
+    profiler.record("SELECT c FROM t", 1, 0);
+    profiler.record("SELECT d FROM t", 1, 0);
+    profiler.record("SELECT a FROM t", 1, 0);
+
+    auto profiles = profiler.snapshot();
+    ASSERT_EQ(3u, profiles.size());
+    EXPECT_EQ(2u, findProfile(profiles, "SELECT a FROM t")->executions);
+    EXPECT_EQ(2u, findProfile(profiles, "(other statements)")->executions);
+    profiler.reset();
+    EXPECT_TRUE(profiler.snapshot().empty());
+}
+
+TEST(SlowQueryLogTest, logsSlowStatementsWithQueryPlan)
+{
+    CppSQLite3DB db;
+    db.setLogHandler([](CppSQLite3LogLevel, std::string_view message) { getRecords().emplace_back(message); });
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+    db.execDML("INSERT INTO `myTable` (`INFO`) WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c` "
+               "LIMIT 1000) SELECT 'row ' || `x` FROM `c`");
+    db.setSlowQueryThreshold(std::chrono::microseconds(1));
+
+    for (auto query = db.execQuery("SELECT * FROM `myTable` WHERE `INFO` > 'row 5'"); !query.eof(); query.nextRow())
+    {
+    }
+    ASSERT_EQ(1u, getRecords().size());
+    EXPECT_EQ(0u, getRecords()[0].find("slow query ("));
+    EXPECT_NE(std::string::npos, getRecords()[0].find(" ms, 554 rows): SELECT * FROM `myTable` WHERE `INFO` > 'row 5'\n"
+                                                      "QUERY PLAN\n  SCAN myTable"));
+    getRecords().clear();
+
+    // the expanded SQL shows the parameters, the plan is the one of the first run
+    auto stmt = db.compileStatement("DELETE FROM `myTable` WHERE `ID` = ?");
+    for (int nID : {1, 2})
+    {
+        stmt.bind(1, nID);
+        EXPECT_EQ(1, stmt.execDML());
+    }
+    ASSERT_EQ(2u, getRecords().size());
+    EXPECT_NE(std::string::npos, getRecords()[1].find(" ms, 0 rows): DELETE FROM `myTable` WHERE `ID` = 2\n"
+                                                      "QUERY PLAN\n  SEARCH myTable USING INTEGER PRIMARY KEY"));
+    getRecords().clear();
+
+    db.setSlowQueryThreshold(std::chrono::hours(1));
+    db.execDML("DELETE FROM `myTable`");
+    db.setSlowQueryThreshold(std::chrono::microseconds(0));
+    db.execDML("DELETE FROM `myTable`");
+    EXPECT_TRUE(getRecords().empty());
+    getRecords().clear();
+}
+
+TEST(StatementStatusTest, readsAndResetsCounters)
+{
+    CppSQLite3DB db;
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `a` (`ID` INTEGER PRIMARY KEY, `KEY` INT);");
+    db.execDML("CREATE TABLE `b` (`KEY` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `a` (`KEY`) WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c` "
+               "LIMIT 100) SELECT `x` FROM `c`");
+    db.execDML("INSERT INTO `b` SELECT `KEY`, 'info ' || `KEY` FROM `a`");
+
+    // joining on a column without index makes SQLite build an automatic index on b
+    auto query = db.execQuery("SELECT `a`.`ID`, `b`.`INFO` FROM `a` JOIN `b` ON `a`.`KEY` = `b`.`KEY`");
+    int nRows = 0;
+    for (; !query.eof(); query.nextRow())
+    {
+        ++nRows;
+    }
+    EXPECT_EQ(100, nRows);
+    auto status = query.status();
+    EXPECT_GE(status.autoindexRows, 99u);
+    EXPECT_GE(status.fullscanSteps, 99u);
+    EXPECT_GT(status.vmSteps, 0u);
+    EXPECT_EQ(0u, status.sorts);
+    EXPECT_GT(status.memoryUsed, 0u);
+    query.finalize();
+    EXPECT_THROW_WITH_MSG(query.status(), std::logic_error, "Null Virtual Machine pointer");
+
+    auto stmt = db.compileStatement("SELECT `INFO` FROM `b` WHERE `KEY` > ? ORDER BY `INFO`");
+    for (int nKey : {10, 20})
+    {
+        stmt.bind(1, nKey);
+        auto sorted = stmt.execQuery();
+        EXPECT_STREQ("info 100", sorted.getStringField(0));
+        stmt.reset();
+    }
+    status = stmt.status(true);
+    EXPECT_EQ(2u, status.sorts);
+    EXPECT_EQ(2u, status.runs);
+    EXPECT_GE(status.fullscanSteps, 198u);
+
+    status = stmt.status();
+    EXPECT_EQ(0u, status.sorts);
+    EXPECT_EQ(0u, status.runs);
+    EXPECT_EQ(0u, status.vmSteps);
+    EXPECT_GT(status.memoryUsed, 0u);
+}
+
+TEST(StatementStatusTest, monitorWarnsAboutAutomaticIndexesAndLargeSorts)
+{
+    CppSQLite3DB db;
+    db.setLogHandler([](CppSQLite3LogLevel, std::string_view message) { getRecords().emplace_back(message); });
+    db.open(":memory:");
+    db.execDML("CREATE TABLE `a` (`ID` INTEGER PRIMARY KEY, `KEY` INT);");
+    db.execDML("CREATE TABLE `b` (`KEY` INT, `INFO` TEXT);");
+    db.execDML("INSERT INTO `a` (`KEY`) WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c` "
+               "LIMIT 1000) SELECT `x` FROM `c`");
+    db.execDML("INSERT INTO `b` SELECT `KEY`, 'info ' || `KEY` FROM `a`");
+    CppSQLite3StatusMonitorOptions options;
+    options.sortVmSteps = 5000;
+    db.enableStatementStatusMonitor(true, options);
+
+    const char* szJoin = "SELECT COUNT(*) FROM `a` JOIN `b` ON `a`.`KEY` = `b`.`KEY` WHERE `a`.`ID` > ?";
+    auto stmt = db.compileStatement(szJoin);
+    for (int nID : {0, 10})
+    {
+        stmt.bind(1, nID);
+        EXPECT_EQ(1000 - nID, stmt.execQuery().getIntField(0));
+        stmt.reset();
+    }
+    // the warning is logged once per SQL text with the plan explaining the automatic index
+    ASSERT_EQ(1u, getRecords().size());
+    EXPECT_EQ(0u, getRecords()[0].find("automatic index (999 automatic index rows, 0 sorts, "));
+    EXPECT_NE(std::string::npos, getRecords()[0].find("WHERE `a`.`ID` > 0\nQUERY PLAN\n"));
+    EXPECT_NE(std::string::npos, getRecords()[0].find("AUTOMATIC COVERING INDEX (KEY=?)"));
+    getRecords().clear();
+
+    // a small sort stays below the threshold
+    db.execQuery("SELECT `KEY` FROM `a` WHERE `ID` < 10 ORDER BY `KEY` DESC").finalize();
+    EXPECT_TRUE(getRecords().empty());
+    for (auto query = db.execQuery("SELECT `INFO` FROM `b` ORDER BY `INFO` DESC"); !query.eof(); query.nextRow())
+    {
+    }
+    ASSERT_EQ(1u, getRecords().size());
+    EXPECT_EQ(0u, getRecords()[0].find("large sort (0 automatic index rows, 1 sorts, 999 full scan steps, "));
+    getRecords().clear();
+
+    // the counters of the statements are left alone, the monitor sums up their runs
+    EXPECT_EQ(1998u, stmt.status().autoindexRows);
+    auto totals = db.statementStatus(true);
+    EXPECT_EQ(1998u, totals.autoindexRows);
+    EXPECT_EQ(2u, totals.sorts);
+    EXPECT_EQ(4u, totals.runs);
+    EXPECT_GT(totals.memoryUsed, 0u);
+    EXPECT_EQ(0u, db.statementStatus().runs);
+
+    db.enableStatementStatusMonitor(false);
+    stmt.execQuery();
+    stmt.reset();
+    EXPECT_EQ(0u, db.statementStatus().runs);
+    EXPECT_TRUE(getRecords().empty());
+    getRecords().clear();
+}
+
+TEST(DBStatsTest, reportsCacheAndMemoryUsage)
+{
+    removeIfExists("statsTest.sqlite");
+    CppSQLite3DB db;
+    EXPECT_THROW_WITH_MSG(db.stats(), std::logic_error, "Database not open");
+    db.open("statsTest.sqlite");
+    db.execDML("PRAGMA cache_size = 10");
+    db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+
+    // a transaction larger than the cache has to spill dirty pages before the commit
+    auto transaction = db.beginTransaction();
+    db.execDML("INSERT INTO `myTable` (`INFO`) WITH RECURSIVE `c`(`x`) AS (SELECT 1 UNION ALL SELECT `x` + 1 FROM `c` "
+               "LIMIT 2000) SELECT printf('%.100c', 'x') FROM `c`");
+    transaction.commit();
+    EXPECT_EQ(2000, db.execScalar("SELECT COUNT(*) FROM `myTable` WHERE `INFO` LIKE 'x%'"));
+
+    auto stmt = db.compileStatement("SELECT `INFO` FROM `myTable` WHERE `ID` = ?");
+    auto stats = db.stats();
+    EXPECT_GT(stats.cacheHits, 0);
+    EXPECT_GT(stats.cacheMisses, 0);
+    EXPECT_GT(stats.cacheWrites, 0);
+    EXPECT_GT(stats.cacheSpills, 0);
+    EXPECT_GT(stats.cacheUsed, 0);
+    EXPECT_GT(stats.schemaUsed, 0);
+    EXPECT_GT(stats.statementsUsed, 0);
+    EXPECT_GT(stats.memoryUsed, 0);
+    EXPECT_GE(stats.memoryHighwater, stats.memoryUsed);
+    EXPECT_GT(stats.largestAllocation, 0);
+    EXPECT_GT(stats.allocations, 0);
+
+    db.stats(true);
+    stats = db.stats();
+    EXPECT_EQ(0, stats.cacheHits);
+    EXPECT_EQ(0, stats.cacheMisses);
+    EXPECT_EQ(0, stats.cacheWrites);
+    EXPECT_EQ(0, stats.cacheSpills);
+    EXPECT_GT(stats.cacheUsed, 0);
+
+    stmt.bind(1, 1);
+    stmt.execQuery();
+    EXPECT_GT(db.stats().cacheHits, 0);
+}
+
+TEST(OpenOptionsTest, appliesPresetsAndReadsThemBack)
+{
+    removeIfExists("openOptionsTest.sqlite");
+    {
+        auto options = CppSQLite3OpenOptions::oltpWAL();
+        options.pageSize = 8192;
+        CppSQLite3DB db;
+        db.setLogHandler([](CppSQLite3LogLevel, std::string_view message) { getRecords().emplace_back(message); });
+        db.open("openOptionsTest.sqlite", options);
+        EXPECT_TRUE(getRecords().empty());
+
+        auto settings = db.readSettings();
+        EXPECT_EQ(SQLITE_OPEN_READWRITE, settings.flags);
+        EXPECT_EQ(8192, settings.pageSize);
+        EXPECT_EQ("wal", settings.journalMode);
+        EXPECT_EQ("normal", settings.synchronous);
+        EXPECT_EQ(-64 * 1024, settings.cacheSize);
+        EXPECT_EQ(std::int64_t{256} << 20, settings.mmapSize);
+        EXPECT_EQ("memory", settings.tempStore);
+        EXPECT_EQ(1000, settings.walAutocheckpoint);
+        EXPECT_EQ(true, settings.foreignKeys);
+        db.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+        db.execDML("INSERT INTO `myTable` (`INFO`) VALUES ('some text')");
+    }
+    {
+        // the page size of a database with content stays, the other settings apply
+        auto options = CppSQLite3OpenOptions::bulkLoad();
+        options.journalMode = "DELETE";
+        options.pageSize = 4096;
+        CppSQLite3DB db;
+        db.setLogHandler([](CppSQLite3LogLevel, std::string_view message) { getRecords().emplace_back(message); });
+        db.open("openOptionsTest.sqlite", options);
+        ASSERT_EQ(1u, getRecords().size());
+        EXPECT_EQ("PRAGMA page_size = 4096 was not applied, the connection reports 8192", getRecords()[0]);
+        getRecords().clear();
+
+        auto settings = db.readSettings();
+        EXPECT_EQ("delete", settings.journalMode);
+        EXPECT_EQ("off", settings.synchronous);
+        EXPECT_EQ(false, settings.foreignKeys);
+    }
+    {
+        CppSQLite3DB db;
+        db.open("openOptionsTest.sqlite", CppSQLite3OpenOptions::readOnlyAnalytics());
+        auto settings = db.readSettings();
+        EXPECT_EQ(SQLITE_OPEN_READONLY, settings.flags);
+        EXPECT_EQ(std::int64_t{1} << 30, settings.mmapSize);
+        EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+        EXPECT_THROW(db.execDML("DELETE FROM `myTable`"), CppSQLite3Exception);
+    }
+    {
+        CppSQLite3DB db;
+        db.open(":memory:", CppSQLite3OpenOptions::inMemory());
+        auto settings = db.readSettings();
+        EXPECT_EQ("memory", settings.journalMode);
+        EXPECT_EQ("off", settings.synchronous);
+        EXPECT_EQ(true, settings.foreignKeys);
+    }
+
+    auto options = CppSQLite3OpenOptions::inMemory();
+    options.journalMode = "wal; DROP TABLE `myTable`";
+    CppSQLite3DB db;
+    EXPECT_THROW_WITH_MSG(db.open(":memory:", options), std::invalid_argument,
+                          "invalid PRAGMA value 'wal; DROP TABLE `myTable`'");
+    EXPECT_FALSE(db.isOpened());
+}
+
+TEST(OpenOptionsTest, immutableReadOnlyIgnoresLocks)
+{
+    const char* szFile = "immutable#Test.sqlite";
+    removeIfExists(szFile);
+    CppSQLite3DB writer;
+    writer.open(szFile);
+    writer.execDML("CREATE TABLE `myTable` (`ID` INTEGER PRIMARY KEY, `INFO` TEXT);");
+    writer.execDML("INSERT INTO `myTable` (`INFO`) VALUES ('some text')");
+
+    CppSQLite3DB db;
+    db.setLogHandler([](CppSQLite3LogLevel, std::string_view message) { getRecords().emplace_back(message); });
+    db.open(szFile, CppSQLite3OpenOptions::immutableReadOnly());
+    EXPECT_TRUE(getRecords().empty());
+    auto settings = db.readSettings();
+    EXPECT_EQ(SQLITE_OPEN_READONLY, settings.flags);
+    EXPECT_EQ(0x7fff0000, settings.mmapSize);
+    EXPECT_THROW(db.execDML("DELETE FROM `myTable`"), CppSQLite3Exception);
+
+    // the exclusive lock would make a normal reader busy
+    auto transaction = writer.beginTransaction(CppSQLite3TransactionMode::exclusive);
+    EXPECT_STREQ("some text", db.execQuery("SELECT `INFO` FROM `myTable` WHERE `ID` = 1").getStringField(0));
+    db.close();
+
+    // the parameter goes before the fragment of a URI
+    db.open("file:immutable%23Test.sqlite#fragment", CppSQLite3OpenOptions::immutableReadOnly());
+    EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    db.close();
+    db.open("file:immutable%23Test.sqlite?cache=private#fragment", CppSQLite3OpenOptions::immutableReadOnly());
+    EXPECT_EQ(1, db.execScalar("SELECT COUNT(*) FROM `myTable`"));
+    transaction.rollback();
+    getRecords().clear();
+}
+
 TEST(StringViewTest, createStringView)
 {
     std::string_view test;